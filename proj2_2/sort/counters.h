@@ -0,0 +1,24 @@
+#ifndef _COUNTERS_H_
+#define _COUNTERS_H_
+
+#include <stdint.h>
+
+/* Operation counters for the sorts.  Building with COUNT=1 defines COUNT_OPS,
+ * and a sort that uses these macros then reports how many key comparisons and
+ * key moves it made.  In a normal build they compile away to nothing.
+ */
+
+#ifdef COUNT_OPS
+extern uint64_t sort_compares;
+extern uint64_t sort_moves;
+#define COUNT_COMPARES(k) (sort_compares += (k))
+#define COUNT_MOVES(k) (sort_moves += (k))
+#else
+#define COUNT_COMPARES(k) ((void) 0)
+#define COUNT_MOVES(k) ((void) 0)
+#endif
+
+/* Count one comparison and yield its result, for use inside conditions. */
+#define CMP(expr) (COUNT_COMPARES(1), (expr))
+
+#endif
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ktiming.h"
+#include "sortlib.h"
+
+/* Testbed for sortlib.c.  Runs every key/payload combination on the same
+ * random input, checks that the keys come out sorted, that every payload
+ * followed its key, and that equal keys kept their input order, and reports
+ * ns/key for each.
+ */
+
+/* Macros */
+
+#define MAX_ELEMENTS 1000000000L
+
+/* Function prototypes */
+
+static uint64_t rng_next(void);
+static void fill(uint64_t *orig, long n);
+static void check(const char *name, const uint64_t *orig, long n,
+                  const void *keys, int key_bytes,
+                  const void *vals, int val_bytes);
+static void report(const char *name, uint64_t nanos, long n, int R);
+
+/* Global variables */
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+/* Function definitions */
+
+int main( int argc, char** argv )
+{
+  long i, N;
+  int j, R, optchar;
+  uint64_t *orig;
+  uint32_t *k32, *v32;
+  uint64_t *k64, *v64;
+  uint64_t t[6] = {0};
+  clockmark_t time1, time2;
+
+  // process command line options
+  while( ( optchar = getopt( argc, argv, "s:" ) ) != -1 ) {
+    switch( optchar ) {
+      case 's':
+        rng_state = (uint64_t) atol(optarg) * 0x9E3779B97F4A7C15ULL + 1;
+        printf("Using user-provided seed: %s\n", optarg);
+        break;
+      default:
+        printf( "Ignoring unrecognized option: %c\n", optchar );
+        continue;
+    }
+  }
+
+  if (argc - optind != 2) {
+    printf("Usage: %s [-s seed] <num_elements> <num_repeats>\n", argv[0]);
+    exit(-1);
+  }
+
+  N = atol(argv[optind]);
+  R = atoi(argv[optind + 1]);
+
+  if (N < 2 || N > MAX_ELEMENTS) {
+    printf("Please pick a number between 2 and %ld\n", MAX_ELEMENTS);
+    exit(-1);
+  }
+
+  orig = (uint64_t *) malloc(N * sizeof(uint64_t));
+  k32 = (uint32_t *) malloc(N * sizeof(uint32_t));
+  v32 = (uint32_t *) malloc(N * sizeof(uint32_t));
+  k64 = (uint64_t *) malloc(N * sizeof(uint64_t));
+  v64 = (uint64_t *) malloc(N * sizeof(uint64_t));
+  if (orig == NULL || k32 == NULL || v32 == NULL || k64 == NULL ||
+      v64 == NULL) {
+    printf("Error: not enough memory\n");
+    exit(-1);
+  }
+
+/* Run one sort on fresh copies of orig, time it, and check the result. */
+#define RUN(slot, name, call, kbytes, vbytes, keys, vals)                   \
+  do {                                                                      \
+    for (i = 0; i < N; i++) {                                               \
+      if (kbytes == 4) k32[i] = (uint32_t) orig[i]; else k64[i] = orig[i];  \
+      if (vbytes == 4) v32[i] = (uint32_t) i; else v64[i] = i;              \
+    }                                                                       \
+    time1 = ktiming_getmark();                                              \
+    if (call < 0) {                                                         \
+      printf("Error: %s ran out of memory\n", name);                        \
+      exit(-1);                                                             \
+    }                                                                       \
+    time2 = ktiming_getmark();                                              \
+    t[slot] += ktiming_diff_nanosec(&time1, &time2);                        \
+    check(name, orig, N, keys, kbytes, vals, vbytes);                       \
+  } while (0)
+
+  for (j = 0; j < R; j++) {
+    fill(orig, N);
+    RUN(0, "u32",     sort_u32(k32, N),          4, 0, k32, NULL);
+    RUN(1, "u64",     sort_u64(k64, N),          8, 0, k64, NULL);
+    RUN(2, "u32_v32", sort_u32_v32(k32, v32, N), 4, 4, k32, v32);
+    RUN(3, "u32_v64", sort_u32_v64(k32, v64, N), 4, 8, k32, v64);
+    RUN(4, "u64_v32", sort_u64_v32(k64, v32, N), 8, 4, k64, v32);
+    RUN(5, "u64_v64", sort_u64_v64(k64, v64, N), 8, 8, k64, v64);
+  }
+  printf("Arrays are sorted: yes\n");
+
+  report("u32", t[0], N, R);
+  report("u64", t[1], N, R);
+  report("u32_v32", t[2], N, R);
+  report("u32_v64", t[3], N, R);
+  report("u64_v32", t[4], N, R);
+  report("u64_v64", t[5], N, R);
+
+  free(orig);
+  free(k32);
+  free(v32);
+  free(k64);
+  free(v64);
+  return 0;
+}
+
+static uint64_t rng_next(void)
+{
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* Random 64-bit keys with plenty of duplicates: about n/2 distinct values,
+ * scrambled by an odd multiplier so they use all 64 bits.  The 32-bit sorts
+ * take the low half of each key. */
+static void fill(uint64_t *orig, long n)
+{
+  long i;
+
+  for (i = 0; i < n; i++) {
+    orig[i] = (rng_next() % (n / 2 + 1)) * 0x9E3779B97F4A7C15ULL;
+  }
+}
+
+static void check(const char *name, const uint64_t *orig, long n,
+                  const void *keys, int key_bytes,
+                  const void *vals, int val_bytes)
+{
+  long i;
+  uint64_t prev_key = 0, prev_val = 0;
+
+  for (i = 0; i < n; i++) {
+    uint64_t key = (key_bytes == 4) ? ((const uint32_t *) keys)[i]
+                                    : ((const uint64_t *) keys)[i];
+    if (i > 0 && key < prev_key) {
+      printf("%s: arrays are sorted: NO!\n", name);
+      exit(-1);
+    }
+    if (vals != NULL) {
+      uint64_t val = (val_bytes == 4) ? ((const uint32_t *) vals)[i]
+                                      : ((const uint64_t *) vals)[i];
+      uint64_t want;
+      if (val >= (uint64_t) n) {
+        printf("%s: payload %ld did not follow its key!\n", name, i);
+        exit(-1);
+      }
+      want = (key_bytes == 4) ? (uint32_t) orig[val] : orig[val];
+      if (want != key) {
+        printf("%s: payload %ld did not follow its key!\n", name, i);
+        exit(-1);
+      }
+      if (i > 0 && key == prev_key && val < prev_val) {
+        printf("%s: equal keys were reordered!\n", name);
+        exit(-1);
+      }
+      prev_val = val;
+    }
+    prev_key = key;
+  }
+}
+
+static void report(const char *name, uint64_t nanos, long n, int R)
+{
+  printf("%-8s %8.2f ns/key  %8.2f sec\n", name,
+         (double) nanos / ((double) n * R), nanos * 1e-9);
+}
@@ -2,6 +2,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "counters.h"
+
 /* Typedefs */
 
 typedef uint32_t data_t;
@@ -14,12 +16,14 @@ void sort(data_t *left, data_t *right)
     data_t val = *cur;
     data_t *index = cur - 1;
 
-    while (index >= left && *index > val) {
+    while (index >= left && CMP(*index > val)) {
       *(index + 1) = *index;
+      COUNT_MOVES(1);
       index--;
     }
 
     *(index + 1) = val;
+    COUNT_MOVES(1);
     cur++;
   }
 }
@@ -2,67 +2,216 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include "counters.h"
+
 /* Typedefs */
 
 typedef uint32_t data_t;
 
+/* Macros */
+
+/* Subarrays at or below this many elements are left for insertion sort. */
+#define INSERTION_CUTOFF 24
+
+/* Above this many elements the pivot is a ninther rather than a median of 3. */
+#define NINTHER_THRESHOLD 128
+
 /* Function prototypes */
 
-inline data_t *partition(data_t *left, data_t *right);
-inline void swap(data_t *a, data_t *b);
+static inline void introsort(data_t *left, data_t *right, int depth);
+static inline void partition(data_t *left, data_t *right,
+                             data_t **less_end, data_t **greater_start);
+static inline data_t *choose_pivot(data_t *left, data_t *right);
+static inline data_t *median3(data_t *a, data_t *b, data_t *c);
+static inline void insertion_sort(data_t *left, data_t *right);
+static void heapsort(data_t *left, data_t *right);
+static inline void sift_down(data_t *heap, size_t root, size_t n);
+static inline void vecswap(data_t *a, data_t *b, size_t n);
+static inline void swap(data_t *a, data_t *b);
 
 /* Function definitions */
 
-/* Basic quick sort */
-void sort(data_t *left, data_t *right) 
+/* Introsort: quicksort that falls back to heapsort once the recursion gets
+ * 2*log2(n) levels deep, and finishes small subarrays with insertion sort.
+ */
+void sort(data_t *left, data_t *right)
 {
-  data_t *p;
+  size_t n = right - left + 1;
+  int depth = 0;
 
-  if (right - left < 1) {
-    return;
+  while (n > 1) {
+    depth += 2;
+    n >>= 1;
   }
 
-  p = partition(left, right);
-  sort(left, p - 1);
-  sort(p + 1, right);
+  introsort(left, right, depth);
 }
 
-/* A fast partition function.  Partitions the array into two parts so that all
- * values from left to the return pointer are smaller than the values from the
- * return pointer + 1 to right.  
- */
-inline data_t *partition(data_t *left, data_t *right) 
-{ 
-  data_t *pivot_ptr = left; 
-  data_t pivot = *pivot_ptr;		/* Choose first element as pivot */
+static inline void introsort(data_t *left, data_t *right, int depth)
+{
+  data_t *less_end, *greater_start;
 
-  left++;
+  while (right - left + 1 > INSERTION_CUTOFF) {
+    if (depth-- == 0) {
+      heapsort(left, right);
+      return;
+    }
+
+    swap(left, choose_pivot(left, right));
+    partition(left, right, &less_end, &greater_start);
 
-  while (left < right) {
-    while (left < right && *left <= pivot) {
-      left++;
+    /* Recurse on the smaller side and loop on the larger one, so the stack
+     * never grows past log2(n) frames. */
+    if (less_end - left < right - greater_start) {
+      introsort(left, less_end, depth);
+      left = greater_start;
+    } else {
+      introsort(greater_start, right, depth);
+      right = less_end;
     }
-    while (left < right && *right > pivot) {
-      right--;
+  }
+
+  insertion_sort(left, right);
+}
+
+/* Three-way partition (Bentley-McIlroy) around the pivot in *left.  Afterwards
+ * everything in [left, *less_end] is smaller than the pivot, everything in
+ * [*greater_start, right] is larger, and everything in between is equal to it,
+ * so runs of duplicate keys drop out of the recursion immediately.
+ */
+static inline void partition(data_t *left, data_t *right,
+                             data_t **less_end, data_t **greater_start)
+{
+  data_t pivot = *left;
+  data_t *a = left + 1, *b = left + 1;  /* [left, a) holds equal keys */
+  data_t *c = right, *d = right;        /* (d, right] holds equal keys */
+  size_t s;
+
+  for (;;) {
+    while (b <= c && CMP(*b <= pivot)) {
+      if (CMP(*b == pivot)) {
+        swap(a++, b);
+      }
+      b++;
     }
-    if (left < right) {
-      swap(left, right);
+    while (c >= b && CMP(*c >= pivot)) {
+      if (CMP(*c == pivot)) {
+        swap(c, d--);
+      }
+      c--;
     }
+    if (b > c) {
+      break;
+    }
+    swap(b++, c--);
   }
 
-  if (pivot > *left) {
-    swap(pivot_ptr, left);
-    return left;
+  /* Move the equal keys from both ends into the middle. */
+  s = (a - left < b - a) ? a - left : b - a;
+  vecswap(left, b - s, s);
+  s = (d - c < right - d) ? d - c : right - d;
+  vecswap(b, right - s + 1, s);
+
+  *less_end = left + (b - a) - 1;
+  *greater_start = right - (d - c) + 1;
+}
+
+/* Pick a pivot that is robust against sorted, reversed and organ-pipe input:
+ * the median of three for small subarrays, Tukey's ninther for large ones.
+ */
+static inline data_t *choose_pivot(data_t *left, data_t *right)
+{
+  size_t n = right - left + 1;
+  data_t *mid = left + n / 2;
+
+  if (n > NINTHER_THRESHOLD) {
+    size_t s = n / 8;
+    data_t *m1 = median3(left, left + s, left + 2 * s);
+    data_t *m2 = median3(mid - s, mid, mid + s);
+    data_t *m3 = median3(right - 2 * s, right - s, right);
+    return median3(m1, m2, m3);
+  }
+
+  return median3(left, mid, right);
+}
+
+static inline data_t *median3(data_t *a, data_t *b, data_t *c)
+{
+  if (CMP(*a < *b)) {
+    if (CMP(*b < *c)) return b;
+    return CMP(*a < *c) ? c : a;
   } else {
-    swap(pivot_ptr, left - 1);
-    return left - 1;
+    if (CMP(*a < *c)) return a;
+    return CMP(*b < *c) ? c : b;
+  }
+}
+
+/* Insertion sort, as in sort1.c */
+static inline void insertion_sort(data_t *left, data_t *right)
+{
+  data_t *cur = left + 1;
+  while (cur <= right) {
+    data_t val = *cur;
+    data_t *index = cur - 1;
+
+    while (index >= left && CMP(*index > val)) {
+      *(index + 1) = *index;
+      COUNT_MOVES(1);
+      index--;
+    }
+
+    *(index + 1) = val;
+    COUNT_MOVES(1);
+    cur++;
+  }
+}
+
+/* Heapsort, used when quicksort has gone too deep to guarantee O(n log n). */
+static void heapsort(data_t *left, data_t *right)
+{
+  size_t n = right - left + 1;
+  size_t i;
+
+  for (i = n / 2; i > 0; i--) {
+    sift_down(left, i - 1, n);
+  }
+  for (i = n - 1; i > 0; i--) {
+    swap(left, left + i);
+    sift_down(left, 0, i);
   }
 }
 
-inline void swap(data_t *a, data_t *b)
+static inline void sift_down(data_t *heap, size_t root, size_t n)
+{
+  data_t val = heap[root];
+  size_t child;
+
+  while ((child = 2 * root + 1) < n) {
+    if (child + 1 < n && CMP(heap[child] < heap[child + 1])) {
+      child++;
+    }
+    if (CMP(heap[child] <= val)) {
+      break;
+    }
+    heap[root] = heap[child];
+    COUNT_MOVES(1);
+    root = child;
+  }
+  heap[root] = val;
+  COUNT_MOVES(1);
+}
+
+static inline void vecswap(data_t *a, data_t *b, size_t n)
+{
+  while (n-- > 0) {
+    swap(a++, b++);
+  }
+}
+
+static inline void swap(data_t *a, data_t *b)
 {
   data_t tmp = *a;
   *a = *b;
   *b = tmp;
+  COUNT_MOVES(2);
 }
-
@@ -1,37 +1,149 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <xmmintrin.h>
 
+#include "counters.h"
+
 /* Typedefs */
 
 typedef uint32_t data_t;
 
-/* Function prototypes */
-
 /* Macros */
 
-#define RADIX_BITS 4
+#define RADIX_BITS 11
 #define BUCKETS (1 << RADIX_BITS)
-#define MAX_ARRAY_SIZE 100000
+#define DIGIT_MASK (BUCKETS - 1)
+#define PASSES ((32 + RADIX_BITS - 1) / RADIX_BITS)
+
+/* Number of keys in one 64-byte cache line.  Each bucket stages this many keys
+ * in a write-combining buffer before they are copied out to their final
+ * location, so the scatter writes whole lines instead of touching 2048
+ * different lines one key at a time. */
+#define WC_KEYS (64 / sizeof(data_t))
+
+/* How far ahead of the read pointer we prefetch, in keys. */
+#define PREFETCH_DIST 64
+
+#define DIGIT(key, pass) (((key) >> ((pass) * RADIX_BITS)) & DIGIT_MASK)
 
 /* Globals */
 
-/* For simplicity, we will statically allocate the radix sort queues here.  
- * Note that if we make this array too big, the program will fail to load when
- * started. */
-data_t queues[BUCKETS][MAX_ARRAY_SIZE];
+/* The ping-pong buffer that every other pass scatters into.  It only ever
+ * grows, so repeated sorts of the same size don't go back to malloc. */
+static data_t *scratch = NULL;
+static size_t scratch_size = 0;
+
+/* Software write-combining buffers, one cache line per bucket. */
+static data_t wc_buf[BUCKETS][WC_KEYS] __attribute__((aligned(64)));
+static unsigned char wc_fill[BUCKETS];
+
+/* Function prototypes */
+
+static void scatter(const data_t *src, data_t *dst, size_t n, int pass,
+                    size_t *offsets);
 
 /* Function definitions */
 
-/* Radix sort */
-void sort(data_t *left, data_t *right) 
+/* LSD radix sort on RADIX_BITS-bit digits */
+void sort(data_t *left, data_t *right)
 {
-  /* Use this to keep track of the tail of each of the queues */
-  int queue_tails[BUCKETS] = {0}; 
+  size_t n = right - left + 1;
+  size_t counts[PASSES][BUCKETS];
+  size_t i;
+  int pass, b;
+  data_t *src = left;
+  data_t *dst;
+
+  if (n < 2) {
+    return;
+  }
+
+  if (scratch_size < n) {
+    free(scratch);
+    scratch = (data_t *) malloc(n * sizeof(data_t));
+    if (scratch == NULL) {
+      printf("Error: not enough memory for radix sort buffer\n");
+      exit(-1);
+    }
+    scratch_size = n;
+  }
+  dst = scratch;
+
+  /* Build the histograms for every pass in one read of the input. */
+  memset(counts, 0, sizeof(counts));
+  for (i = 0; i < n; i++) {
+    data_t key = left[i];
+    _mm_prefetch((const char *) &left[i + PREFETCH_DIST], _MM_HINT_T0);
+    for (pass = 0; pass < PASSES; pass++) {
+      counts[pass][DIGIT(key, pass)]++;
+    }
+  }
+
+  for (pass = 0; pass < PASSES; pass++) {
+    size_t offsets[BUCKETS];
+    size_t sum = 0;
+
+    /* If every key has the same digit, this pass would only copy the array. */
+    if (counts[pass][DIGIT(left[0], pass)] == n) {
+      continue;
+    }
+
+    /* Exclusive prefix sum gives the starting offset of each bucket. */
+    for (b = 0; b < BUCKETS; b++) {
+      offsets[b] = sum;
+      sum += counts[pass][b];
+    }
+
+    scatter(src, dst, n, pass, offsets);
+    COUNT_MOVES(n);
+
+    data_t *tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+
+  /* An odd number of real passes leaves the result in the scratch buffer. */
+  if (src != left) {
+    memcpy(left, src, n * sizeof(data_t));
+    COUNT_MOVES(n);
+  }
+}
+
+/* Distribute src into dst by the digit for this pass, staging keys through the
+ * write-combining buffers.  offsets[b] is where bucket b's next key goes.
+ */
+static void scatter(const data_t *src, data_t *dst, size_t n, int pass,
+                    size_t *offsets)
+{
+  size_t i;
+  int b, k;
+
+  memset(wc_fill, 0, sizeof(wc_fill));
+
+  for (i = 0; i < n; i++) {
+    data_t key = src[i];
+    _mm_prefetch((const char *) &src[i + PREFETCH_DIST], _MM_HINT_T0);
+
+    b = DIGIT(key, pass);
+    wc_buf[b][wc_fill[b]++] = key;
 
-  /* Fill in this function... */
+    if (wc_fill[b] == WC_KEYS) {
+      data_t *out = dst + offsets[b];
+      for (k = 0; k < WC_KEYS; k++) {
+        out[k] = wc_buf[b][k];
+      }
+      offsets[b] += WC_KEYS;
+      wc_fill[b] = 0;
+    }
+  }
 
-  /* Prefetch data with this function: 
-    _mm_prefetch((const char *) <address>, _MM_HINT_T0); */
+  /* Flush whatever is left over in each bucket. */
+  for (b = 0; b < BUCKETS; b++) {
+    data_t *out = dst + offsets[b];
+    for (k = 0; k < wc_fill[b]; k++) {
+      out[k] = wc_buf[b][k];
+    }
+  }
 }
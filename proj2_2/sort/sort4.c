@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "counters.h"
+
+/* Typedefs */
+
+typedef uint32_t data_t;
+
+/* Macros */
+
+/* Subarrays at or below this many elements are left for insertion sort. */
+#define INSERTION_CUTOFF 24
+
+/* Above this many elements the pivot is a ninther rather than a median of 3. */
+#define NINTHER_THRESHOLD 128
+
+/* Number of elements scanned per block.  Offsets into a block are stored in
+ * unsigned chars, so this can be at most 256. */
+#define BLOCK 128
+
+/* Function prototypes */
+
+static inline void introsort(data_t *left, data_t *right, int depth);
+static inline data_t *partition(data_t *left, data_t *right);
+static inline data_t *choose_pivot(data_t *left, data_t *right);
+static inline data_t *median3(data_t *a, data_t *b, data_t *c);
+static inline void insertion_sort(data_t *left, data_t *right);
+static void heapsort(data_t *left, data_t *right);
+static inline void sift_down(data_t *heap, size_t root, size_t n);
+static inline void swap(data_t *a, data_t *b);
+
+/* Function definitions */
+
+/* BlockQuicksort: the introsort from sort2.c with a partition loop whose
+ * comparisons never feed a branch.
+ */
+void sort(data_t *left, data_t *right)
+{
+  size_t n = right - left + 1;
+  int depth = 0;
+
+  while (n > 1) {
+    depth += 2;
+    n >>= 1;
+  }
+
+  introsort(left, right, depth);
+}
+
+static inline void introsort(data_t *left, data_t *right, int depth)
+{
+  data_t *p;
+
+  while (right - left + 1 > INSERTION_CUTOFF) {
+    if (depth-- == 0) {
+      heapsort(left, right);
+      return;
+    }
+
+    swap(left, choose_pivot(left, right));
+    p = partition(left, right);
+
+    /* Recurse on the smaller side and loop on the larger one. */
+    if (p - left < right - p) {
+      introsort(left, p - 1, depth);
+      left = p + 1;
+    } else {
+      introsort(p + 1, right, depth);
+      right = p - 1;
+    }
+  }
+
+  insertion_sort(left, right);
+}
+
+/* Block partition around the pivot in *left.  Each side scans a block of BLOCK
+ * elements and writes the offset of every element into its buffer, bumping the
+ * count only when the element is on the wrong side.  The comparison result is
+ * used as an integer rather than a branch condition, so the scan never
+ * mispredicts.  The misplaced elements are then swapped pairwise in bulk.
+ *
+ * Returns p such that [left, p) <= *p <= (p, right].
+ */
+static inline data_t *partition(data_t *left, data_t *right)
+{
+  data_t pivot = *left;
+  data_t *l = left + 1;  /* everything before l is <= pivot */
+  data_t *r = right;     /* everything after r is >= pivot */
+  unsigned char offsets_l[BLOCK], offsets_r[BLOCK];
+  int num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+  int i, num;
+
+  while (r - l + 1 > 2 * BLOCK) {
+    if (num_l == 0) {
+      start_l = 0;
+      for (i = 0; i < BLOCK; i++) {
+        offsets_l[num_l] = i;
+        num_l += (l[i] >= pivot);
+      }
+      COUNT_COMPARES(BLOCK);
+    }
+    if (num_r == 0) {
+      start_r = 0;
+      for (i = 0; i < BLOCK; i++) {
+        offsets_r[num_r] = i;
+        num_r += (*(r - i) <= pivot);
+      }
+      COUNT_COMPARES(BLOCK);
+    }
+
+    num = (num_l < num_r) ? num_l : num_r;
+    for (i = 0; i < num; i++) {
+      swap(l + offsets_l[start_l + i], r - offsets_r[start_r + i]);
+    }
+
+    num_l -= num;
+    num_r -= num;
+    start_l += num;
+    start_r += num;
+    if (num_l == 0) {
+      l += BLOCK;
+    }
+    if (num_r == 0) {
+      r -= BLOCK;
+    }
+  }
+
+  /* Fewer than two blocks remain, possibly including one half-finished block.
+   * Finish with an ordinary Hoare scan, which skips the elements already in
+   * place. */
+  for (;;) {
+    while (l <= r && CMP(*l < pivot)) {
+      l++;
+    }
+    while (l <= r && CMP(*r > pivot)) {
+      r--;
+    }
+    if (l >= r) {
+      break;
+    }
+    swap(l++, r--);
+  }
+
+  swap(left, r);
+  return r;
+}
+
+/* Median of three for small subarrays, Tukey's ninther for large ones. */
+static inline data_t *choose_pivot(data_t *left, data_t *right)
+{
+  size_t n = right - left + 1;
+  data_t *mid = left + n / 2;
+
+  if (n > NINTHER_THRESHOLD) {
+    size_t s = n / 8;
+    data_t *m1 = median3(left, left + s, left + 2 * s);
+    data_t *m2 = median3(mid - s, mid, mid + s);
+    data_t *m3 = median3(right - 2 * s, right - s, right);
+    return median3(m1, m2, m3);
+  }
+
+  return median3(left, mid, right);
+}
+
+static inline data_t *median3(data_t *a, data_t *b, data_t *c)
+{
+  if (CMP(*a < *b)) {
+    if (CMP(*b < *c)) return b;
+    return CMP(*a < *c) ? c : a;
+  } else {
+    if (CMP(*a < *c)) return a;
+    return CMP(*b < *c) ? c : b;
+  }
+}
+
+/* Insertion sort, as in sort1.c */
+static inline void insertion_sort(data_t *left, data_t *right)
+{
+  data_t *cur = left + 1;
+  while (cur <= right) {
+    data_t val = *cur;
+    data_t *index = cur - 1;
+
+    while (index >= left && CMP(*index > val)) {
+      *(index + 1) = *index;
+      COUNT_MOVES(1);
+      index--;
+    }
+
+    *(index + 1) = val;
+    COUNT_MOVES(1);
+    cur++;
+  }
+}
+
+/* Heapsort fallback, as in sort2.c */
+static void heapsort(data_t *left, data_t *right)
+{
+  size_t n = right - left + 1;
+  size_t i;
+
+  for (i = n / 2; i > 0; i--) {
+    sift_down(left, i - 1, n);
+  }
+  for (i = n - 1; i > 0; i--) {
+    swap(left, left + i);
+    sift_down(left, 0, i);
+  }
+}
+
+static inline void sift_down(data_t *heap, size_t root, size_t n)
+{
+  data_t val = heap[root];
+  size_t child;
+
+  while ((child = 2 * root + 1) < n) {
+    if (child + 1 < n && CMP(heap[child] < heap[child + 1])) {
+      child++;
+    }
+    if (CMP(heap[child] <= val)) {
+      break;
+    }
+    heap[root] = heap[child];
+    COUNT_MOVES(1);
+    root = child;
+  }
+  heap[root] = val;
+  COUNT_MOVES(1);
+}
+
+static inline void swap(data_t *a, data_t *b)
+{
+  data_t tmp = *a;
+  *a = *b;
+  *b = tmp;
+  COUNT_MOVES(2);
+}
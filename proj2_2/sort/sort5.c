@@ -0,0 +1,483 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+/* Typedefs */
+
+typedef uint32_t data_t;
+
+/* Macros */
+
+/* Keys per AVX2 register. */
+#define LANES 8
+
+/* Keys sorted together in registers before any merging: an 8x8 block. */
+#define BLOCK (LANES * LANES)
+
+/* Keys per chunk sorted entirely within cache before the final multiway merge.
+ * The chunk and its half of the scratch buffer take 512KB together, which
+ * stays in L2 on current x86 parts.  Must be a multiple of BLOCK. */
+#define CHUNK (1 << 16)
+
+/* Capacity in keys of the buffer between two levels of the merge tree.
+ * Must be a multiple of LANES. */
+#define NODE_KEYS 256
+
+/* Typedefs */
+
+/* A node in the multiway merge tree.  Leaves read straight from a sorted run;
+ * internal nodes merge their two children into a ring buffer. */
+typedef struct node {
+  struct node *left, *right;  /* children, NULL for a leaf */
+  data_t *keys;               /* leaf: next unread key; internal: ring buffer */
+  size_t head;                /* internal: index of the next key to hand out */
+  size_t count;               /* keys available to the parent right now */
+  data_t carry[LANES];        /* internal: the 8 largest keys merged so far */
+  enum {MERGE_IDLE, MERGE_RUNNING, MERGE_DONE} state;
+} node_t;
+
+/* Function prototypes */
+
+static inline void compare_exchange(__m256i *a, __m256i *b);
+static inline __m256i bitonic_clean(__m256i v);
+static inline void bitonic_merge(__m256i *a, __m256i *b);
+static inline void sort_block(data_t *p);
+static inline void merge_runs(const data_t *a, size_t na, const data_t *b,
+                              size_t nb, data_t *out);
+static void sort_chunk(data_t *chunk, data_t *buf, size_t n);
+static inline data_t *node_front(node_t *node);
+static inline data_t *node_back(node_t *node);
+static inline void node_pop(node_t *node);
+static void refill(node_t *node);
+static node_t *build_tree(node_t *nodes, int *next_node, data_t *data,
+                          size_t *starts, size_t *ends, int lo, int hi,
+                          data_t *buffers);
+static void multiway_merge(data_t *data, size_t *starts, size_t *ends, int k,
+                           data_t *out);
+static void merge_tail(const data_t *a, size_t na, const data_t *b, size_t nb,
+                       data_t *out);
+static void insertion_sort(data_t *left, data_t *right);
+
+/* Globals */
+
+/* Grow-only scratch buffer, as in sort3.c. */
+static data_t *scratch = NULL;
+static size_t scratch_size = 0;
+
+/* Function definitions */
+
+/* AVX2 merge sort.  Blocks of 64 keys are sorted in registers with a sorting
+ * network, chunks of CHUNK keys are built up from them with vectorized bitonic
+ * merges while they are hot in cache, and the chunks are combined with a
+ * single multiway merge through a tree of vector merges.
+ */
+void sort(data_t *left, data_t *right)
+{
+  size_t n = right - left + 1;
+  size_t body = n - n % BLOCK;  /* keys handled by the vector code */
+  size_t *starts, *ends;
+  size_t i;
+  int k = 0;
+
+  if (n <= BLOCK) {
+    insertion_sort(left, right);
+    return;
+  }
+
+  if (scratch_size < n) {
+    free(scratch);
+    scratch = (data_t *) malloc(n * sizeof(data_t));
+    if (scratch == NULL) {
+      printf("Error: not enough memory for merge sort buffer\n");
+      exit(-1);
+    }
+    scratch_size = n;
+  }
+
+  /* One run per chunk. */
+  int max_runs = (int) ((body + CHUNK - 1) / CHUNK);
+  starts = (size_t *) malloc(max_runs * sizeof(size_t));
+  ends = (size_t *) malloc(max_runs * sizeof(size_t));
+  if (starts == NULL || ends == NULL) {
+    printf("Error: not enough memory for merge runs\n");
+    exit(-1);
+  }
+
+  for (i = 0; i < body; i += CHUNK) {
+    size_t len = (body - i < CHUNK) ? body - i : CHUNK;
+    sort_chunk(left + i, scratch + i, len);
+    starts[k] = i;
+    ends[k] = i + len;
+    k++;
+  }
+
+  if (k > 1) {
+    multiway_merge(left, starts, ends, k, scratch);
+  } else {
+    memcpy(scratch, left, body * sizeof(data_t));
+  }
+
+  /* The last n % BLOCK keys never went through the vector code.  Sort them on
+   * their own and fold them in while copying the result back. */
+  if (body < n) {
+    insertion_sort(left + body, right);
+    merge_tail(scratch, body, left + body, n - body, left);
+  } else {
+    memcpy(left, scratch, n * sizeof(data_t));
+  }
+
+  free(starts);
+  free(ends);
+}
+
+/* Put the lanewise minimum in *a and the maximum in *b. */
+static inline void compare_exchange(__m256i *a, __m256i *b)
+{
+  __m256i lo = _mm256_min_epu32(*a, *b);
+  __m256i hi = _mm256_max_epu32(*a, *b);
+  *a = lo;
+  *b = hi;
+}
+
+/* Sort a bitonic sequence held in one register: compare-exchange at distance
+ * 4, then 2, then 1, keeping the minimum in the lower lane of each pair.
+ */
+static inline __m256i bitonic_clean(__m256i v)
+{
+  __m256i p;
+
+  p = _mm256_permute2x128_si256(v, v, 0x01);
+  v = _mm256_blend_epi32(_mm256_min_epu32(v, p), _mm256_max_epu32(v, p), 0xF0);
+
+  p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+  v = _mm256_blend_epi32(_mm256_min_epu32(v, p), _mm256_max_epu32(v, p), 0xCC);
+
+  p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+  v = _mm256_blend_epi32(_mm256_min_epu32(v, p), _mm256_max_epu32(v, p), 0xAA);
+
+  return v;
+}
+
+/* Merge two sorted registers: afterwards *a holds the 8 smallest keys and *b
+ * the 8 largest, both sorted.
+ */
+static inline void bitonic_merge(__m256i *a, __m256i *b)
+{
+  const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  __m256i r = _mm256_permutevar8x32_epi32(*b, reverse);
+
+  /* a ascending followed by b descending is bitonic; one compare-exchange
+   * splits it into two bitonic halves with every key in the low half below
+   * every key in the high half. */
+  compare_exchange(a, &r);
+  *a = bitonic_clean(*a);
+  *b = bitonic_clean(r);
+}
+
+/* Sort 64 keys at p into four sorted runs of 16. */
+static inline void sort_block(data_t *p)
+{
+  __m256i r0 = _mm256_loadu_si256((__m256i *) (p + 0 * LANES));
+  __m256i r1 = _mm256_loadu_si256((__m256i *) (p + 1 * LANES));
+  __m256i r2 = _mm256_loadu_si256((__m256i *) (p + 2 * LANES));
+  __m256i r3 = _mm256_loadu_si256((__m256i *) (p + 3 * LANES));
+  __m256i r4 = _mm256_loadu_si256((__m256i *) (p + 4 * LANES));
+  __m256i r5 = _mm256_loadu_si256((__m256i *) (p + 5 * LANES));
+  __m256i r6 = _mm256_loadu_si256((__m256i *) (p + 6 * LANES));
+  __m256i r7 = _mm256_loadu_si256((__m256i *) (p + 7 * LANES));
+  __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+
+  /* 19-comparator network for 8 inputs, applied to all 8 columns at once. */
+  compare_exchange(&r0, &r2); compare_exchange(&r1, &r3);
+  compare_exchange(&r4, &r6); compare_exchange(&r5, &r7);
+  compare_exchange(&r0, &r4); compare_exchange(&r1, &r5);
+  compare_exchange(&r2, &r6); compare_exchange(&r3, &r7);
+  compare_exchange(&r0, &r1); compare_exchange(&r2, &r3);
+  compare_exchange(&r4, &r5); compare_exchange(&r6, &r7);
+  compare_exchange(&r2, &r4); compare_exchange(&r3, &r5);
+  compare_exchange(&r1, &r4); compare_exchange(&r3, &r6);
+  compare_exchange(&r1, &r2); compare_exchange(&r3, &r4);
+  compare_exchange(&r5, &r6);
+
+  /* Transpose, so that each register holds one sorted column. */
+  t0 = _mm256_unpacklo_epi32(r0, r1);
+  t1 = _mm256_unpackhi_epi32(r0, r1);
+  t2 = _mm256_unpacklo_epi32(r2, r3);
+  t3 = _mm256_unpackhi_epi32(r2, r3);
+  t4 = _mm256_unpacklo_epi32(r4, r5);
+  t5 = _mm256_unpackhi_epi32(r4, r5);
+  t6 = _mm256_unpacklo_epi32(r6, r7);
+  t7 = _mm256_unpackhi_epi32(r6, r7);
+
+  r0 = _mm256_unpacklo_epi64(t0, t2);
+  r1 = _mm256_unpackhi_epi64(t0, t2);
+  r2 = _mm256_unpacklo_epi64(t1, t3);
+  r3 = _mm256_unpackhi_epi64(t1, t3);
+  r4 = _mm256_unpacklo_epi64(t4, t6);
+  r5 = _mm256_unpackhi_epi64(t4, t6);
+  r6 = _mm256_unpacklo_epi64(t5, t7);
+  r7 = _mm256_unpackhi_epi64(t5, t7);
+
+  t0 = _mm256_permute2x128_si256(r0, r4, 0x20);
+  t1 = _mm256_permute2x128_si256(r1, r5, 0x20);
+  t2 = _mm256_permute2x128_si256(r2, r6, 0x20);
+  t3 = _mm256_permute2x128_si256(r3, r7, 0x20);
+  t4 = _mm256_permute2x128_si256(r0, r4, 0x31);
+  t5 = _mm256_permute2x128_si256(r1, r5, 0x31);
+  t6 = _mm256_permute2x128_si256(r2, r6, 0x31);
+  t7 = _mm256_permute2x128_si256(r3, r7, 0x31);
+
+  /* Merge pairs of columns into runs of 16. */
+  bitonic_merge(&t0, &t1);
+  bitonic_merge(&t2, &t3);
+  bitonic_merge(&t4, &t5);
+  bitonic_merge(&t6, &t7);
+
+  _mm256_storeu_si256((__m256i *) (p + 0 * LANES), t0);
+  _mm256_storeu_si256((__m256i *) (p + 1 * LANES), t1);
+  _mm256_storeu_si256((__m256i *) (p + 2 * LANES), t2);
+  _mm256_storeu_si256((__m256i *) (p + 3 * LANES), t3);
+  _mm256_storeu_si256((__m256i *) (p + 4 * LANES), t4);
+  _mm256_storeu_si256((__m256i *) (p + 5 * LANES), t5);
+  _mm256_storeu_si256((__m256i *) (p + 6 * LANES), t6);
+  _mm256_storeu_si256((__m256i *) (p + 7 * LANES), t7);
+}
+
+/* Merge sorted runs a and b, whose lengths are nonzero multiples of 8, into
+ * out.  One register carries the 8 largest keys seen so far; each step loads
+ * the next 8 keys from whichever run has the smaller head, merges, and emits
+ * the lower half.
+ */
+static inline void merge_runs(const data_t *a, size_t na, const data_t *b,
+                              size_t nb, data_t *out)
+{
+  const data_t *a_end = a + na, *b_end = b + nb;
+  __m256i lo = _mm256_loadu_si256((__m256i *) a);
+  __m256i hi = _mm256_loadu_si256((__m256i *) b);
+
+  a += LANES;
+  b += LANES;
+  bitonic_merge(&lo, &hi);
+  _mm256_storeu_si256((__m256i *) out, lo);
+  out += LANES;
+
+  while (a < a_end || b < b_end) {
+    if (b >= b_end || (a < a_end && *a <= *b)) {
+      lo = _mm256_loadu_si256((__m256i *) a);
+      a += LANES;
+    } else {
+      lo = _mm256_loadu_si256((__m256i *) b);
+      b += LANES;
+    }
+    bitonic_merge(&lo, &hi);
+    _mm256_storeu_si256((__m256i *) out, lo);
+    out += LANES;
+  }
+
+  _mm256_storeu_si256((__m256i *) out, hi);
+}
+
+/* Sort n keys (a multiple of BLOCK) in place, using buf as scratch. */
+static void sort_chunk(data_t *chunk, data_t *buf, size_t n)
+{
+  data_t *src = chunk, *dst = buf, *tmp;
+  size_t width, i;
+
+  for (i = 0; i < n; i += BLOCK) {
+    sort_block(chunk + i);
+  }
+
+  /* Bottom-up merge passes, ping-ponging between chunk and buf. */
+  for (width = 2 * LANES; width < n; width *= 2) {
+    for (i = 0; i < n; i += 2 * width) {
+      if (i + width >= n) {
+        memcpy(dst + i, src + i, (n - i) * sizeof(data_t));
+      } else {
+        size_t nb = (n - i - width < width) ? n - i - width : width;
+        merge_runs(src + i, width, src + i + width, nb, dst + i);
+      }
+    }
+    tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+
+  if (src != chunk) {
+    memcpy(chunk, src, n * sizeof(data_t));
+  }
+}
+
+static inline data_t *node_front(node_t *node)
+{
+  return (node->left == NULL) ? node->keys : node->keys + node->head;
+}
+
+static inline data_t *node_back(node_t *node)
+{
+  return node->keys + (node->head + node->count) % NODE_KEYS;
+}
+
+static inline void node_pop(node_t *node)
+{
+  if (node->left == NULL) {
+    node->keys += LANES;
+  } else {
+    node->head = (node->head + LANES) % NODE_KEYS;
+  }
+  node->count -= LANES;
+}
+
+/* Pull keys down through the merge tree until node's buffer is full or both
+ * of its inputs have run dry.  A child is only empty here once it is finished
+ * for good, because it is refilled as soon as it runs out.
+ */
+static void refill(node_t *node)
+{
+  node_t *l = node->left, *r = node->right;
+  __m256i lo, hi = _mm256_loadu_si256((__m256i *) node->carry);
+
+  while (node->state != MERGE_DONE && node->count + LANES <= NODE_KEYS) {
+    if (l->count == 0 && l->left != NULL && l->state != MERGE_DONE) {
+      refill(l);
+    }
+    if (r->count == 0 && r->left != NULL && r->state != MERGE_DONE) {
+      refill(r);
+    }
+
+    if (node->state == MERGE_IDLE) {
+      lo = _mm256_loadu_si256((__m256i *) node_front(l));
+      hi = _mm256_loadu_si256((__m256i *) node_front(r));
+      node_pop(l);
+      node_pop(r);
+      node->state = MERGE_RUNNING;
+    } else if (l->count == 0 && r->count == 0) {
+      _mm256_storeu_si256((__m256i *) node_back(node), hi);
+      node->count += LANES;
+      node->state = MERGE_DONE;
+      break;
+    } else if (r->count == 0 ||
+               (l->count > 0 && *node_front(l) <= *node_front(r))) {
+      lo = _mm256_loadu_si256((__m256i *) node_front(l));
+      node_pop(l);
+    } else {
+      lo = _mm256_loadu_si256((__m256i *) node_front(r));
+      node_pop(r);
+    }
+
+    bitonic_merge(&lo, &hi);
+    _mm256_storeu_si256((__m256i *) node_back(node), lo);
+    node->count += LANES;
+  }
+
+  _mm256_storeu_si256((__m256i *) node->carry, hi);
+}
+
+/* Build a balanced merge tree over runs[lo, hi) in nodes, starting at
+ * *next_node.  Returns the root of the subtree.
+ */
+static node_t *build_tree(node_t *nodes, int *next_node, data_t *data,
+                          size_t *starts, size_t *ends, int lo, int hi,
+                          data_t *buffers)
+{
+  node_t *node = &nodes[(*next_node)++];
+
+  memset(node, 0, sizeof(node_t));
+  if (hi - lo == 1) {
+    node->keys = data + starts[lo];
+    node->count = ends[lo] - starts[lo];
+    return node;
+  }
+
+  int mid = lo + (hi - lo) / 2;
+  node->keys = buffers + (size_t) (node - nodes) * NODE_KEYS;
+  node->left = build_tree(nodes, next_node, data, starts, ends, lo, mid,
+                          buffers);
+  node->right = build_tree(nodes, next_node, data, starts, ends, mid, hi,
+                           buffers);
+  return node;
+}
+
+/* Merge the k sorted runs data[starts[i] .. ends[i]), whose lengths are
+ * multiples of 8, into out.  Rather than log2(k) passes of two-way merging
+ * over the whole array, the runs feed a tree of two-way vector merges whose
+ * nodes pass keys upward through small buffers.  The buffers for 150 runs take
+ * about 150KB, so every key is read from memory once and written once, and all
+ * the intermediate merging happens in cache.
+ */
+static void multiway_merge(data_t *data, size_t *starts, size_t *ends, int k,
+                           data_t *out)
+{
+  int next_node = 0;
+  node_t *nodes, *root;
+  data_t *buffers;
+
+  nodes = (node_t *) malloc((2 * k - 1) * sizeof(node_t));
+  buffers = (data_t *) malloc((size_t) (2 * k - 1) * NODE_KEYS *
+                              sizeof(data_t));
+  if (nodes == NULL || buffers == NULL) {
+    printf("Error: not enough memory for multiway merge\n");
+    exit(-1);
+  }
+
+  root = build_tree(nodes, &next_node, data, starts, ends, 0, k, buffers);
+
+  for (;;) {
+    if (root->count == 0) {
+      if (root->state == MERGE_DONE) {
+        break;
+      }
+      refill(root);
+    }
+    _mm256_storeu_si256((__m256i *) out,
+                        _mm256_loadu_si256((__m256i *) node_front(root)));
+    node_pop(root);
+    out += LANES;
+  }
+
+  free(nodes);
+  free(buffers);
+}
+
+/* Scalar merge of a (na keys) and a short tail b (nb keys) into out.  b is
+ * copied aside first, since it is allowed to sit at the end of out.
+ */
+static void merge_tail(const data_t *a, size_t na, const data_t *b, size_t nb,
+                       data_t *out)
+{
+  data_t tail[BLOCK];
+  const data_t *a_end = a + na, *b_end;
+
+  memcpy(tail, b, nb * sizeof(data_t));
+  b = tail;
+  b_end = tail + nb;
+
+  while (a < a_end && b < b_end) {
+    *out++ = (*b < *a) ? *b++ : *a++;
+  }
+  while (a < a_end) {
+    *out++ = *a++;
+  }
+  while (b < b_end) {
+    *out++ = *b++;
+  }
+}
+
+/* Insertion sort, as in sort1.c */
+static void insertion_sort(data_t *left, data_t *right)
+{
+  data_t *cur = left + 1;
+  while (cur <= right) {
+    data_t val = *cur;
+    data_t *index = cur - 1;
+
+    while (index >= left && *index > val) {
+      *(index + 1) = *index;
+      index--;
+    }
+
+    *(index + 1) = val;
+    cur++;
+  }
+}
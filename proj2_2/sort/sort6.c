@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+/* Typedefs */
+
+typedef uint32_t data_t;
+
+/* Macros */
+
+#define RADIX_BITS 8
+#define BUCKETS (1 << RADIX_BITS)
+#define DIGIT_MASK (BUCKETS - 1)
+#define PASSES (32 / RADIX_BITS)
+
+#define DIGIT(key, pass) (((key) >> ((pass) * RADIX_BITS)) & DIGIT_MASK)
+
+/* Below this many keys per thread, the parallel phases cost more than they
+ * save and we just radix sort on the calling thread. */
+#define MIN_KEYS_PER_THREAD (1 << 16)
+
+/* Samples drawn per bucket when choosing splitters.  More samples make the
+ * buckets more even at the cost of a bigger sample to sort. */
+#define OVERSAMPLE 128
+
+/* Typedefs */
+
+/* Everything shared between the worker threads of one sort() call. */
+typedef struct {
+  data_t *data;           /* the array being sorted */
+  data_t *buf;            /* scratch space the size of data */
+  size_t n;               /* number of keys */
+  int threads;            /* number of workers, and of buckets */
+  data_t *splitters;      /* threads - 1 sorted splitters */
+  size_t *splitter_pos;   /* the input index each splitter was drawn from */
+  size_t *counts;         /* counts[t * threads + b]: keys from t's block in b */
+  size_t *offsets;        /* offsets[t * threads + b]: where t writes into b */
+  size_t *bucket_starts;  /* threads + 1 bucket boundaries in buf */
+  pthread_barrier_t barrier;
+} sample_sort_t;
+
+typedef struct {
+  sample_sort_t *shared;
+  int id;
+} worker_t;
+
+/* A sampled key and where in the input it was drawn from. */
+typedef struct {
+  data_t key;
+  size_t pos;
+} sample_t;
+
+/* Function prototypes */
+
+static void *worker(void *arg);
+static inline int find_bucket(const sample_sort_t *ss, data_t key,
+                              size_t pos);
+static int compare_samples(const void *a, const void *b);
+static void choose_splitters(sample_sort_t *ss);
+static data_t *radix_sort(data_t *keys, data_t *buf, size_t n);
+
+/* Extern variables */
+
+/* Number of threads to use, set by the -t option in testbed.c */
+extern int num_threads;
+
+/* Globals */
+
+/* Grow-only scratch buffer, as in sort3.c. */
+static data_t *scratch = NULL;
+static size_t scratch_size = 0;
+
+/* Function definitions */
+
+/* Parallel sample sort.  Splitters are chosen from an oversampled random
+ * sample, every thread counts how many keys of its block fall in each bucket,
+ * a prefix sum over those counts gives each (thread, bucket) pair a private
+ * slice of the scratch buffer, every thread scatters its block there, and
+ * finally each thread radix sorts one bucket and writes it back in place.
+ */
+void sort(data_t *left, data_t *right)
+{
+  size_t n = right - left + 1;
+  int threads = num_threads;
+  sample_sort_t ss;
+  worker_t *workers;
+  pthread_t *tids;
+  int t;
+
+  if (scratch_size < n) {
+    free(scratch);
+    scratch = (data_t *) malloc(n * sizeof(data_t));
+    if (scratch == NULL) {
+      printf("Error: not enough memory for sample sort buffer\n");
+      exit(-1);
+    }
+    scratch_size = n;
+  }
+
+  if (threads < 1) {
+    threads = 1;
+  }
+  if ((size_t) threads > n / MIN_KEYS_PER_THREAD) {
+    threads = (int) (n / MIN_KEYS_PER_THREAD);
+  }
+  if (threads <= 1) {
+    data_t *sorted = radix_sort(left, scratch, n);
+    if (sorted != left) {
+      memcpy(left, sorted, n * sizeof(data_t));
+    }
+    return;
+  }
+
+  ss.data = left;
+  ss.buf = scratch;
+  ss.n = n;
+  ss.threads = threads;
+  ss.splitters = (data_t *) malloc((threads - 1) * sizeof(data_t));
+  ss.splitter_pos = (size_t *) malloc((threads - 1) * sizeof(size_t));
+  ss.counts = (size_t *) calloc(threads * threads, sizeof(size_t));
+  ss.offsets = (size_t *) malloc(threads * threads * sizeof(size_t));
+  ss.bucket_starts = (size_t *) malloc((threads + 1) * sizeof(size_t));
+  workers = (worker_t *) malloc(threads * sizeof(worker_t));
+  tids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+  if (ss.splitters == NULL || ss.splitter_pos == NULL || ss.counts == NULL ||
+      ss.offsets == NULL || ss.bucket_starts == NULL || workers == NULL ||
+      tids == NULL) {
+    printf("Error: not enough memory for sample sort bookkeeping\n");
+    exit(-1);
+  }
+  pthread_barrier_init(&ss.barrier, NULL, threads);
+
+  choose_splitters(&ss);
+
+  /* The calling thread is worker 0. */
+  for (t = 0; t < threads; t++) {
+    workers[t].shared = &ss;
+    workers[t].id = t;
+  }
+  for (t = 1; t < threads; t++) {
+    if (pthread_create(&tids[t], NULL, worker, &workers[t]) != 0) {
+      printf("Error: could not create sort thread\n");
+      exit(-1);
+    }
+  }
+  worker(&workers[0]);
+  for (t = 1; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+
+  pthread_barrier_destroy(&ss.barrier);
+  free(ss.splitters);
+  free(ss.splitter_pos);
+  free(ss.counts);
+  free(ss.offsets);
+  free(ss.bucket_starts);
+  free(workers);
+  free(tids);
+}
+
+/* One worker's share of the sort.  Worker id owns block id of the input
+ * during classification and bucket id of the output during the local sort.
+ */
+static void *worker(void *arg)
+{
+  worker_t *w = (worker_t *) arg;
+  sample_sort_t *ss = w->shared;
+  int p = ss->threads;
+  int id = w->id;
+  size_t lo = ss->n * id / p;
+  size_t hi = ss->n * (id + 1) / p;
+  size_t *counts = ss->counts + (size_t) id * p;
+  size_t *offsets = ss->offsets + (size_t) id * p;
+  size_t i;
+  int b, t;
+
+  /* Phase 1: histogram this thread's block by bucket. */
+  for (i = lo; i < hi; i++) {
+    counts[find_bucket(ss, ss->data[i], i)]++;
+  }
+  pthread_barrier_wait(&ss->barrier);
+
+  /* Phase 2: one thread turns the p x p histogram into write offsets.  Bucket
+   * b starts after all of buckets 0..b-1, and within bucket b, thread t's keys
+   * come after those of threads 0..t-1. */
+  if (id == 0) {
+    size_t sum = 0;
+    for (b = 0; b < p; b++) {
+      ss->bucket_starts[b] = sum;
+      for (t = 0; t < p; t++) {
+        ss->offsets[(size_t) t * p + b] = sum;
+        sum += ss->counts[(size_t) t * p + b];
+      }
+    }
+    ss->bucket_starts[p] = sum;
+  }
+  pthread_barrier_wait(&ss->barrier);
+
+  /* Phase 3: all-to-all redistribution into the scratch buffer.  Every
+   * (thread, bucket) slice is disjoint, so no locking is needed. */
+  for (i = lo; i < hi; i++) {
+    data_t key = ss->data[i];
+    ss->buf[offsets[find_bucket(ss, key, i)]++] = key;
+  }
+  pthread_barrier_wait(&ss->barrier);
+
+  /* Phase 4: sort bucket id, using the matching stretch of data as the radix
+   * sort's ping-pong buffer, and leave the result in data. */
+  {
+    size_t start = ss->bucket_starts[id];
+    size_t len = ss->bucket_starts[id + 1] - start;
+    data_t *sorted = radix_sort(ss->buf + start, ss->data + start, len);
+    if (sorted != ss->data + start) {
+      memcpy(ss->data + start, sorted, len * sizeof(data_t));
+    }
+  }
+
+  return NULL;
+}
+
+/* Return the bucket for the key at input index pos: the number of splitters
+ * that are <= key, where a splitter equal to key counts only if it was drawn
+ * from at or before pos.  Ordering by (key, index) rather than by key alone
+ * lets a run of equal splitters divide the copies of a common key among
+ * several buckets, instead of giving them all to one thread.
+ */
+static inline int find_bucket(const sample_sort_t *ss, data_t key,
+                              size_t pos)
+{
+  const data_t *splitters = ss->splitters;
+  int lo = 0, len = ss->threads - 1;
+
+  while (len > 0) {
+    int half = len / 2;
+    data_t s = splitters[lo + half];
+    if (s < key || (s == key && ss->splitter_pos[lo + half] <= pos)) {
+      lo += half + 1;
+      len -= half + 1;
+    } else {
+      len = half;
+    }
+  }
+  return lo;
+}
+
+/* Order samples by key, then by input index. */
+static int compare_samples(const void *a, const void *b)
+{
+  const sample_t *x = (const sample_t *) a;
+  const sample_t *y = (const sample_t *) b;
+
+  if (x->key != y->key) {
+    return (x->key < y->key) ? -1 : 1;
+  }
+  return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+/* Draw OVERSAMPLE keys per bucket at random, sort them by key and input
+ * index, and keep every OVERSAMPLE-th as a splitter.
+ */
+static void choose_splitters(sample_sort_t *ss)
+{
+  int p = ss->threads;
+  size_t nsamples = (size_t) p * OVERSAMPLE;
+  sample_t *samples;
+  uint64_t rng = 0x9E3779B97F4A7C15ULL;  /* fixed seed, so runs repeat */
+  size_t i;
+  int b;
+
+  samples = (sample_t *) malloc(nsamples * sizeof(sample_t));
+  if (samples == NULL) {
+    printf("Error: not enough memory for splitter samples\n");
+    exit(-1);
+  }
+
+  for (i = 0; i < nsamples; i++) {
+    /* xorshift64 */
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    samples[i].pos = rng % ss->n;
+    samples[i].key = ss->data[samples[i].pos];
+  }
+
+  qsort(samples, nsamples, sizeof(sample_t), compare_samples);
+  for (b = 1; b < p; b++) {
+    ss->splitters[b - 1] = samples[(size_t) b * OVERSAMPLE].key;
+    ss->splitter_pos[b - 1] = samples[(size_t) b * OVERSAMPLE].pos;
+  }
+
+  free(samples);
+}
+
+/* LSD radix sort of n keys, using buf (also n keys) as the other half of the
+ * ping-pong.  Passes whose digit is the same for every key are skipped, which
+ * is common inside a bucket where the keys share their high bits.  Returns
+ * whichever of keys and buf holds the sorted result.
+ */
+static data_t *radix_sort(data_t *keys, data_t *buf, size_t n)
+{
+  size_t counts[PASSES][BUCKETS];
+  data_t *src = keys, *dst = buf, *tmp;
+  size_t i;
+  int pass, b;
+
+  if (n < 2) {
+    return keys;
+  }
+
+  memset(counts, 0, sizeof(counts));
+  for (i = 0; i < n; i++) {
+    data_t key = keys[i];
+    for (pass = 0; pass < PASSES; pass++) {
+      counts[pass][DIGIT(key, pass)]++;
+    }
+  }
+
+  for (pass = 0; pass < PASSES; pass++) {
+    size_t offsets[BUCKETS];
+    size_t sum = 0;
+
+    if (counts[pass][DIGIT(keys[0], pass)] == n) {
+      continue;
+    }
+    for (b = 0; b < BUCKETS; b++) {
+      offsets[b] = sum;
+      sum += counts[pass][b];
+    }
+    for (i = 0; i < n; i++) {
+      data_t key = src[i];
+      dst[offsets[DIGIT(key, pass)]++] = key;
+    }
+
+    tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+
+  return src;
+}
@@ -0,0 +1,20 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "sortlib.h"
+
+/* Typedefs */
+
+typedef uint32_t data_t;
+
+/* Function definitions */
+
+/* The library's 32-bit radix sort (sortlib.c) behind the testbed interface */
+void sort(data_t *left, data_t *right)
+{
+  if (sort_u32(left, right - left + 1) < 0) {
+    printf("Error: not enough memory for radix sort buffer\n");
+    exit(-1);
+  }
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sortlib.h"
+
+/* Macros */
+
+#define RADIX_BITS 8
+#define BUCKETS (1 << RADIX_BITS)
+#define DIGIT_MASK (BUCKETS - 1)
+
+/* Inputs shorter than this are insertion sorted; the histogram and scratch
+ * allocation would cost more than the sort. */
+#define INSERTION_CUTOFF 64
+
+#define DIGIT(key, pass) ((size_t) ((key) >> ((pass) * RADIX_BITS)) & DIGIT_MASK)
+
+/* Each sort in sortlib.h is an instance of one of the two templates below,
+ * one for bare keys and one for keys with payloads.  Every instance builds the
+ * histograms for all of its passes in one read, skips the passes where every
+ * key has the same digit, and ping-pongs between the caller's arrays and one
+ * scratch allocation.  Both the scatter and the insertion sort are stable.
+ */
+
+#define DEFINE_KEY_SORT(name, key_t)                                          \
+int name(key_t *keys, size_t n)                                               \
+{                                                                             \
+  enum { PASSES = sizeof(key_t) * 8 / RADIX_BITS };                           \
+  size_t counts[PASSES][BUCKETS];                                             \
+  key_t *src = keys, *dst, *buf, *tmp;                                        \
+  size_t i, j;                                                                \
+  int pass, b;                                                                \
+                                                                              \
+  if (n < INSERTION_CUTOFF) {                                                 \
+    for (i = 1; i < n; i++) {                                                 \
+      key_t key = keys[i];                                                    \
+      for (j = i; j > 0 && keys[j - 1] > key; j--) {                          \
+        keys[j] = keys[j - 1];                                                \
+      }                                                                       \
+      keys[j] = key;                                                          \
+    }                                                                         \
+    return 0;                                                                 \
+  }                                                                           \
+                                                                              \
+  if ((buf = (key_t *) malloc(n * sizeof(key_t))) == NULL) {                  \
+    return -1;                                                                \
+  }                                                                           \
+  dst = buf;                                                                  \
+                                                                              \
+  memset(counts, 0, sizeof(counts));                                          \
+  for (i = 0; i < n; i++) {                                                   \
+    key_t key = keys[i];                                                      \
+    for (pass = 0; pass < PASSES; pass++) {                                   \
+      counts[pass][DIGIT(key, pass)]++;                                       \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  for (pass = 0; pass < PASSES; pass++) {                                     \
+    size_t offsets[BUCKETS];                                                  \
+    size_t sum = 0;                                                           \
+                                                                              \
+    if (counts[pass][DIGIT(keys[0], pass)] == n) {                            \
+      continue;                                                               \
+    }                                                                         \
+    for (b = 0; b < BUCKETS; b++) {                                           \
+      offsets[b] = sum;                                                       \
+      sum += counts[pass][b];                                                 \
+    }                                                                         \
+    for (i = 0; i < n; i++) {                                                 \
+      key_t key = src[i];                                                     \
+      dst[offsets[DIGIT(key, pass)]++] = key;                                 \
+    }                                                                         \
+    tmp = src; src = dst; dst = tmp;                                          \
+  }                                                                           \
+                                                                              \
+  if (src != keys) {                                                          \
+    memcpy(keys, src, n * sizeof(key_t));                                     \
+  }                                                                           \
+  free(buf);                                                                  \
+  return 0;                                                                   \
+}
+
+#define DEFINE_KEY_VALUE_SORT(name, key_t, val_t)                             \
+int name(key_t *keys, val_t *vals, size_t n)                                  \
+{                                                                             \
+  enum { PASSES = sizeof(key_t) * 8 / RADIX_BITS };                           \
+  size_t counts[PASSES][BUCKETS];                                             \
+  key_t *ksrc = keys, *kdst, *kbuf, *ktmp;                                    \
+  val_t *vsrc = vals, *vdst, *vbuf, *vtmp;                                    \
+  size_t i, j;                                                                \
+  int pass, b;                                                                \
+                                                                              \
+  if (n < INSERTION_CUTOFF) {                                                 \
+    for (i = 1; i < n; i++) {                                                 \
+      key_t key = keys[i];                                                    \
+      val_t val = vals[i];                                                    \
+      for (j = i; j > 0 && keys[j - 1] > key; j--) {                          \
+        keys[j] = keys[j - 1];                                                \
+        vals[j] = vals[j - 1];                                                \
+      }                                                                       \
+      keys[j] = key;                                                          \
+      vals[j] = val;                                                          \
+    }                                                                         \
+    return 0;                                                                 \
+  }                                                                           \
+                                                                              \
+  kbuf = (key_t *) malloc(n * sizeof(key_t));                                 \
+  vbuf = (val_t *) malloc(n * sizeof(val_t));                                 \
+  if (kbuf == NULL || vbuf == NULL) {                                         \
+    free(kbuf);                                                               \
+    free(vbuf);                                                               \
+    return -1;                                                                \
+  }                                                                           \
+  kdst = kbuf;                                                                \
+  vdst = vbuf;                                                                \
+                                                                              \
+  memset(counts, 0, sizeof(counts));                                          \
+  for (i = 0; i < n; i++) {                                                   \
+    key_t key = keys[i];                                                      \
+    for (pass = 0; pass < PASSES; pass++) {                                   \
+      counts[pass][DIGIT(key, pass)]++;                                       \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  for (pass = 0; pass < PASSES; pass++) {                                     \
+    size_t offsets[BUCKETS];                                                  \
+    size_t sum = 0;                                                           \
+                                                                              \
+    if (counts[pass][DIGIT(keys[0], pass)] == n) {                            \
+      continue;                                                               \
+    }                                                                         \
+    for (b = 0; b < BUCKETS; b++) {                                           \
+      offsets[b] = sum;                                                       \
+      sum += counts[pass][b];                                                 \
+    }                                                                         \
+    /* The key and its payload go to the same index of parallel arrays. */    \
+    for (i = 0; i < n; i++) {                                                 \
+      key_t key = ksrc[i];                                                    \
+      size_t dest = offsets[DIGIT(key, pass)]++;                              \
+      kdst[dest] = key;                                                       \
+      vdst[dest] = vsrc[i];                                                   \
+    }                                                                         \
+    ktmp = ksrc; ksrc = kdst; kdst = ktmp;                                    \
+    vtmp = vsrc; vsrc = vdst; vdst = vtmp;                                    \
+  }                                                                           \
+                                                                              \
+  if (ksrc != keys) {                                                         \
+    memcpy(keys, ksrc, n * sizeof(key_t));                                    \
+    memcpy(vals, vsrc, n * sizeof(val_t));                                    \
+  }                                                                           \
+  free(kbuf);                                                                 \
+  free(vbuf);                                                                 \
+  return 0;                                                                   \
+}
+
+/* Function definitions */
+
+DEFINE_KEY_SORT(sort_u32, uint32_t)
+DEFINE_KEY_SORT(sort_u64, uint64_t)
+
+DEFINE_KEY_VALUE_SORT(sort_u32_v32, uint32_t, uint32_t)
+DEFINE_KEY_VALUE_SORT(sort_u32_v64, uint32_t, uint64_t)
+DEFINE_KEY_VALUE_SORT(sort_u64_v32, uint64_t, uint32_t)
+DEFINE_KEY_VALUE_SORT(sort_u64_v64, uint64_t, uint64_t)
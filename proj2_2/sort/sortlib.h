@@ -0,0 +1,28 @@
+#ifndef _SORTLIB_H_
+#define _SORTLIB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Stable LSD radix sorts for 32- and 64-bit unsigned keys, optionally carrying
+ * a payload per key.  Keys and payloads live in separate arrays (structure of
+ * arrays) and are scattered side by side, so a payload costs one extra
+ * sequential read and one extra write per pass rather than doubling the size
+ * of every element moved.  A payload is typically the record's index, or a
+ * record pointer cast to uintptr_t and stored in a 64-bit payload array.
+ *
+ * Each call allocates scratch space the size of its inputs and returns 0, or
+ * returns -1 without touching the arrays if that allocation fails.  The
+ * functions keep no global state and are safe to call from several threads
+ * at once.
+ */
+
+int sort_u32(uint32_t *keys, size_t n);
+int sort_u64(uint64_t *keys, size_t n);
+
+int sort_u32_v32(uint32_t *keys, uint32_t *vals, size_t n);
+int sort_u32_v64(uint32_t *keys, uint64_t *vals, size_t n);
+int sort_u64_v32(uint64_t *keys, uint32_t *vals, size_t n);
+int sort_u64_v64(uint64_t *keys, uint64_t *vals, size_t n);
+
+#endif
@@ -1,39 +1,124 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include "ktiming.h" 
+#include <string.h>
+#include <time.h>
+#include "ktiming.h"
+#include "counters.h"
 
 typedef uint32_t data_t;
 
+/* Macros */
+
+/* Largest array we are willing to allocate: 16 GB of keys. */
+#define MAX_ELEMENTS 4000000000L
+
+/* Number of distinct ranks the Zipf generator draws from. */
+#define ZIPF_RANKS (1 << 20)
+
+/* Smallest array size in the benchmark matrix. */
+#define MATRIX_MIN_N 1000
+
+/* Typedefs */
+
+/* Input distributions.  The parameter k has a different meaning for each, as
+ * described in dist_names below. */
+typedef enum {
+  DIST_UNIFORM,
+  DIST_SORTED,
+  DIST_REVERSE,
+  DIST_NEARLY,
+  DIST_FEW_UNIQUE,
+  DIST_ZIPF,
+  DIST_ORGAN_PIPE,
+  DIST_SAWTOOTH,
+  NUM_DISTS
+} dist_t;
+
 /* Function prototypes */
 
 void sort(data_t *left, data_t *right);
+static dist_t parse_dist(const char *name);
+static void fill(data_t *data, long n, dist_t dist, long k);
+static long default_param(dist_t dist, long n);
+static void seed_rng(uint64_t seed);
+static uint32_t rng_next(void);
+static void check_sorted(data_t *data, long n);
+static uint64_t wall_nanos(void);
+static void run_matrix(data_t *data, long max_n, int R, unsigned int seed,
+                       long k);
 
 /* Extern variables */
 
 // extern int optind;
 
+/* Global variables */
+
+/* Number of threads a parallel sort() may use (set by -t).  Serial sorts
+ * ignore it. */
+int num_threads = 1;
+
+/* Operation counters, bumped by sorts built with COUNT=1. */
+uint64_t sort_compares = 0;
+uint64_t sort_moves = 0;
+
+static const char *dist_names[] = {
+  "uniform",     /* uniformly random 32-bit keys */
+  "sorted",      /* ascending */
+  "reverse",     /* descending */
+  "nearly",      /* ascending with k random swaps (default n/100) */
+  "fewunique",   /* k distinct random values (default 16) */
+  "zipf",        /* Zipf(1) over 2^20 keys, so a few keys dominate */
+  "organpipe",   /* ascending then descending */
+  "sawtooth",    /* k ascending runs (default 16) */
+};
+
+/* State for the xorshift64* generator.  We use our own generator rather than
+ * rand() so that a seed produces the same input on every libc. */
+static uint64_t rng_state;
+
 /* Function definitions */
 
 int main( int argc, char** argv )
 {
-  int i, j, N, R, optchar, printFlag = 0;
-  unsigned int seed = 0;
+  long i, N;
+  int j, R, optchar, printFlag = 0, matrixFlag = 0;
+  unsigned int seed = 1;
+  dist_t dist = DIST_UNIFORM;
+  long k = -1;
   clockmark_t time1, time2;
+  uint64_t wall1, wall2;
   float sum_time = 0;
+  double sum_wall = 0;
   data_t *data;
 
   // process command line options
-  while( ( optchar = getopt( argc, argv, "s:p" ) ) != -1 ) {
+  while( ( optchar = getopt( argc, argv, "s:pt:d:k:m" ) ) != -1 ) {
     switch( optchar ) {
       case 's':
         seed = (unsigned int) atoi(optarg);
         printf("Using user-provided seed: %u\n", seed);
-        srand(seed);
         break;
       case 'p':
         printFlag = 1;
         break;
+      case 't':
+        num_threads = atoi(optarg);
+        if (num_threads < 1) {
+          printf("Please pick at least 1 thread\n");
+          exit(-1);
+        }
+        printf("Using %d threads\n", num_threads);
+        break;
+      case 'd':
+        dist = parse_dist(optarg);
+        break;
+      case 'k':
+        k = atol(optarg);
+        break;
+      case 'm':
+        matrixFlag = 1;
+        break;
       default:
         printf( "Ignoring unrecognized option: %c\n", optchar );
         continue;
@@ -48,17 +133,26 @@ int main( int argc, char** argv )
 
   // check to make sure number of arguments is correct
   if (remaining_args != 2) {
-    printf("Usage: %s [-p] [-s seed] <num_elements> <num_repeats>\n", argv[0]);
+    printf("Usage: %s [-p] [-m] [-s seed] [-t threads] [-d dist] [-k param] <num_elements> <num_repeats>\n", argv[0]);
     printf("  -p : print before/after arrays\n");
-    printf("  -s : set rand() seed value\n");
+    printf("  -m : benchmark every distribution at sizes from %d up to num_elements\n",
+           MATRIX_MIN_N);
+    printf("  -s : set random seed value\n");
+    printf("  -t : number of threads for parallel sorts\n");
+    printf("  -d : input distribution, one of:");
+    for (j = 0; j < NUM_DISTS; j++) {
+      printf(" %s", dist_names[j]);
+    }
+    printf("\n");
+    printf("  -k : distribution parameter (swaps, distinct values, or runs)\n");
     exit(-1);
   }
 
-  N = atoi(argv[1]);
+  N = atol(argv[1]);
   R = atoi(argv[2]);
 
-  if (N < 2 || N > 10000000) {
-    printf("Please pick a number between 2 and 10000000\n");
+  if (N < 2 || N > MAX_ELEMENTS) {
+    printf("Please pick a number between 2 and %ld\n", MAX_ELEMENTS);
     exit(-1);
   }
 
@@ -69,50 +163,307 @@ int main( int argc, char** argv )
     exit(-1);
   }
 
+  if (matrixFlag) {
+    run_matrix(data, N, R, seed, k);
+    free(data);
+    return 0;
+  }
+
+  seed_rng(seed);
+  if (k < 0) {
+    k = default_param(dist, N);
+  }
+
   // repeat for each trial
   for (j = 0; j < R; j++) {
 
-    // initialize data with random numbers
-    for (i = 0; i < N; i++) {
-      data[i] = rand();
-    }
+    // initialize data from the chosen distribution
+    fill(data, N, dist, k);
 
     // display array
     if (printFlag) {
       for (i = 0; i < N; i++) {
-        printf("%d ", data[i]);
+        printf("%u ", data[i]);
       }
       printf("\n");
     }
 
     // sort array
+    wall1 = wall_nanos();
     time1 = ktiming_getmark( );
     sort(data, data + N - 1);
     time2 = ktiming_getmark( );
+    wall2 = wall_nanos();
 
     // compute time for this trial
     sum_time += ktiming_diff_sec( &time1, &time2 );
+    sum_wall += (wall2 - wall1) * 1e-9;
 
     // display array
     if (printFlag) {
       for (i = 0; i < N; i++) {
-        printf("%d ", data[i]);
+        printf("%u ", data[i]);
       }
       printf("\n");
     }
 
     // check if array is sorted
-    for (i = 1; i < N; i++) {
-      if (data[i - 1] > data[i]) {
-        printf("Arrays are sorted: NO!\n");
-        exit(-1);
-      }
-    }
+    check_sorted(data, N);
   }
   printf("Arrays are sorted: yes\n");
 
   // report total execution time
   printf( "Elapsed execution time: %f sec\n", sum_time );
 
+  // CPU time adds up across threads, so also show what the clock on the wall
+  // saw when the sort may have run in parallel
+  if (num_threads > 1) {
+    printf( "Elapsed wall-clock time: %f sec\n", sum_wall );
+  }
+
+#ifdef COUNT_OPS
+  printf( "Comparisons: %llu\nMoves: %llu\n",
+          (unsigned long long) sort_compares, (unsigned long long) sort_moves );
+#endif
+
+  free(data);
   return 0;
 }
+
+/* Run R trials of every distribution at sizes MATRIX_MIN_N, 10x that, and so
+ * on up to max_n, and print one row per (distribution, size) cell.  Each cell
+ * reseeds the generator, so every sort binary sees exactly the same inputs.
+ */
+static void run_matrix(data_t *data, long max_n, int R, unsigned int seed,
+                       long k)
+{
+  long n;
+  int d, j;
+
+  printf("%-10s %11s %12s %12s %12s %12s\n", "dist", "n", "cpu ns/key",
+         "wall ns/key", "cmps/key", "moves/key");
+
+  for (d = 0; d < NUM_DISTS; d++) {
+    n = (max_n < MATRIX_MIN_N) ? max_n : MATRIX_MIN_N;
+    for (;;) {
+      uint64_t cpu = 0, wall = 0;
+      long param = (k < 0) ? default_param(d, n) : k;
+
+      seed_rng(seed);
+      sort_compares = 0;
+      sort_moves = 0;
+
+      for (j = 0; j < R; j++) {
+        clockmark_t time1, time2;
+        uint64_t wall1, wall2;
+
+        fill(data, n, d, param);
+        wall1 = wall_nanos();
+        time1 = ktiming_getmark();
+        sort(data, data + n - 1);
+        time2 = ktiming_getmark();
+        wall2 = wall_nanos();
+
+        cpu += ktiming_diff_nanosec(&time1, &time2);
+        wall += wall2 - wall1;
+        check_sorted(data, n);
+      }
+
+      printf("%-10s %11ld %12.2f %12.2f", dist_names[d], n,
+             (double) cpu / ((double) n * R), (double) wall / ((double) n * R));
+      if (sort_compares > 0 || sort_moves > 0) {
+        printf(" %12.2f %12.2f\n", (double) sort_compares / ((double) n * R),
+               (double) sort_moves / ((double) n * R));
+      } else {
+        printf(" %12s %12s\n", "-", "-");
+      }
+      fflush(stdout);
+
+      if (n == max_n) {
+        break;
+      }
+      n = (n * 10 > max_n) ? max_n : n * 10;
+    }
+  }
+}
+
+/* Look up a distribution by name. */
+static dist_t parse_dist(const char *name)
+{
+  int d;
+
+  for (d = 0; d < NUM_DISTS; d++) {
+    if (strcmp(name, dist_names[d]) == 0) {
+      return d;
+    }
+  }
+  printf("Unknown distribution: %s\n", name);
+  exit(-1);
+}
+
+/* The parameter each distribution uses when -k isn't given. */
+static long default_param(dist_t dist, long n)
+{
+  switch (dist) {
+    case DIST_NEARLY:
+      return n / 100 + 1;
+    case DIST_FEW_UNIQUE:
+    case DIST_SAWTOOTH:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+/* Fill data with n keys drawn from dist. */
+static void fill(data_t *data, long n, dist_t dist, long k)
+{
+  long i;
+  /* Spacing for the ascending distributions, so keys span the 32-bit range */
+  uint64_t step = ((uint64_t) UINT32_MAX + 1) / n;
+
+  switch (dist) {
+    case DIST_UNIFORM:
+      for (i = 0; i < n; i++) {
+        data[i] = rng_next();
+      }
+      break;
+
+    case DIST_SORTED:
+      for (i = 0; i < n; i++) {
+        data[i] = i * step;
+      }
+      break;
+
+    case DIST_REVERSE:
+      for (i = 0; i < n; i++) {
+        data[i] = (n - 1 - i) * step;
+      }
+      break;
+
+    case DIST_NEARLY:
+      for (i = 0; i < n; i++) {
+        data[i] = i * step;
+      }
+      for (i = 0; i < k; i++) {
+        long a = rng_next() % n, b = rng_next() % n;
+        data_t tmp = data[a];
+        data[a] = data[b];
+        data[b] = tmp;
+      }
+      break;
+
+    case DIST_FEW_UNIQUE: {
+      data_t *values;
+      if (k < 1) {
+        k = 1;
+      }
+      values = (data_t *) malloc(k * sizeof(data_t));
+      if (values == NULL) {
+        printf("Error: not enough memory\n");
+        exit(-1);
+      }
+      for (i = 0; i < k; i++) {
+        values[i] = rng_next();
+      }
+      for (i = 0; i < n; i++) {
+        data[i] = values[rng_next() % k];
+      }
+      free(values);
+      break;
+    }
+
+    case DIST_ZIPF: {
+      /* Inverse-CDF sampling: rank r has weight 1/r.  The rank is scrambled
+       * by an odd multiplier, which is a bijection on 32-bit keys, so the
+       * popular keys are spread over the key space instead of being 1, 2, 3. */
+      double *cdf = (double *) malloc(ZIPF_RANKS * sizeof(double));
+      double sum = 0;
+      if (cdf == NULL) {
+        printf("Error: not enough memory\n");
+        exit(-1);
+      }
+      for (i = 0; i < ZIPF_RANKS; i++) {
+        sum += 1.0 / (i + 1);
+        cdf[i] = sum;
+      }
+      for (i = 0; i < n; i++) {
+        double u = (rng_next() / 4294967296.0) * sum;
+        long lo = 0, hi = ZIPF_RANKS - 1;
+        while (lo < hi) {
+          long mid = (lo + hi) / 2;
+          if (cdf[mid] < u) {
+            lo = mid + 1;
+          } else {
+            hi = mid;
+          }
+        }
+        data[i] = (data_t) (lo + 1) * 2654435761u;
+      }
+      free(cdf);
+      break;
+    }
+
+    case DIST_ORGAN_PIPE:
+      for (i = 0; i < n; i++) {
+        long up = (i < n / 2) ? i : n - 1 - i;
+        data[i] = up * 2 * step;
+      }
+      break;
+
+    case DIST_SAWTOOTH: {
+      long period;
+      if (k < 1) {
+        k = 1;
+      }
+      period = (n + k - 1) / k;
+      for (i = 0; i < n; i++) {
+        data[i] = (i % period) * (((uint64_t) UINT32_MAX + 1) / period);
+      }
+      break;
+    }
+
+    default:
+      printf("Error: bad distribution\n");
+      exit(-1);
+  }
+}
+
+static void seed_rng(uint64_t seed)
+{
+  /* Run the seed through splitmix64, so small seeds give unrelated streams
+   * and seed 0 isn't stuck at 0. */
+  uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  rng_state = (z ^ (z >> 31)) | 1;
+}
+
+static uint32_t rng_next(void)
+{
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (uint32_t) ((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static void check_sorted(data_t *data, long n)
+{
+  long i;
+
+  for (i = 1; i < n; i++) {
+    if (data[i - 1] > data[i]) {
+      printf("Arrays are sorted: NO!\n");
+      exit(-1);
+    }
+  }
+}
+
+/* Wall-clock time in nanoseconds */
+static uint64_t wall_nanos(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
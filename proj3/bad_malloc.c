@@ -71,3 +71,26 @@ void *bad_realloc(void *ptr, size_t size)
   /* Return a pointer to the new block. */
   return newptr;
 }
+
+/*
+ * bad_calloc - Same as bad_malloc; the block is not zeroed.
+ */
+void *bad_calloc(size_t nmemb, size_t size)
+{
+  return bad_malloc(nmemb * size);
+}
+
+/*
+ * bad_memalign - Ignores the alignment.
+ */
+void *bad_memalign(size_t alignment, size_t size)
+{
+  return bad_malloc(size);
+}
+
+/*
+ * bad_free_sized - Same as bad_free.
+ */
+void bad_free_sized(void *ptr, size_t size)
+{
+}
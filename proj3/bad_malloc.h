@@ -7,6 +7,9 @@ int bad_init(void);
 void *bad_malloc(size_t size);
 void bad_free(void *ptr);
 void *bad_realloc(void *ptr, size_t size);
+void *bad_calloc(size_t nmemb, size_t size);
+void *bad_memalign(size_t alignment, size_t size);
+void bad_free_sized(void *ptr, size_t size);
 int bad_check(void);
 
 #endif /* MM_BAD_MALLOC_H */
@@ -2,57 +2,130 @@
  * clock.c - Routines for using the cycle counters on x86,
  *           Alpha, and Sparc boxes.
  *
+ * The counter is the x86 time stamp counter when it is invariant, and
+ * CLOCK_MONOTONIC_RAW, counting nanoseconds, when it is not.
+ *
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/times.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 #include "clock.h"
 
 
-/* Initialize the cycle counter */
-static unsigned cyc_hi = 0;
-static unsigned cyc_lo = 0;
+/* The counter value when the counter was started */
+static uint64_t cyc_start = 0;
+
+/* Whether the counter is the TSC: 1 if so, 0 if it is CLOCK_MONOTONIC_RAW
+   nanoseconds, -1 if not yet decided */
+static int use_tsc = -1;
+
+/* Read CLOCK_MONOTONIC_RAW, in nanoseconds */
+static uint64_t monotonic_ns(void)
+{
+  struct timespec ts;
 
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-/* Set *hi and *lo to the high and low order bits  of the cycle counter.
-   Implementation requires assembly code to use the rdtsc instruction. */
-void access_counter(unsigned *hi, unsigned *lo)
+/* Does the processor have an invariant TSC, one that ticks at the same
+   rate in every power state and on every core, and the rdtscp
+   instruction to read it? */
+static int has_invariant_tsc(void)
 {
-  asm("rdtsc; movl %%edx,%0; movl %%eax,%1"   /* Read cycle counter */
-      : "=r" (*hi), "=r" (*lo)                /* and move results to */
-      : /* No input */                        /* the two outputs */
-      : "%edx", "%eax");
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 27)))
+    return 0;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    return 0;
+  return (edx >> 8) & 1;
+#else
+  return 0;
+#endif
+}
+
+/* Read the counter: the TSC, with rdtscp so that the instructions before
+   it have finished, or else CLOCK_MONOTONIC_RAW. */
+static uint64_t access_counter(void)
+{
+  if (use_tsc < 0)
+    use_tsc = has_invariant_tsc();
+#if defined(__x86_64__) || defined(__i386__)
+  if (use_tsc) {
+    unsigned aux;
+    return __rdtscp(&aux);
+  }
+#endif
+  return monotonic_ns();
 }
 
 /* Record the current value of the cycle counter. */
 void start_counter()
 {
-  access_counter(&cyc_hi, &cyc_lo);
+  cyc_start = access_counter();
 }
 
 /* Return the number of cycles since the last call to start_counter. */
 double get_counter()
 {
-  unsigned ncyc_hi, ncyc_lo;
-  unsigned hi, lo, borrow;
-  double result;
-
-  /* Get cycle counter */
-  access_counter(&ncyc_hi, &ncyc_lo);
-
-  /* Do double precision subtraction */
-  lo = ncyc_lo - cyc_lo;
-  borrow = lo > ncyc_lo;
-  hi = ncyc_hi - cyc_hi - borrow;
-  result = (double) hi * (1 << 30) * 4 + lo;
-  if (result < 0) {
-    fprintf(stderr, "Error: counter returns neg value: %.0f\n", result);
+  return (double)(access_counter() - cyc_start);
+}
+
+/* Is the counter the TSC, rather than nanoseconds? */
+int counter_is_tsc(void)
+{
+  if (use_tsc < 0)
+    use_tsc = has_invariant_tsc();
+  return use_tsc;
+}
+
+/* Calibrate the counter against CLOCK_MONOTONIC_RAW: count its ticks over
+   CALIBRATE_ROUNDS spans of CALIBRATE_NS each, and take the median rate.
+   Returns ticks per second. */
+#define CALIBRATE_ROUNDS 5
+#define CALIBRATE_NS 20000000
+
+double counter_hz(int verbose)
+{
+  double rates[CALIBRATE_ROUNDS], rate;
+  uint64_t c0, c1, t0, t1;
+  int i, j;
+
+  if (!counter_is_tsc()) {
+    if (verbose)
+      printf("No invariant TSC; timing with CLOCK_MONOTONIC_RAW\n");
+    return 1e9;
   }
-  return result;
+
+  for (i = 0; i < CALIBRATE_ROUNDS; i++) {
+    t0 = monotonic_ns();
+    c0 = access_counter();
+    do {
+      t1 = monotonic_ns();
+    } while (t1 - t0 < CALIBRATE_NS);
+    c1 = access_counter();
+    rate = (double)(c1 - c0) / (t1 - t0) * 1e9;
+    for (j = i; j > 0 && rates[j-1] > rate; j--)
+      rates[j] = rates[j-1];
+    rates[j] = rate;
+  }
+
+  rate = rates[CALIBRATE_ROUNDS / 2];
+  if (verbose)
+    printf("Invariant TSC rate ~= %.1f MHz\n", rate / 1e6);
+  return rate;
 }
 /* $end x86cyclecounter */
 
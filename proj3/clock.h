@@ -12,6 +12,12 @@ double get_counter(void);
 /* Measure overhead for counter */
 double ovhd(void);
 
+/* Is the counter the invariant TSC, rather than CLOCK_MONOTONIC_RAW? */
+int counter_is_tsc(void);
+
+/* Counter ticks per second, calibrated against CLOCK_MONOTONIC_RAW */
+double counter_hz(int verbose);
+
 /* Determine clock rate of processor (using a default sleeptime) */
 double mhz(int verbose);
 
@@ -58,15 +58,24 @@
 #define ALIGNMENT 8
 
 /*
- * Maximum heap size in bytes
+ * Maximum heap size in bytes.  Only address space is reserved up front, so
+ * this can be generous; heap offsets in mm.c must still fit in 32 bits.
  */
-#define MAX_HEAP (50*(1<<20))  /* 50 MB */
+#define MAX_HEAP (1<<30)  /* 1 GB */
+
+/*
+ * Maximum heap size in bytes when it is backed by hugetlbfs pages, which
+ * are taken from the pool for the whole heap up front
+ */
+#define MAX_HUGETLB_HEAP (64*(1<<20))  /* 64 MB */
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_TSC    1   /* invariant TSC, else CLOCK_MONOTONIC_RAW, w/K-best
+                          scheme on one CPU (Linux) */
 
 #endif /* MM_CONFIG_H */
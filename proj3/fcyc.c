@@ -6,10 +6,16 @@
  *
  * Uses the cycle timer routines in clock.c to estimate the
  * the time in CPU cycles for a function f.
+ *
+ * fcyc returns the smallest sample.  The confidence interval fcyc_ci gives
+ * is instead for the mean of the K best samples, which fcyc_mean returns:
+ * the minimum of a few samples has no simple interval, and the K best are
+ * the samples the scheme takes to be undisturbed.
  */
 #include <stdlib.h>
 #include <sys/times.h>
 #include <stdio.h>
+#include <math.h>
 
 #include "fcyc.h"
 #include "clock.h"
@@ -35,6 +41,8 @@ static int *cache_buf = NULL;
 
 static double *values = NULL;
 static int samplecount = 0;
+static double last_mean = 0;  /* mean of the K best samples of last fcyc */
+static double last_ci = 0;    /* relative 95% confidence interval of it */
 
 /* for debugging only */
 #define KEEP_VALS 0
@@ -97,6 +105,36 @@ static int has_converged()
       ((1 + epsilon)*values[0] >= values[kbest-1]);
 }
 
+/*
+ * confidence - Half-width of a 95% confidence interval for the mean of the
+ *     kbest smallest samples, relative to that mean, which is stored in
+ *     *meanp.  These are the samples the K-best scheme takes to be
+ *     undisturbed, so a wide interval means the measurement did not
+ *     converge.
+ */
+static double confidence(double *meanp)
+{
+  /* Student's t, 97.5th percentile, for 1..20 degrees of freedom */
+  static const double t975[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086
+  };
+  int n = (samplecount < kbest) ? samplecount : kbest;
+  double mean = 0, var = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    mean += values[i];
+  mean /= (n > 0) ? n : 1;
+  *meanp = mean;
+  if (n < 2)
+    return 0;
+  for (i = 0; i < n; i++)
+    var += (values[i] - mean) * (values[i] - mean);
+  var /= n - 1;
+  return t975[(n - 2 < 19) ? n - 2 : 19] * sqrt(var / n) / mean;
+}
+
 /*
  * clear - Code to clear cache
  */
@@ -160,6 +198,7 @@ double fcyc(test_funct f, void *argp)
   }
 #endif
   result = values[0];
+  last_ci = confidence(&last_mean);
 #if !KEEP_VALS
   free(values);
   values = NULL;
@@ -168,6 +207,25 @@ double fcyc(test_funct f, void *argp)
 }
 
 
+/*
+ * fcyc_mean - The mean of the K best samples of the last function fcyc
+ *     measured, in cycles
+ */
+double fcyc_mean(void)
+{
+  return last_mean;
+}
+
+/*
+ * fcyc_ci - Half-width of a 95% confidence interval for fcyc_mean, as a
+ *     fraction of it
+ */
+double fcyc_ci(void)
+{
+  return last_ci;
+}
+
+
 /*************************************************************
  * Set the various parameters used by the measurement routines
  ************************************************************/
@@ -16,6 +16,14 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Mean of the K best samples of the last function fcyc measured.  fcyc
+   itself returns the best one. */
+double fcyc_mean(void);
+
+/* Half-width of a 95% confidence interval for that mean, as a fraction of
+   it */
+double fcyc_ci(void);
+
 /*********************************************************
  * Set the various parameters used by measurement routines
  *********************************************************/
@@ -1,7 +1,9 @@
 /****************************
  * High-level timing wrappers
  ****************************/
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <sched.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
@@ -9,6 +11,7 @@
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
+static double Hz;   /* calibrated counter frequency, for USE_TSC */
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -18,6 +21,7 @@ extern int verbose; /* -v option in mdriver.c */
 void init_fsecs(void)
 {
   Mhz = 0; /* keep gcc -Wall happy */
+  Hz = 0;
 
 #if USE_FCYC
   if (verbose)
@@ -30,6 +34,18 @@ void init_fsecs(void)
   set_fcyc_epsilon(0.01);
   set_fcyc_k(3);
   Mhz = mhz(verbose > 0);
+#elif USE_TSC
+  if (verbose)
+    printf("Measuring performance with %s, pinned to one CPU.\n",
+           counter_is_tsc() ? "the invariant TSC" : "CLOCK_MONOTONIC_RAW");
+
+  /* the K-best scheme, with more samples to judge the spread by */
+  set_fcyc_maxsamples(30);
+  set_fcyc_clear_cache(1);
+  set_fcyc_compensate(0);
+  set_fcyc_epsilon(0.01);
+  set_fcyc_k(5);
+  Hz = counter_hz(verbose > 1);
 #elif USE_ITIMER
   if (verbose)
     printf("Measuring performance with the interval timer.\n");
@@ -47,9 +63,55 @@ double fsecs(fsecs_test_funct f, void *argp)
 #if USE_FCYC
   double cycles = fcyc(f, argp);
   return cycles/(Mhz*1e6);
+#elif USE_TSC
+  cpu_set_t saved, one;
+  int cpu = sched_getcpu();
+  int pinned = 0;
+  double ticks;
+
+  /* Stay on the CPU we are on, so that migrations don't disturb the
+   * samples.  Only while measuring: threads started later inherit the
+   * affinity. */
+  if (cpu >= 0 && sched_getaffinity(0, sizeof(saved), &saved) == 0) {
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    pinned = (sched_setaffinity(0, sizeof(one), &one) == 0);
+  }
+  ticks = fcyc(f, argp);
+  if (pinned)
+    sched_setaffinity(0, sizeof(saved), &saved);
+  return ticks/Hz;
 #elif USE_ITIMER
   return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
   return ftimer_gettod(f, argp, 10);
 #endif
 }
+
+/*
+ * fsecs_mean - The mean of the K best samples behind the last time fsecs
+ *    returned, which is the best of them, or -1 if the timer keeps no samples
+ */
+double fsecs_mean(void)
+{
+#if USE_FCYC
+  return fcyc_mean()/(Mhz*1e6);
+#elif USE_TSC
+  return fcyc_mean()/Hz;
+#else
+  return -1;
+#endif
+}
+
+/*
+ * fsecs_ci - Half-width of a 95% confidence interval for fsecs_mean, as a
+ *    fraction of it, or -1 if the timer gives none
+ */
+double fsecs_ci(void)
+{
+#if USE_FCYC || USE_TSC
+  return fcyc_ci();
+#else
+  return -1;
+#endif
+}
@@ -5,5 +5,7 @@ typedef void (*fsecs_test_funct)(void *);
 
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+double fsecs_mean(void);
+double fsecs_ci(void);
 
 #endif /* MM_FSECS_H */
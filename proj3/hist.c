@@ -0,0 +1,97 @@
+/*
+ * hist.c - Log-linear latency histograms.
+ *
+ * A value's bucket comes from the position of its top bit, which picks the
+ * power of two, and the HIST_SUB_BITS bits below it, which pick the step
+ * within it.  Recording is a count-leading-zeros, two shifts and an
+ * increment, cheap enough to do for every request of a trace.
+ */
+#include <string.h>
+
+#include "hist.h"
+
+/*
+ * bucket_of - The bucket value falls in.
+ */
+static int bucket_of(uint64_t value)
+{
+  int shift;
+
+  if (value < (1 << HIST_SUB_BITS))
+    return (int)value;
+  shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+  return ((shift + 1) << HIST_SUB_BITS) +
+      (int)((value >> shift) - (1 << HIST_SUB_BITS));
+}
+
+/*
+ * bucket_top - The largest value that falls in bucket.
+ */
+static uint64_t bucket_top(int bucket)
+{
+  int shift;
+
+  if (bucket < (1 << HIST_SUB_BITS))
+    return bucket;
+  shift = (bucket >> HIST_SUB_BITS) - 1;
+  return ((((uint64_t)bucket & ((1 << HIST_SUB_BITS) - 1)) +
+           (1 << HIST_SUB_BITS)) << shift) + ((uint64_t)1 << shift) - 1;
+}
+
+/*
+ * hist_clear - Empty a histogram.
+ */
+void hist_clear(hist_t *hist)
+{
+  memset(hist, 0, sizeof(*hist));
+}
+
+/*
+ * hist_record - Count one value.
+ */
+void hist_record(hist_t *hist, uint64_t value)
+{
+  hist->counts[bucket_of(value)]++;
+  hist->total++;
+  if (value > hist->max)
+    hist->max = value;
+}
+
+/*
+ * hist_add - Count every value in histogram from in histogram to as well.
+ */
+void hist_add(hist_t *to, const hist_t *from)
+{
+  int i;
+
+  for (i = 0; i < HIST_BUCKETS; i++)
+    to->counts[i] += from->counts[i];
+  to->total += from->total;
+  if (from->max > to->max)
+    to->max = from->max;
+}
+
+/*
+ * hist_percentile - The value that percentile percent of the values are at
+ *     or below, rounded up to the top of its bucket but never past the
+ *     largest value.  0 for an empty histogram.
+ */
+uint64_t hist_percentile(const hist_t *hist, double percentile)
+{
+  uint64_t rank, seen = 0, top;
+  int i;
+
+  if (hist->total == 0)
+    return 0;
+  rank = (uint64_t)(percentile / 100.0 * hist->total + 0.5);
+  if (rank < 1)
+    rank = 1;
+
+  for (i = 0; i < HIST_BUCKETS; i++) {
+    seen += hist->counts[i];
+    if (seen >= rank)
+      break;
+  }
+  top = bucket_top(i);
+  return (top < hist->max) ? top : hist->max;
+}
@@ -0,0 +1,26 @@
+#ifndef MM_HIST_H
+#define MM_HIST_H
+
+#include <stdint.h>
+
+/*
+ * Log-linear histograms of latencies, after HdrHistogram: values below
+ * 2^HIST_SUB_BITS each get a bucket, and every power of two above that is
+ * split into 2^HIST_SUB_BITS equal buckets, so a value is known to within
+ * 1/2^HIST_SUB_BITS of itself at any scale.
+ */
+#define HIST_SUB_BITS 5
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+typedef struct {
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t total;  /* values recorded */
+  uint64_t max;    /* largest of them, exactly */
+} hist_t;
+
+void hist_clear(hist_t *hist);
+void hist_record(hist_t *hist, uint64_t value);
+void hist_add(hist_t *to, const hist_t *from);
+uint64_t hist_percentile(const hist_t *hist, double percentile);
+
+#endif /* MM_HIST_H */
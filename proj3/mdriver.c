@@ -11,18 +11,29 @@
  */
 #include <assert.h>
 #include <errno.h>
+#include <malloc.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "bad_malloc.h"
+#include "clock.h"
 #include "config.h"
 #include "fsecs.h"
+#include "ftimer.h"
+#include "hist.h"
 #include "mdriver.h"
 #include "memlib.h"
 #include "mm.h"
+#include "mm_mt.h"
+#include "mm_tree.h"
+#include "trace.h"
 #include "validator.h"
 
 /******************************
@@ -35,14 +46,58 @@ typedef struct {
   double ops;      /* number of ops (malloc/free/realloc) in the trace */
   int valid;       /* was the trace processed correctly by the allocator? */
   int checked;     /* was the heap valid after every allocation? */
-  double secs;     /* number of secs needed to run the trace */
+  double secs;     /* number of secs needed to run the trace, at best */
+  double mean;     /* mean secs of the timer's best runs, or -1 if it
+                      keeps none */
+  double ci;       /* 95% confidence interval of mean, as a fraction of it,
+                      or -1 if the timer gives none */
 
   /* defined only for the student malloc package */
   double util;     /* space utilization for this trace (always 0 for libc) */
+  double rss_util; /* the same, over resident heap pages (always 0 for libc) */
 
   /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+/* How the threads of a multithreaded replay share the work */
+typedef enum {
+  MT_COPIES,            /* each thread replays its own copy of the trace */
+  MT_PRODUCER_CONSUMER  /* likewise, but the next thread over does the frees */
+} mt_mode_t;
+
+/* A single-producer, single-consumer ring of blocks waiting to be freed */
+typedef struct {
+  char *slots[MT_QUEUE_SLOTS];
+  size_t head;     /* next slot to empty; only the consumer moves it */
+  size_t tail;     /* next slot to fill; only the producer moves it */
+} mt_queue_t;
+
+struct mt_run;
+
+/* One thread's share of a multithreaded replay */
+typedef struct {
+  struct mt_run *run;
+  int id;          /* index in run->threads */
+  char **blocks;   /* this thread's pointers, indexed like trace->blocks */
+  int *sizes;      /* ... and their payload sizes */
+  mt_queue_t inbox;/* blocks the previous thread has handed over to free */
+  int done;        /* has this thread finished replaying its ops? */
+  int failed;      /* did the allocator fail before the replay finished? */
+} mt_thread_t;
+
+/* A multithreaded replay: every thread replays the whole trace at once */
+typedef struct mt_run {
+  malloc_impl_t *impl;
+  mt_mode_t mode;
+  trace_t *trace;
+  int num_threads;
+  mt_thread_t *threads;
+  int track;          /* count live payload bytes (slows the replay) */
+  long live_bytes;    /* payload bytes allocated and not yet freed */
+  long peak_bytes;    /* most live_bytes has been */
+  int failed;         /* did any thread fail? */
+} mt_run_t;
+
 /********************
  * Global variables
  *******************/
@@ -58,25 +113,47 @@ static char *default_tracefiles[] = {
   DEFAULT_TRACEFILES, NULL
 };
 
+/* Names of the request types, in the order of traceop_t's enum */
+static char *op_names[NUM_OP_TYPES] = {
+  "malloc", "free", "realloc", "calloc", "memalign", "free_sized"
+};
+
+/* Counter ticks per second, and the ticks it takes to read it, for -L */
+static double lat_hz;
+static double lat_overhead;
+
 /*********************
  * Function prototypes
  *********************/
 
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
-
 /* Routines for evaluating the speed of libc malloc */
 static void eval_libc_speed(trace_t *trace);
 
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
-static double eval_mm_util(trace_t *trace, int tracenum);
+static double eval_mm_util(trace_t *trace, int tracenum, double *rss_util);
 static void eval_mm_speed(trace_t *trace);
+static void eval_mm_latency(trace_t *trace, hist_t *hists);
 static int eval_mm_check(malloc_impl_t *impl, trace_t *trace, int tracenum);
+static int *eval_valid_parallel(malloc_impl_t *impl, int n, char **tracefiles,
+                                int jobs);
+
+/* Routines for evaluating how thread-safe malloc packages scale */
+static void eval_mt_scaling(malloc_impl_t *impl, char *name, mt_mode_t mode,
+                            int n, char **tracefiles, int max_threads,
+                            int check_heap);
+static double eval_mt_util(mt_run_t *run);
+static double eval_mt_util_libc(mt_run_t *run);
+static void eval_mt_speed(mt_run_t *run);
+static void *mt_replay_thread(void *arg);
+static void mt_track(mt_run_t *run, char *block, int size, long delta);
+static int mt_queue_push(mt_queue_t *queue, char *block);
+static int mt_queue_drain(malloc_impl_t *impl, mt_queue_t *queue);
+static long proc_status_kb(const char *field);
 
 /* Various helper routines */
 static void printresults(int n, char **tracefiles, stats_t *stats);
+static void printlatency(int n, char **tracefiles, hist_t *hists);
 static void usage(void);
 
 /* Struct of function pointers for the mm malloc implementation. */
@@ -85,12 +162,49 @@ static malloc_impl_t mm_impl = {
   &mm_malloc,
   &mm_realloc,
   &mm_free,
+  &mm_calloc,
+  &mm_memalign,
+  &mm_free_sized,
   &mm_check,
   &mem_reset_brk,
   &mem_heap_lo,
   &mem_heap_hi,
 };
 
+/* Struct of function pointers for the tree best-fit malloc implementation. */
+static malloc_impl_t tree_impl = {
+  &mm_tree_init,
+  &mm_tree_malloc,
+  &mm_tree_realloc,
+  &mm_tree_free,
+  &mm_tree_calloc,
+  &mm_tree_memalign,
+  &mm_tree_free_sized,
+  &mm_tree_check,
+  &mem_reset_brk,
+  &mem_heap_lo,
+  &mem_heap_hi,
+};
+
+/* The package evaluated as the mm malloc, and its name (set by -m) */
+static malloc_impl_t *mm_pkg = &mm_impl;
+static char *mm_pkg_name = "mm";
+
+/* Struct of function pointers for the thread-safe mm malloc front end. */
+static malloc_impl_t mt_impl = {
+  &mm_mt_init,
+  &mm_mt_malloc,
+  &mm_mt_realloc,
+  &mm_mt_free,
+  &mm_mt_calloc,
+  &mm_mt_memalign,
+  &mm_mt_free_sized,
+  &mm_mt_check,
+  &mem_reset_brk,
+  &mem_heap_lo,
+  &mem_heap_hi,
+};
+
 /* Libc needs no initialization. */
 static int libc_init(void)
 {
@@ -103,6 +217,12 @@ static int libc_check(void)
   return 1;
 }
 
+/* Libc has no sized free. */
+static void libc_free_sized(void *ptr, size_t size)
+{
+  free(ptr);
+}
+
 /* Libc can't be reset. */
 static void libc_reset(void)
 {
@@ -129,6 +249,9 @@ static malloc_impl_t libc_impl = {
   &malloc,
   &realloc,
   &free,
+  &calloc,
+  &memalign,
+  &libc_free_sized,
   &libc_check,
   &libc_reset,
   &libc_heap_lo,
@@ -141,6 +264,9 @@ static malloc_impl_t bad_impl = {
   &bad_malloc,
   &bad_realloc,
   &bad_free,
+  &bad_calloc,
+  &bad_memalign,
+  &bad_free_sized,
   &bad_check,
   &mem_reset_brk,
   &mem_heap_lo,
@@ -164,7 +290,16 @@ int main(int argc, char **argv)
   int run_libc = 0;    /* If set, run libc malloc (set by -l) */
   int run_bad = 0;     /* If set, run bad malloc (set by -b) */
   int check_heap = 0;  /* If set, run the student heap checker (set by -c) */
+  int check_every = 0; /* If set, check incrementally, walking the heap about
+                          this often (-C) */
   int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+  int mt_threads = 0;  /* If set, measure scaling up to this many (-T) */
+  mt_mode_t mt_mode = MT_COPIES; /* Hand frees to another thread (-P) */
+  int heap_pages = MEM_PAGES_SMALL; /* Back the heap with huge pages (-H) */
+  int jobs = 1;        /* Validate this many traces at once (-j) */
+  int run_latency = 0; /* If set, measure each request's latency (-L) */
+  hist_t *latency = NULL; /* Their histograms, by trace and type */
+  int *valid = NULL;   /* Their results, if validated at once */
 
   /* temporaries used to compute the performance index */
   double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -173,7 +308,7 @@ int main(int argc, char **argv)
   /*
    * Read and interpret the command line arguments
    */
-  while ((c = getopt(argc, argv, "f:t:hvVgalbc")) != EOF) {
+  while ((c = getopt(argc, argv, "f:t:T:H:j:m:C:LPhvVgalbc")) != EOF) {
     switch (c) {
       case 'g': /* Generate summary info for the autograder */
         autograder = 1;
@@ -193,6 +328,45 @@ int main(int argc, char **argv)
         if (tracedir[strlen(tracedir)-1] != '/')
           strcat(tracedir, "/"); /* path always ends with "/" */
         break;
+      case 'T': /* Measure mm_mt on up to this many threads */
+        mt_threads = atoi(optarg);
+        if (mt_threads < 1) {
+          usage();
+          exit(1);
+        }
+        break;
+      case 'H': /* Back the simulated heap with huge pages */
+        if (strcmp(optarg, "thp") == 0)
+          heap_pages = MEM_PAGES_THP;
+        else if (strcmp(optarg, "hugetlb") == 0)
+          heap_pages = MEM_PAGES_HUGETLB;
+        else {
+          usage();
+          exit(1);
+        }
+        break;
+      case 'j': /* Validate traces in this many processes at once */
+        jobs = atoi(optarg);
+        if (jobs < 1) {
+          usage();
+          exit(1);
+        }
+        break;
+      case 'm': /* Evaluate another package in place of mm */
+        if (strcmp(optarg, "tree") == 0)
+          mm_pkg = &tree_impl;
+        else if (strcmp(optarg, "mm") != 0) {
+          usage();
+          exit(1);
+        }
+        mm_pkg_name = optarg;
+        break;
+      case 'L': /* Measure the latency of each request */
+        run_latency = 1;
+        break;
+      case 'P': /* Free each block on a different thread in -T runs */
+        mt_mode = MT_PRODUCER_CONSUMER;
+        break;
       case 'l': /* Run libc malloc */
         run_libc = 1;
         break;
@@ -202,6 +376,14 @@ int main(int argc, char **argv)
       case 'c':
         check_heap = 1;
         break;
+      case 'C': /* Check the heap incrementally */
+        check_heap = 1;
+        check_every = atoi(optarg);
+        if (check_every < 1) {
+          usage();
+          exit(1);
+        }
+        break;
       case 'v': /* Print per-trace performance breakdown */
         verbose = 1;
         break;
@@ -230,6 +412,24 @@ int main(int argc, char **argv)
   /* Initialize the timing package */
   init_fsecs();
 
+  /* Calibrate the counter, and what reading it costs, for latencies */
+  if (run_latency) {
+    latency = (hist_t *)calloc(num_tracefiles * NUM_OP_TYPES, sizeof(hist_t));
+    if (latency == NULL)
+      unix_error("latency calloc in main failed");
+    lat_hz = counter_hz(verbose > 1);
+    lat_overhead = ovhd();
+    for (i = 0; i < 100; i++) {
+      double o = ovhd();
+      if (o < lat_overhead)
+        lat_overhead = o;
+    }
+  }
+
+  /* Have mm_check look only at what each operation touched */
+  if (check_every > 0)
+    mm_check_incremental(check_every);
+
   /*
    * Optionally run and evaluate the libc malloc package
    */
@@ -243,12 +443,16 @@ int main(int argc, char **argv)
       unix_error("libc_stats calloc in main failed");
 
     /* Evaluate the libc malloc package using the K-best scheme */
+    if (jobs > 1)
+      valid = eval_valid_parallel(&libc_impl, num_tracefiles, tracefiles,
+                                  jobs);
     for (i = 0; i < num_tracefiles; i++) {
       trace = read_trace(tracedir, tracefiles[i]);
       libc_stats[i].ops = trace->num_ops;
       if (verbose > 1)
         printf("Checking libc malloc for correctness, ");
-      libc_stats[i].valid = eval_mm_valid(&libc_impl, trace, i);
+      libc_stats[i].valid = valid ? valid[i] :
+          eval_mm_valid(&libc_impl, trace, i);
       if (check_heap) {
         libc_stats[i].checked = eval_mm_check(&libc_impl, trace, i);
       }
@@ -256,9 +460,13 @@ int main(int argc, char **argv)
         if (verbose > 1)
           printf("and performance.\n");
         libc_stats[i].secs = fsecs((void (*)(void *))eval_libc_speed, trace);
+        libc_stats[i].mean = fsecs_mean();
+        libc_stats[i].ci = fsecs_ci();
       }
       free_trace(trace);
     }
+    free(valid);
+    valid = NULL;
 
     /* Display the libc results in a compact table */
     if (verbose) {
@@ -268,7 +476,13 @@ int main(int argc, char **argv)
   }
 
   /* Initialize the simulated memory system in memlib.c */
+  mem_set_pages(heap_pages);
   mem_init();
+  if (heap_pages != MEM_PAGES_SMALL)
+    printf("Heap backed by %s.\n",
+           (mem_pages() == MEM_PAGES_HUGETLB) ? "hugetlbfs pages" :
+           (mem_pages() == MEM_PAGES_THP) ? "transparent huge pages" :
+           "ordinary pages: no huge page support");
 
   /*
    * Optionally run and evaluate the libc malloc package
@@ -283,16 +497,21 @@ int main(int argc, char **argv)
       unix_error("bad_stats calloc in main failed");
 
     /* Evaluate the bad malloc package using the K-best scheme */
+    if (jobs > 1)
+      valid = eval_valid_parallel(&bad_impl, num_tracefiles, tracefiles, jobs);
     for (i = 0; i < num_tracefiles; i++) {
       trace = read_trace(tracedir, tracefiles[i]);
       bad_stats[i].ops = trace->num_ops;
       printf("Checking bad malloc for correctness.\n");
-      bad_stats[i].valid = eval_mm_valid(&bad_impl, trace, i);
+      bad_stats[i].valid = valid ? valid[i] :
+          eval_mm_valid(&bad_impl, trace, i);
       if (check_heap) {
         bad_stats[i].checked = eval_mm_check(&bad_impl, trace, i);
       }
       free_trace(trace);
     }
+    free(valid);
+    valid = NULL;
 
     /* Display the bad results in a compact table */
     if (verbose) {
@@ -305,7 +524,7 @@ int main(int argc, char **argv)
    * Always run and evaluate the student's mm package
    */
   if (verbose > 1)
-    printf("\nTesting mm malloc\n");
+    printf("\nTesting %s malloc\n", mm_pkg_name);
 
   /* Allocate the mm stats array, with one stats_t struct per tracefile */
   mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
@@ -313,36 +532,63 @@ int main(int argc, char **argv)
     unix_error("mm_stats calloc in main failed");
 
   /* Evaluate student's mm malloc package using the K-best scheme */
+  if (jobs > 1)
+    valid = eval_valid_parallel(mm_pkg, num_tracefiles, tracefiles, jobs);
   for (i = 0; i < num_tracefiles; i++) {
     trace = read_trace(tracedir, tracefiles[i]);
     mm_stats[i].ops = trace->num_ops;
     if (verbose > 1)
       printf("Checking mm_malloc for correctness, ");
-    mm_stats[i].valid = eval_mm_valid(&mm_impl, trace, i);
+    mm_stats[i].valid = valid ? valid[i] : eval_mm_valid(mm_pkg, trace, i);
     if (check_heap) {
-      mm_stats[i].checked = eval_mm_check(&mm_impl, trace, i);
+      mm_stats[i].checked = eval_mm_check(mm_pkg, trace, i);
     }
     if (mm_stats[i].valid) {
       if (verbose > 1)
         printf("efficiency, ");
-      mm_stats[i].util = eval_mm_util(trace, i);
+      mm_stats[i].util = eval_mm_util(trace, i, &mm_stats[i].rss_util);
       if (verbose > 1)
         printf("and performance.\n");
       mm_stats[i].secs = fsecs((void (*)(void *))eval_mm_speed, trace);
+      mm_stats[i].mean = fsecs_mean();
+      mm_stats[i].ci = fsecs_ci();
+      if (latency != NULL)
+        eval_mm_latency(trace, &latency[i * NUM_OP_TYPES]);
     }
     free_trace(trace);
   }
+  free(valid);
+  valid = NULL;
+
+  /*
+   * Optionally measure how the thread-safe front end, and libc, scale
+   */
+  if (mt_threads > 0) {
+    eval_mt_scaling(&mt_impl, "mm_mt", mt_mode, num_tracefiles, tracefiles,
+                    mt_threads, check_heap);
+    if (run_libc)
+      eval_mt_scaling(&libc_impl, "libc", mt_mode, num_tracefiles,
+                      tracefiles, mt_threads, 0);
+  }
 
   /* Free the simulated heap block. */
   mem_deinit();
 
   /* Display the mm results in a compact table */
   if (verbose) {
-    printf("\nResults for mm malloc:\n");
+    printf("\nResults for %s malloc:\n", mm_pkg_name);
     printresults(num_tracefiles, tracefiles, mm_stats);
     printf("\n");
   }
 
+  /* Display the latencies of each kind of request */
+  if (latency != NULL) {
+    printf("Latency for %s malloc, in ns:\n", mm_pkg_name);
+    printlatency(num_tracefiles, tracefiles, latency);
+    printf("\n");
+    free(latency);
+  }
+
   /*
    * Accumulate the aggregate statistics for the student's mm package
    */
@@ -399,109 +645,6 @@ int main(int argc, char **argv)
   exit(0);
 }
 
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
-
-/*
- * read_trace - read a trace file and store it in memory
- */
-static trace_t *read_trace(char *tracedir, char *filename)
-{
-  FILE *tracefile;
-  trace_t *trace;
-  char type[MAXLINE];
-  char path[MAXLINE];
-  unsigned index, size;
-  unsigned max_index = 0;
-  unsigned op_index;
-
-  if (verbose > 1)
-    printf("Reading tracefile: %s\n", filename);
-
-  /* Allocate the trace record */
-  if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-    unix_error("malloc 1 failed in read_trance");
-
-  /* Read the trace file header */
-  strcpy(path, tracedir);
-  strcat(path, filename);
-  if ((tracefile = fopen(path, "r")) == NULL) {
-    sprintf(msg, "Could not open %s in read_trace", path);
-    unix_error(msg);
-  }
-  int num; /* Added to get rid of "fscanf return value not used" warning */
-  num = fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-  num = fscanf(tracefile, "%d", &(trace->num_ids));
-  num = fscanf(tracefile, "%d", &(trace->num_ops));
-  num = fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-
-  /* We'll store each request line in the trace in this array */
-  if ((trace->ops =
-       (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-    unix_error("malloc 2 failed in read_trace");
-
-  /* We'll keep an array of pointers to the allocated blocks here... */
-  if ((trace->blocks =
-       (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-    unix_error("malloc 3 failed in read_trace");
-
-  /* ... along with the corresponding byte sizes of each block */
-  if ((trace->block_sizes =
-       (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-    unix_error("malloc 4 failed in read_trace");
-
-  /* read every request line in the trace file */
-  index = 0;
-  op_index = 0;
-  while (fscanf(tracefile, "%s", type) != EOF) {
-    switch(type[0]) {
-      case 'a':
-        num = fscanf(tracefile, "%u %u", &index, &size);
-        trace->ops[op_index].type = ALLOC;
-        trace->ops[op_index].index = index;
-        trace->ops[op_index].size = size;
-        max_index = (index > max_index) ? index : max_index;
-        break;
-      case 'r':
-        num = fscanf(tracefile, "%u %u", &index, &size);
-        trace->ops[op_index].type = REALLOC;
-        trace->ops[op_index].index = index;
-        trace->ops[op_index].size = size;
-        max_index = (index > max_index) ? index : max_index;
-        break;
-      case 'f':
-        num = fscanf(tracefile, "%ud", &index);
-        trace->ops[op_index].type = FREE;
-        trace->ops[op_index].index = index;
-        break;
-      default:
-        printf("Bogus type character (%c) in tracefile %s\n",
-               type[0], path);
-        exit(1);
-    }
-    op_index++;
-
-  }
-  fclose(tracefile);
-  assert(max_index == trace->num_ids - 1);
-  assert(trace->num_ops == op_index);
-
-  return trace;
-}
-
-/*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
- */
-void free_trace(trace_t *trace)
-{
-  free(trace->ops);         /* free the three arrays... */
-  free(trace->blocks);
-  free(trace->block_sizes);
-  free(trace);              /* and the trace record itself... */
-}
-
 /**********************************************************************
  * The following functions evaluate the space utilization and
  * throughput of the libc and mm malloc packages.
@@ -512,35 +655,54 @@ void free_trace(trace_t *trace)
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace.
+ *   largest the heap got while running the student's malloc
+ *   package on the trace.  *rss_util is set to hwm over the most heap
+ *   memory that was resident at once, which credits the package for
+ *   pages it hands back to the system.  Payloads are written so that
+ *   they are resident.
  *
  */
-static double eval_mm_util(trace_t *trace, int tracenum)
+static double eval_mm_util(trace_t *trace, int tracenum, double *rss_util)
 {
   int i;
   int index;
   int size, newsize, oldsize;
   int max_total_size = 0;
   int total_size = 0;
+  size_t max_rss;
   char *p;
   char *newp, *oldp;
 
-  /* initialize the heap and the mm malloc package */
+  /* initialize the heap and the mm malloc package, dropping the pages
+   * earlier runs left resident */
   mem_reset_brk();
-  if (mm_init() < 0)
+  mem_trim();
+  mem_watch_rss(1);
+  if (mm_pkg->init() < 0)
     app_error("mm_init failed in eval_mm_util");
 
   for (i = 0; i < trace->num_ops; i++) {
     switch (trace->ops[i].type) {
 
       case ALLOC: /* mm_alloc */
+      case CALLOC: /* mm_calloc */
+      case MEMALIGN: /* mm_memalign */
         index = trace->ops[i].index;
         size = trace->ops[i].size;
 
-        if ((p = mm_malloc(size)) == NULL)
+        if (trace->ops[i].type == CALLOC)
+          p = mm_pkg->calloc(1, size);
+        else if (trace->ops[i].type == MEMALIGN)
+          p = mm_pkg->memalign(trace->ops[i].align, size);
+        else
+          p = mm_pkg->malloc(size);
+        if (p == NULL)
           app_error("mm_malloc failed in eval_mm_util");
 
+        /* Write the payload, as the program would, so that its pages
+         * count toward the resident set */
+        memset(p, 0, size);
+
         /* Remember region and size */
         trace->blocks[index] = p;
         trace->block_sizes[index] = size;
@@ -560,8 +722,10 @@ static double eval_mm_util(trace_t *trace, int tracenum)
         oldsize = trace->block_sizes[index];
 
         oldp = trace->blocks[index];
-        if ((newp = mm_realloc(oldp,newsize)) == NULL)
+        if ((newp = mm_pkg->realloc(oldp,newsize)) == NULL)
           app_error("mm_realloc failed in eval_mm_util");
+        if (newsize > oldsize)
+          memset(newp + oldsize, 0, newsize - oldsize);
 
         /* Remember region and size */
         trace->blocks[index] = newp;
@@ -577,11 +741,15 @@ static double eval_mm_util(trace_t *trace, int tracenum)
         break;
 
       case FREE: /* mm_free */
+      case SIZED_FREE: /* mm_free_sized */
         index = trace->ops[i].index;
         size = trace->block_sizes[index];
         p = trace->blocks[index];
 
-        mm_free(p);
+        if (trace->ops[i].type == SIZED_FREE)
+          mm_pkg->free_sized(p, size);
+        else
+          mm_pkg->free(p);
 
         /* Keep track of current total size
          * of all allocated blocks */
@@ -594,7 +762,10 @@ static double eval_mm_util(trace_t *trace, int tracenum)
     }
   }
 
-  return ((double)max_total_size / (double)mem_heapsize());
+  max_rss = mem_peak_rss();
+  mem_watch_rss(0);
+  *rss_util = (max_rss > 0) ? (double)max_total_size / (double)max_rss : 0;
+  return ((double)max_total_size / (double)mem_peak_heapsize());
 }
 
 
@@ -609,7 +780,7 @@ static void eval_mm_speed(trace_t *trace)
 
   /* Reset the heap and initialize the mm package */
   mem_reset_brk();
-  if (mm_init() < 0)
+  if (mm_pkg->init() < 0)
     app_error("mm_init failed in eval_mm_speed");
 
   /* Interpret each trace request */
@@ -619,16 +790,32 @@ static void eval_mm_speed(trace_t *trace)
       case ALLOC: /* mm_malloc */
         index = trace->ops[i].index;
         size = trace->ops[i].size;
-        if ((p = mm_malloc(size)) == NULL)
+        if ((p = mm_pkg->malloc(size)) == NULL)
           app_error("mm_malloc error in eval_mm_speed");
         trace->blocks[index] = p;
         break;
 
+      case CALLOC: /* mm_calloc */
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        if ((p = mm_pkg->calloc(1, size)) == NULL)
+          app_error("mm_calloc error in eval_mm_speed");
+        trace->blocks[index] = p;
+        break;
+
+      case MEMALIGN: /* mm_memalign */
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        if ((p = mm_pkg->memalign(trace->ops[i].align, size)) == NULL)
+          app_error("mm_memalign error in eval_mm_speed");
+        trace->blocks[index] = p;
+        break;
+
       case REALLOC: /* mm_realloc */
         index = trace->ops[i].index;
         newsize = trace->ops[i].size;
         oldp = trace->blocks[index];
-        if ((newp = mm_realloc(oldp,newsize)) == NULL)
+        if ((newp = mm_pkg->realloc(oldp,newsize)) == NULL)
           app_error("mm_realloc error in eval_mm_speed");
         trace->blocks[index] = newp;
         break;
@@ -636,7 +823,13 @@ static void eval_mm_speed(trace_t *trace)
       case FREE: /* mm_free */
         index = trace->ops[i].index;
         block = trace->blocks[index];
-        mm_free(block);
+        mm_pkg->free(block);
+        break;
+
+      case SIZED_FREE: /* mm_free_sized */
+        index = trace->ops[i].index;
+        block = trace->blocks[index];
+        mm_pkg->free_sized(block, trace->ops[i].size);
         break;
 
       default:
@@ -644,6 +837,64 @@ static void eval_mm_speed(trace_t *trace)
     }
 }
 
+/*
+ * eval_mm_latency - Replay the trace LATENCY_RUNS times with the mm
+ *    package, timing each request on its own with the cycle counter, and
+ *    count the times, less the cost of reading the counter, in the
+ *    histogram for the request's type.
+ */
+static void eval_mm_latency(trace_t *trace, hist_t *hists)
+{
+  int i, run, index, type;
+  char *p;
+  double ticks;
+
+  for (run = 0; run < LATENCY_RUNS; run++) {
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_pkg->init() < 0)
+      app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0; i < trace->num_ops; i++) {
+      index = trace->ops[i].index;
+      type = trace->ops[i].type;
+      p = NULL;
+
+      start_counter();
+      switch (type) {
+        case ALLOC: /* mm_malloc */
+          p = mm_pkg->malloc(trace->ops[i].size);
+          break;
+        case CALLOC: /* mm_calloc */
+          p = mm_pkg->calloc(1, trace->ops[i].size);
+          break;
+        case MEMALIGN: /* mm_memalign */
+          p = mm_pkg->memalign(trace->ops[i].align, trace->ops[i].size);
+          break;
+        case REALLOC: /* mm_realloc */
+          p = mm_pkg->realloc(trace->blocks[index], trace->ops[i].size);
+          break;
+        case FREE: /* mm_free */
+          mm_pkg->free(trace->blocks[index]);
+          break;
+        case SIZED_FREE: /* mm_free_sized */
+          mm_pkg->free_sized(trace->blocks[index], trace->ops[i].size);
+          break;
+        default:
+          app_error("Nonexistent request type in eval_mm_latency");
+      }
+      ticks = get_counter() - lat_overhead;
+
+      if (type != FREE && type != SIZED_FREE) {
+        if (p == NULL)
+          app_error("mm_malloc error in eval_mm_latency");
+        trace->blocks[index] = p;
+      }
+      hist_record(&hists[type], (ticks > 0) ? (uint64_t)ticks : 0);
+    }
+  }
+}
+
 /*
  * eval_mm_check - This function is used to check the heap of the student's
  *    implementation.  Returns 0 on check failure, and 1 on pass.
@@ -672,6 +923,26 @@ static int eval_mm_check(malloc_impl_t *impl, trace_t *trace, int tracenum)
         trace->blocks[index] = p;
         break;
 
+      case CALLOC: /* calloc */
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        if ((p = impl->calloc(1, size)) == NULL) {
+          malloc_error(tracenum, i, "impl calloc failed.");
+          return 0;
+        }
+        trace->blocks[index] = p;
+        break;
+
+      case MEMALIGN: /* memalign */
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        if ((p = impl->memalign(trace->ops[i].align, size)) == NULL) {
+          malloc_error(tracenum, i, "impl memalign failed.");
+          return 0;
+        }
+        trace->blocks[index] = p;
+        break;
+
       case REALLOC: /* realloc */
         index = trace->ops[i].index;
         newsize = trace->ops[i].size;
@@ -689,6 +960,12 @@ static int eval_mm_check(malloc_impl_t *impl, trace_t *trace, int tracenum)
         impl->free(block);
         break;
 
+      case SIZED_FREE: /* free_sized */
+        index = trace->ops[i].index;
+        block = trace->blocks[index];
+        impl->free_sized(block, trace->ops[i].size);
+        break;
+
       default:
         app_error("Nonexistent request type in eval_mm_speed");
     }
@@ -702,6 +979,66 @@ static int eval_mm_check(malloc_impl_t *impl, trace_t *trace, int tracenum)
   return 1;
 }
 
+/*
+ * eval_valid_parallel - Check the n traces for correctness with up to jobs
+ *    of them at once, and return whether each passed.  The packages keep
+ *    their heap in globals, so each trace is checked in a child process of
+ *    its own, on its own copy of the heap.  A child's exit status is the
+ *    number of errors it found; its messages go straight to stdout.
+ */
+static int *eval_valid_parallel(malloc_impl_t *impl, int n, char **tracefiles,
+                                int jobs)
+{
+  int *valid, *active;
+  int k, next = 0, running = 0, status;
+  pid_t pid;
+  trace_t *trace;
+
+  valid = (int *)calloc(n, sizeof(int));
+  active = (int *)malloc(n * sizeof(int));
+  if (valid == NULL || active == NULL)
+    unix_error("calloc in eval_valid_parallel failed");
+
+  while (next < n || running > 0) {
+    /* Start traces until jobs of them are running */
+    while (next < n && running < jobs) {
+      fflush(stdout);
+      if ((pid = fork()) < 0)
+        unix_error("fork in eval_valid_parallel failed");
+      if (pid == 0) {
+        errors = 0;
+        trace = read_trace(tracedir, tracefiles[next]);
+        eval_mm_valid(impl, trace, next);
+        fflush(stdout);
+        _exit(errors < 255 ? errors : 255);
+      }
+      active[next++] = pid;
+      running++;
+    }
+
+    /* And collect one that finishes */
+    if ((pid = wait(&status)) < 0)
+      unix_error("wait in eval_valid_parallel failed");
+    for (k = 0; k < next && active[k] != pid; k++)
+      ;
+    if (k == next)
+      continue;
+    active[k] = 0;
+    running--;
+    if (WIFEXITED(status)) {
+      valid[k] = (WEXITSTATUS(status) == 0);
+      errors += WEXITSTATUS(status);
+    } else {
+      errors++;
+      printf("ERROR [trace %d]: validation process died with signal %d\n",
+             k, WTERMSIG(status));
+    }
+  }
+
+  free(active);
+  return valid;
+}
+
 /*
  * eval_libc_speed - This is the function that is used by fcyc() to
  *    measure the running time of the libc malloc package on the set
@@ -733,7 +1070,24 @@ static void eval_libc_speed(trace_t *trace)
         trace->blocks[index] = newp;
         break;
 
+      case CALLOC: /* calloc */
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        if ((p = calloc(1, size)) == NULL)
+          unix_error("calloc failed in eval_libc_speed");
+        trace->blocks[index] = p;
+        break;
+
+      case MEMALIGN: /* memalign */
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        if ((p = memalign(trace->ops[i].align, size)) == NULL)
+          unix_error("memalign failed in eval_libc_speed");
+        trace->blocks[index] = p;
+        break;
+
       case FREE: /* free */
+      case SIZED_FREE:
         index = trace->ops[i].index;
         block = trace->blocks[index];
         free(block);
@@ -742,6 +1096,439 @@ static void eval_libc_speed(trace_t *trace)
   }
 }
 
+/*
+ * eval_mt_scaling - Check a thread-safe malloc package on each trace, then
+ *    time it replaying the trace from 1, 2, 4, ... up to max_threads threads
+ *    at once, each thread with its own copy of the block pointers.  Prints
+ *    the aggregate throughput at each thread count, the speedup of the
+ *    largest count over one thread, and the utilization at the largest
+ *    count.  Counts at which the allocator runs out of memory print as "-",
+ *    and leave the trace out of the totals.  A utilization that can't be
+ *    measured prints as "-" and is left out of the average.
+ */
+static void eval_mt_scaling(malloc_impl_t *impl, char *name, mt_mode_t mode,
+                            int n, char **tracefiles, int max_threads,
+                            int check_heap)
+{
+  int counts[32];
+  int num_counts = 0;
+  double *ops, *secs;
+  double util = 0;
+  int i, j, t, valid, skipped = 0, util_traces = 0;
+  trace_t *trace;
+  mt_run_t run;
+
+  for (t = 1; t < max_threads && num_counts < 31; t *= 2)
+    counts[num_counts++] = t;
+  counts[num_counts++] = max_threads;
+
+  ops = (double *)calloc(num_counts, sizeof(double));
+  secs = (double *)calloc(num_counts, sizeof(double));
+  run.threads = (mt_thread_t *)calloc(max_threads, sizeof(mt_thread_t));
+  if (ops == NULL || secs == NULL || run.threads == NULL)
+    unix_error("calloc in eval_mt_scaling failed");
+  run.impl = impl;
+  run.mode = mode;
+
+  printf("\nResults for %s malloc, %s (Kops/sec by thread count):\n", name,
+         (mode == MT_COPIES) ? "each thread frees its own blocks" :
+         "each thread's blocks freed by the next");
+  printf("%5s%27s%10s", "trace", "filename", " valid");
+  for (j = 0; j < num_counts; j++)
+    printf("%7d thr", counts[j]);
+  printf("%9s%6s\n", "speedup", "util");
+
+  for (i = 0; i < n; i++) {
+    trace = read_trace(tracedir, tracefiles[i]);
+    valid = eval_mm_valid(impl, trace, i);
+    if (valid && check_heap)
+      valid = eval_mm_check(impl, trace, i);
+    printf("%2d%30s%10s", i, tracefiles[i], valid ? "yes" : "no");
+
+    if (valid) {
+      double first = 0, kops = 0, trace_util;
+      double trace_secs[num_counts];
+      int complete = 1;
+
+      run.trace = trace;
+      for (t = 0; t < max_threads; t++) {
+        run.threads[t].run = &run;
+        run.threads[t].id = t;
+        run.threads[t].blocks = (char **)malloc(trace->num_ids *
+                                                sizeof(char *));
+        run.threads[t].sizes = (int *)malloc(trace->num_ids * sizeof(int));
+        if (run.threads[t].blocks == NULL || run.threads[t].sizes == NULL)
+          unix_error("malloc in eval_mt_scaling failed");
+      }
+
+      for (j = 0; j < num_counts; j++) {
+        double s;
+        run.num_threads = counts[j];
+        s = ftimer_gettod((ftimer_test_funct)eval_mt_speed, &run, 10);
+        if (run.failed) {
+          complete = 0;
+          printf("%11s", "-");
+          continue;
+        }
+        kops = (double)counts[j] * trace->num_ops / 1e3 / s;
+        if (j == 0)
+          first = kops;
+        trace_secs[j] = s;
+        printf("%11.0f", kops);
+      }
+
+      if (complete) {
+        trace_util = eval_mt_util(&run);
+        printf("%8.2fx", kops / first);
+        if (trace_util < 0) {
+          printf("%6s\n", "-");
+        } else {
+          printf("%5.0f%%\n", trace_util * 100.0);
+          util += trace_util;
+          util_traces++;
+        }
+        for (j = 0; j < num_counts; j++) {
+          ops[j] += (double)counts[j] * trace->num_ops;
+          secs[j] += trace_secs[j];
+        }
+      } else {
+        printf("%9s%6s\n", "-", "-");
+        skipped++;
+      }
+
+      for (t = 0; t < max_threads; t++) {
+        free(run.threads[t].blocks);
+        free(run.threads[t].sizes);
+      }
+    } else {
+      printf("\n");
+    }
+    free_trace(trace);
+  }
+
+  if (errors == 0 && skipped < n) {
+    printf("%12s%30s", "Total       ", "");
+    for (j = 0; j < num_counts; j++)
+      printf("%11.0f", ops[j] / 1e3 / secs[j]);
+    printf("%8.2fx", (ops[num_counts - 1] / secs[num_counts - 1]) /
+           (ops[0] / secs[0]));
+    if (util_traces > 0)
+      printf("%5.0f%%\n", util / util_traces * 100.0);
+    else
+      printf("%6s\n", "-");
+    if (skipped > 0)
+      printf("(totals leave out %d trace(s) that ran out of memory)\n",
+             skipped);
+  }
+
+  free(ops);
+  free(secs);
+  free(run.threads);
+}
+
+/*
+ * eval_mt_util - Replay the trace once more from run->num_threads threads,
+ *    counting live payload bytes, and return the peak live bytes over the
+ *    most memory that was resident at once to hold them: the simulated
+ *    heap's resident pages, or for libc the growth of the process's peak
+ *    RSS.  Returns -1 if the replay runs out of memory or the RSS can't be
+ *    measured.
+ */
+static double eval_mt_util(mt_run_t *run)
+{
+  double footprint;
+
+  if (run->impl->heap_lo() == NULL)
+    return eval_mt_util_libc(run);
+
+  /* Drop the pages the timing runs left resident */
+  mem_reset_brk();
+  mem_trim();
+  mem_watch_rss(1);
+
+  run->track = 1;
+  run->live_bytes = 0;
+  run->peak_bytes = 0;
+  eval_mt_speed(run);
+  run->track = 0;
+
+  footprint = mem_peak_rss();
+  mem_watch_rss(0);
+  if (run->failed)
+    return -1;
+  return (footprint > 0) ? run->peak_bytes / footprint : 0;
+}
+
+/*
+ * eval_mt_util_libc - eval_mt_util for libc, whose memory is the process's
+ *    own.  The replay runs in a child process, which first hands libc's
+ *    free memory back and resets its peak RSS through /proc/self/clear_refs,
+ *    so that pages resident from the timing runs neither get reused nor
+ *    count.  Without clear_refs the peak still counts if the replay pushed
+ *    it higher than it already was.  The child writes the utilization back
+ *    through a pipe.  Live payload is always written and so resident, but
+ *    libc may still reuse a few resident pages it couldn't hand back, so
+ *    the result is capped at 100%.
+ */
+static double eval_mt_util_libc(mt_run_t *run)
+{
+  double util = -1;
+  long rss_before, hwm_before, hwm;
+  int fds[2], status;
+  FILE *f;
+  pid_t pid;
+
+  if (pipe(fds) < 0)
+    unix_error("pipe in eval_mt_util_libc failed");
+  fflush(stdout);
+  if ((pid = fork()) < 0)
+    unix_error("fork in eval_mt_util_libc failed");
+
+  if (pid == 0) {
+    close(fds[0]);
+    malloc_trim(0);
+    if ((f = fopen("/proc/self/clear_refs", "w")) != NULL) {
+      fputs("5", f);
+      fclose(f);
+    }
+    rss_before = proc_status_kb("VmRSS:");
+    hwm_before = proc_status_kb("VmHWM:");
+
+    run->track = 1;
+    run->live_bytes = 0;
+    run->peak_bytes = 0;
+    eval_mt_speed(run);
+
+    hwm = proc_status_kb("VmHWM:");
+    if (!run->failed && rss_before > 0 && hwm > hwm_before) {
+      util = run->peak_bytes / ((hwm - rss_before) * 1024.0);
+      if (util > 1)
+        util = 1;
+    }
+    if (write(fds[1], &util, sizeof(util)) != sizeof(util))
+      _exit(1);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  if (read(fds[0], &util, sizeof(util)) != sizeof(util))
+    util = -1;
+  close(fds[0]);
+  if (waitpid(pid, &status, 0) < 0)
+    unix_error("waitpid in eval_mt_util_libc failed");
+  return util;
+}
+
+/*
+ * eval_mt_speed - Reset the heap, then replay the trace from
+ *    run->num_threads threads at once.  Timed by eval_mt_scaling.
+ */
+static void eval_mt_speed(mt_run_t *run)
+{
+  pthread_t tids[run->num_threads];
+  int t;
+
+  run->impl->reset_brk();
+  if (run->impl->init() < 0)
+    app_error("init failed in eval_mt_speed");
+
+  for (t = 0; t < run->num_threads; t++) {
+    run->threads[t].inbox.head = 0;
+    run->threads[t].inbox.tail = 0;
+    run->threads[t].done = 0;
+    run->threads[t].failed = 0;
+  }
+
+  for (t = 0; t < run->num_threads; t++) {
+    if (pthread_create(&tids[t], NULL, &mt_replay_thread,
+                       &run->threads[t]) != 0)
+      unix_error("pthread_create failed in eval_mt_speed");
+  }
+
+  run->failed = 0;
+  for (t = 0; t < run->num_threads; t++) {
+    pthread_join(tids[t], NULL);
+    run->failed |= run->threads[t].failed;
+  }
+}
+
+/*
+ * mt_replay_thread - One thread of eval_mt_speed: replay the whole trace,
+ *    keeping pointers in the thread's own block array.  In producer-consumer
+ *    mode each free is queued for the next thread instead, and the thread
+ *    frees what the previous one queues for it, both while it replays and
+ *    after, until the previous thread is done.  Stops replaying early,
+ *    marking the thread failed, if the allocator fails.
+ */
+static void *mt_replay_thread(void *arg)
+{
+  mt_thread_t *thread = arg;
+  mt_run_t *run = thread->run;
+  malloc_impl_t *impl = run->impl;
+  trace_t *trace = run->trace;
+  mt_thread_t *next = &run->threads[(thread->id + 1) % run->num_threads];
+  mt_thread_t *prev = &run->threads[(thread->id + run->num_threads - 1) %
+                                    run->num_threads];
+  int handoff = (run->mode == MT_PRODUCER_CONSUMER);
+  char **blocks = thread->blocks;
+  int *sizes = thread->sizes;
+  int i, index, size;
+  char *p;
+
+  for (i = 0; i < trace->num_ops; i++) {
+    index = trace->ops[i].index;
+    size = trace->ops[i].size;
+    switch (trace->ops[i].type) {
+      case ALLOC:
+      case CALLOC:
+      case MEMALIGN:
+        if (trace->ops[i].type == CALLOC)
+          p = impl->calloc(1, size);
+        else if (trace->ops[i].type == MEMALIGN)
+          p = impl->memalign(trace->ops[i].align, size);
+        else
+          p = impl->malloc(size);
+        if (p == NULL)
+          goto failed;
+        if (run->track)
+          mt_track(run, p, size, size);
+        blocks[index] = p;
+        sizes[index] = size;
+        break;
+
+      case REALLOC:
+        if ((p = impl->realloc(blocks[index], size)) == NULL)
+          goto failed;
+        if (run->track)
+          mt_track(run, p, size, size - sizes[index]);
+        blocks[index] = p;
+        sizes[index] = size;
+        break;
+
+      case FREE:
+      case SIZED_FREE:
+        if (run->track)
+          mt_track(run, NULL, 0, -sizes[index]);
+        if (!handoff) {
+          if (trace->ops[i].type == SIZED_FREE)
+            impl->free_sized(blocks[index], size);
+          else
+            impl->free(blocks[index]);
+          break;
+        }
+        /* The consumer doesn't know the size, so handed-off frees are
+         * plain frees. */
+        /* Keep freeing our own queue while the next thread's is full, or
+         * two threads waiting on each other would never finish. */
+        while (!mt_queue_push(&next->inbox, blocks[index])) {
+          if (mt_queue_drain(impl, &thread->inbox) == 0)
+            sched_yield();
+        }
+        break;
+
+      default:
+        app_error("Nonexistent request type in mt_replay_thread");
+    }
+
+    if (handoff && (i & 63) == 0)
+      mt_queue_drain(impl, &thread->inbox);
+  }
+
+  if (0) {
+ failed:
+    thread->failed = 1;
+  }
+
+  __atomic_store_n(&thread->done, 1, __ATOMIC_RELEASE);
+  if (handoff) {
+    /* Whatever prev queued before saying it was done is in the queue when
+     * we next look, so one last drain after seeing done empties it. */
+    for (;;) {
+      int prev_done = __atomic_load_n(&prev->done, __ATOMIC_ACQUIRE);
+      if (mt_queue_drain(impl, &thread->inbox) == 0) {
+        if (prev_done)
+          break;
+        sched_yield();
+      }
+    }
+  }
+  return NULL;
+}
+
+/*
+ * mt_track - Add delta to the run's live payload bytes and raise the peak.
+ *    When a block of size bytes has grown by delta, the new bytes are
+ *    written, as the program would write them, so that their pages count
+ *    toward the resident set.
+ */
+static void mt_track(mt_run_t *run, char *block, int size, long delta)
+{
+  long live = __atomic_add_fetch(&run->live_bytes, delta, __ATOMIC_RELAXED);
+  long peak = __atomic_load_n(&run->peak_bytes, __ATOMIC_RELAXED);
+
+  if (block != NULL && delta > 0)
+    memset(block + size - delta, 0, delta);
+
+  while (live > peak &&
+         !__atomic_compare_exchange_n(&run->peak_bytes, &peak, live, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+/*
+ * mt_queue_push - Queue block for the consumer.  Returns 0 if the queue is
+ *    full.
+ */
+static int mt_queue_push(mt_queue_t *queue, char *block)
+{
+  size_t tail = queue->tail;
+
+  if (tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) ==
+      MT_QUEUE_SLOTS)
+    return 0;
+  queue->slots[tail % MT_QUEUE_SLOTS] = block;
+  __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/*
+ * mt_queue_drain - Free every block in the queue.  Returns how many there
+ *    were.
+ */
+static int mt_queue_drain(malloc_impl_t *impl, mt_queue_t *queue)
+{
+  size_t head = queue->head;
+  size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+  int n = tail - head;
+
+  while (head != tail)
+    impl->free(queue->slots[head++ % MT_QUEUE_SLOTS]);
+  __atomic_store_n(&queue->head, head, __ATOMIC_RELEASE);
+  return n;
+}
+
+/*
+ * proc_status_kb - Read a "Field:  N kB" line from /proc/self/status.
+ *    Returns 0 if the field can't be read.
+ */
+static long proc_status_kb(const char *field)
+{
+  char line[MAXLINE];
+  long kb = 0;
+  FILE *f;
+
+  if ((f = fopen("/proc/self/status", "r")) == NULL)
+    return 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (strncmp(line, field, strlen(field)) == 0) {
+      kb = atol(line + strlen(field));
+      break;
+    }
+  }
+  fclose(f);
+  return kb;
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -756,27 +1543,54 @@ static void printresults(int n, char **tracefiles, stats_t *stats)
   double secs = 0;
   double ops = 0;
   double util = 0;
-
-  /* Print the individual results for each trace */
-  printf("%5s%27s%10s%10s%6s%8s%10s%9s\n",
-         "trace", "filename", " valid", "checked", "util", "ops", "secs", "Kops/sec");
+  double rss_util = 0;
+  double mean_secs = 0;  /* sum of the mean times, or -1 if one is missing */
+  double var = 0;  /* sum of the squared confidence intervals, in secs */
+  char mean[16], ci[16];
+
+  /* Print the individual results for each trace.  secs is the best time,
+   * which Kops/sec is computed from; the interval is for the mean of the
+   * timer's best runs, printed with it. */
+  printf("%5s%27s%10s%10s%6s%6s%11s%10s%10s%7s%9s\n",
+         "trace", "filename", " valid", "checked", "util", "rss", "ops", "secs",
+         "mean", "+/-", "Kops/sec");
   for (i = 0; i < n; i++) {
     if (stats[i].valid) {
-      printf("%2d%30s%10s%10s%5.0f%%%8.0f%10.6f %8.0f\n",
+      if (stats[i].mean >= 0)
+        sprintf(mean, "%10.6f", stats[i].mean);
+      else
+        strcpy(mean, "-");
+      if (stats[i].ci >= 0 && stats[i].mean >= 0)
+        sprintf(ci, "%5.1f%%", stats[i].ci*100.0);
+      else
+        strcpy(ci, "-");
+      printf("%2d%30s%10s%10s%5.0f%%%5.0f%%%11.0f%10.6f%10s%7s %8.0f\n",
              i,
              tracefiles[i],
              "yes",
              (stats[i].checked ? "yes" : "no"),
              stats[i].util*100.0,
+             stats[i].rss_util*100.0,
              stats[i].ops,
              stats[i].secs,
+             mean,
+             ci,
              (stats[i].ops/1e3)/stats[i].secs);
+      if (stats[i].mean < 0 || mean_secs < 0)
+        mean_secs = -1;
+      else
+        mean_secs += stats[i].mean;
+      if (stats[i].ci < 0 || stats[i].mean < 0 || var < 0)
+        var = -1;
+      else
+        var += (stats[i].ci*stats[i].mean) * (stats[i].ci*stats[i].mean);
       secs += stats[i].secs;
       ops += stats[i].ops;
       util += stats[i].util;
+      rss_util += stats[i].rss_util;
     }
     else {
-      printf("%2d%30s%10s%10s%6s%8s%10s%8s\n",
+      printf("%2d%30s%10s%10s%6s%6s%11s%10s%10s%7s%8s\n",
              i,
              tracefiles[i],
              "no",
@@ -784,32 +1598,92 @@ static void printresults(int n, char **tracefiles, stats_t *stats)
              "-",
              "-",
              "-",
+             "-",
+             "-",
+             "-",
              "-");
     }
   }
 
   /* Print the aggregate results for the set of traces */
   if (errors == 0) {
-    printf("%12s%40s%5.0f%%%8.0f%10.6f %8.0f\n",
+    /* The traces' times are independent, so their intervals add in
+     * quadrature. */
+    if (mean_secs >= 0)
+      sprintf(mean, "%10.6f", mean_secs);
+    else
+      strcpy(mean, "-");
+    if (var >= 0 && mean_secs > 0)
+      sprintf(ci, "%5.1f%%", sqrt(var)/mean_secs*100.0);
+    else
+      strcpy(ci, "-");
+    printf("%12s%40s%5.0f%%%5.0f%%%11.0f%10.6f%10s%7s %8.0f\n",
            "Total       ",
            "",
            (util/n)*100.0,
+           (rss_util/n)*100.0,
            ops,
            secs,
+           mean,
+           ci,
            (ops/1e3)/secs);
   }
   else {
-    printf("%12s%40s%6s%8s%10s%8s\n",
+    printf("%12s%40s%6s%6s%11s%10s%10s%7s%8s\n",
            "Total       ",
            "",
            "-",
            "-",
            "-",
+           "-",
+           "-",
+           "-",
            "-");
   }
 
 }
 
+/*
+ * printlatency - prints the latency percentiles of each type of request,
+ *     for each trace and for all of them together
+ */
+static void printlatency(int n, char **tracefiles, hist_t *hists)
+{
+  static const double percentiles[] = {50, 90, 99, 99.9};
+  hist_t *total;
+  int i, t, j;
+
+  if ((total = (hist_t *)calloc(NUM_OP_TYPES, sizeof(hist_t))) == NULL)
+    unix_error("calloc in printlatency failed");
+
+  printf("%5s%27s%11s%10s%8s%8s%8s%8s%9s\n",
+         "trace", "filename", "request", "ops", "p50", "p90", "p99", "p99.9",
+         "max");
+  for (i = 0; i <= n; i++) {
+    int first = 1;  /* name the trace on its first line only */
+    for (t = 0; t < NUM_OP_TYPES; t++) {
+      hist_t *hist = (i < n) ? &hists[i * NUM_OP_TYPES + t] : &total[t];
+      if (hist->total == 0)
+        continue;
+      if (i < n) {
+        hist_add(&total[t], hist);
+        if (first)
+          printf("%2d%30s", i, tracefiles[i]);
+        else
+          printf("%32s", "");
+      } else {
+        printf("%-32s", first ? "Total" : "");
+      }
+      first = 0;
+      printf("%11s%10lu", op_names[t], (unsigned long)hist->total);
+      for (j = 0; j < 4; j++)
+        printf("%8.0f", hist_percentile(hist, percentiles[j]) * 1e9 / lat_hz);
+      printf("%9.0f\n", hist->max * 1e9 / lat_hz);
+    }
+  }
+  free(total);
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -842,13 +1716,26 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void)
 {
-  fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+  fprintf(stderr, "Usage: mdriver [-hvValPc] [-C <k>] [-f <file>] [-t <dir>] "
+          "[-T <n>]\n\t[-L] [-H thp|hugetlb] [-j <n>] [-m mm|tree]\n");
   fprintf(stderr, "Options\n");
+  fprintf(stderr, "\t-c         Check the heap after every operation.\n");
+  fprintf(stderr, "\t-C <k>     Like -c, but have mm_check look only at the blocks\n");
+  fprintf(stderr, "\t           each operation touched, walking the whole heap\n");
+  fprintf(stderr, "\t           about every <k> operations.\n");
   fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
   fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
   fprintf(stderr, "\t-h         Print this message.\n");
+  fprintf(stderr, "\t-H <kind>  Back the heap with huge pages: thp, or hugetlb\n");
+  fprintf(stderr, "\t           (falling back to thp).\n");
+  fprintf(stderr, "\t-j <n>     Check the traces for correctness <n> at a time.\n");
   fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+  fprintf(stderr, "\t-L         Print percentiles of each request's latency.\n");
+  fprintf(stderr, "\t-m <pkg>   Evaluate <pkg> as the mm malloc: mm (default), or tree\n");
+  fprintf(stderr, "\t           for the tree best-fit allocator.\n");
+  fprintf(stderr, "\t-P         With -T, free each block on the next thread over.\n");
   fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+  fprintf(stderr, "\t-T <n>     Measure mm_mt (and libc with -l) on 1..n threads.\n");
   fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
   fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
@@ -9,6 +9,8 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define MT_QUEUE_SLOTS 1024 /* frees in flight between two replay threads */
+#define LATENCY_RUNS  10 /* replays of a trace when timing each request */
 
 /******************************
  * The key compound data types
@@ -16,11 +18,16 @@
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-  enum {ALLOC, FREE, REALLOC} type; /* type of request */
+  enum {ALLOC, FREE, REALLOC,       /* type of request */
+        CALLOC, MEMALIGN, SIZED_FREE} type;
   int index;                        /* index for free() to use later */
-  int size;                         /* byte size of alloc/realloc request */
+  int size;                         /* byte size of alloc/realloc request,
+                                       or of the block a sized free frees */
+  int align;                        /* alignment of a memalign request */
 } traceop_t;
 
+#define NUM_OP_TYPES (SIZED_FREE + 1) /* number of request types */
+
 /* Holds the information for one trace file*/
 typedef struct {
   int sugg_heapsize;   /* suggested heap size (unused) */
@@ -41,6 +48,9 @@ typedef struct {
   void *(*malloc)(size_t size);
   void *(*realloc)(void *ptr, size_t size);
   void (*free)(void *ptr);
+  void *(*calloc)(size_t nmemb, size_t size);
+  void *(*memalign)(size_t alignment, size_t size);
+  void (*free_sized)(void *ptr, size_t size);
   int (*check)();
   void (*reset_brk)(void);
   void *(*heap_lo)(void);
@@ -2,6 +2,20 @@
  * memlib.c - a module that simulates the memory system.  Needed because it
  *            allows us to interleave calls from the student's malloc package
  *            with the system's malloc package in libc.
+ *
+ * The heap's MAX_HEAP bytes of address space are reserved up front but
+ * inaccessible; pages are committed COMMIT_CHUNK bytes at a time as the brk
+ * reaches them, and decommitted again when the heap shrinks.  Pages inside
+ * the heap can be handed back to the system with mem_release.
+ *
+ * The heap can instead be backed by 2 MB huge pages, either transparent
+ * ones the kernel is asked for with madvise, or explicit ones from the
+ * hugetlbfs pool.  The pool's pages are reserved at mem_init, for a heap
+ * of at most MAX_HUGETLB_HEAP bytes, and if it is too small the heap falls
+ * back to transparent huge pages.  With huge
+ * pages, the heap starts on a huge page boundary, and it is committed
+ * and released a whole huge page at a time, so that releasing memory
+ * never splits one.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,28 +24,104 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* Granularity of committing and decommitting heap pages.  A multiple of
+ * the page size. */
+#define COMMIT_CHUNK (64 * 1024)
+
+/* Size of a huge page on x86-64 */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */
+static char *mem_commit;     /* first byte past the committed pages */
+static char *mem_peak_brk;   /* highest brk since the last reset */
+static char *mem_map;        /* start of the reserved mapping */
+static size_t mem_map_len;   /* and its length */
+static size_t mem_chunk = COMMIT_CHUNK;  /* commit granularity */
+static int mem_page_kind = MEM_PAGES_SMALL;  /* what backs the heap */
+static int mem_rss_watch;    /* keep mem_rss_peak up to date? */
+static size_t mem_rss_peak;  /* most heap resident before a release */
+
+/* Function prototypes for internal helpers */
+static int mem_commit_to(char *addr);
+static void mem_decommit_from(char *addr);
+static void mem_note_rss(void);
+
+/*
+ * mem_set_pages - choose what mem_init backs the heap with: MEM_PAGES_SMALL,
+ *    MEM_PAGES_THP or MEM_PAGES_HUGETLB
+ */
+void mem_set_pages(int kind)
+{
+  mem_page_kind = kind;
+}
+
+/*
+ * mem_pages - what backs the heap, which after mem_init may be a fallback
+ *    from what was asked for
+ */
+int mem_pages(void)
+{
+  return mem_page_kind;
+}
 
 /*
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-  /* allocate the storage we will use to model the available VM */
-  if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-    fprintf(stderr, "mem_init_vm: malloc error\n");
-    exit(1);
+  mem_map = MAP_FAILED;
+  mem_chunk = COMMIT_CHUNK;
+
+  /* hugetlbfs pages are reserved from the pool now, so that running out
+   * shows up here rather than as a SIGBUS at first touch */
+  if (mem_page_kind == MEM_PAGES_HUGETLB) {
+    mem_map_len = MAX_HUGETLB_HEAP + HUGE_PAGE_SIZE - 1;
+    mem_map_len -= mem_map_len % HUGE_PAGE_SIZE;
+    mem_map = mmap(NULL, mem_map_len, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem_map == MAP_FAILED)
+      mem_page_kind = MEM_PAGES_THP;
+    mem_start_brk = mem_map;
   }
 
-  mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
+  /* reserve the address space we will use to model the available VM,
+   * with room to start it on a huge page boundary if need be */
+  if (mem_map == MAP_FAILED) {
+    mem_map_len = MAX_HEAP;
+    if (mem_page_kind == MEM_PAGES_THP)
+      mem_map_len += HUGE_PAGE_SIZE;
+    mem_map = mmap(NULL, mem_map_len, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_map == MAP_FAILED) {
+      fprintf(stderr, "mem_init_vm: mmap error\n");
+      exit(1);
+    }
+    mem_start_brk = mem_map;
+    if (mem_page_kind == MEM_PAGES_THP) {
+      mem_start_brk = (char *)(((uintptr_t)mem_map + HUGE_PAGE_SIZE - 1) &
+                               ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+      if (madvise(mem_start_brk, MAX_HEAP, MADV_HUGEPAGE) < 0)
+        mem_page_kind = MEM_PAGES_SMALL;
+    }
+  }
+
+  if (mem_page_kind != MEM_PAGES_SMALL)
+    mem_chunk = HUGE_PAGE_SIZE;
+
+  /* max legal heap address */
+  mem_max_addr = mem_start_brk + ((mem_page_kind == MEM_PAGES_HUGETLB) ?
+                                  MAX_HUGETLB_HEAP : MAX_HEAP);
   mem_brk = mem_start_brk;                  /* heap is empty initially */
+  mem_commit = mem_start_brk;               /* and nothing is committed */
+  mem_peak_brk = mem_start_brk;
 }
 
 /*
@@ -39,35 +129,144 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-  free(mem_start_brk);
+  munmap(mem_map, mem_map_len);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap.
+ *    The pages stay committed and resident, so that timing runs don't pay
+ *    to fault them in again on every repetition.
  */
 void mem_reset_brk(void)
 {
   mem_brk = mem_start_brk;
+  mem_peak_brk = mem_start_brk;
+}
+
+/*
+ * mem_trim - decommit every page past the brk, giving it back to the system.
+ */
+void mem_trim(void)
+{
+  mem_decommit_from(mem_brk);
 }
 
 /*
  * mem_sbrk - simple model of the sbrk function. Extends the heap
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes, or shrinks it if incr is negative, and returns the
+ *    old brk, which for a positive incr is the start of the new area.
+ *    Growing is safe from several threads at once: the brk pointer only
+ *    moves by compare-and-swap, and only once the pages it will cover are
+ *    committed, so a failed commit leaves the heap as it was.  Shrinking
+ *    decommits the pages the heap no longer covers, so it must not race
+ *    with other calls.
  */
 void *mem_sbrk(int incr)
 {
-  char *old_brk = mem_brk;
+  char *old_brk = __atomic_load_n(&mem_brk, __ATOMIC_RELAXED);
+  char *peak;
 
-  if ((incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-    errno = ENOMEM;
-    fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-    return (void *)-1;
+  do {
+    if (((old_brk + incr) > mem_max_addr) ||
+        ((old_brk + incr) < mem_start_brk)) {
+      errno = ENOMEM;
+      fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+      return (void *)-1;
+    }
+    if (incr > 0 && mem_commit_to(old_brk + incr) < 0) {
+      errno = ENOMEM;
+      fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit memory...\n");
+      return (void *)-1;
+    }
+  } while (!__atomic_compare_exchange_n(&mem_brk, &old_brk, old_brk + incr,
+                                        1, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_RELAXED));
+
+  if (incr < 0) {
+    mem_decommit_from(old_brk + incr);
+    return (void *)old_brk;
   }
-  mem_brk += incr;
+
+  peak = __atomic_load_n(&mem_peak_brk, __ATOMIC_RELAXED);
+  while (old_brk + incr > peak &&
+         !__atomic_compare_exchange_n(&mem_peak_brk, &peak, old_brk + incr,
+                                      1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
   return (void *)old_brk;
 }
 
+/*
+ * mem_commit_to - make sure the pages up to addr are committed, extending
+ *    the committed range a whole chunk at a time.  Threads growing
+ *    the heap together may commit the same pages twice, which is harmless.
+ *    Returns -1 if the system refuses.
+ */
+static int mem_commit_to(char *addr)
+{
+  char *commit = __atomic_load_n(&mem_commit, __ATOMIC_ACQUIRE);
+  char *end;
+
+  while (addr > commit) {
+    end = mem_start_brk + (addr - mem_start_brk + mem_chunk - 1) /
+        mem_chunk * mem_chunk;
+    if (end > mem_max_addr)
+      end = mem_max_addr;
+    if (mprotect(commit, end - commit, PROT_READ | PROT_WRITE) < 0)
+      return -1;
+    if (__atomic_compare_exchange_n(&mem_commit, &commit, end, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      break;
+  }
+  return 0;
+}
+
+/*
+ * mem_decommit_from - give back the pages past addr: release the ones in
+ *    its chunk, and remap the whole chunks after it inaccessible, which
+ *    also returns their commit charge.  Remapped transparent huge pages are
+ *    advised again.  hugetlbfs pages stay mapped, since
+ *    they are reserved for the heap anyway.
+ */
+static void mem_decommit_from(char *addr)
+{
+  char *keep = mem_start_brk + (addr - mem_start_brk + mem_chunk - 1) /
+      mem_chunk * mem_chunk;
+
+  if (keep > mem_commit)
+    keep = mem_commit;
+  mem_release(addr, keep);
+  if (mem_page_kind == MEM_PAGES_HUGETLB) {
+    mem_release(keep, mem_commit);
+  } else if (keep < mem_commit) {
+    mem_note_rss();
+    if (mmap(keep, mem_commit - keep, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+             -1, 0) == MAP_FAILED)
+      return;
+    /* The new mapping doesn't inherit the old one's advice */
+    if (mem_page_kind == MEM_PAGES_THP)
+      madvise(keep, mem_commit - keep, MADV_HUGEPAGE);
+    mem_commit = keep;
+  }
+}
+
+/*
+ * mem_release - hand the whole pages between lo and hi (the first byte past
+ *    the range) back to the system.  They stay part of the heap, and read
+ *    as zeros when next touched.  Pages are mem_pagesize() bytes.
+ */
+void mem_release(void *lo, void *hi)
+{
+  size_t pagesize = mem_pagesize();
+  uintptr_t start = ((uintptr_t)lo + pagesize - 1) & ~(pagesize - 1);
+  uintptr_t end = (uintptr_t)hi & ~(pagesize - 1);
+
+  if (start < end) {
+    mem_note_rss();
+    madvise((void *)start, end - start, MADV_DONTNEED);
+  }
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -94,9 +293,83 @@ size_t mem_heapsize(void)
 }
 
 /*
- * mem_pagesize() - returns the page size of the system
+ * mem_peak_heapsize() - returns the largest the heap has been, in bytes,
+ *    since the last reset
+ */
+size_t mem_peak_heapsize(void)
+{
+  return (size_t)(mem_peak_brk - mem_start_brk);
+}
+
+/*
+ * mem_heap_rss() - returns how many bytes of the committed heap pages are
+ *    resident in memory
+ */
+size_t mem_heap_rss(void)
+{
+  size_t pagesize = (size_t)getpagesize();
+  size_t pages = (mem_commit - mem_start_brk) / pagesize;
+  size_t resident = 0, i, n;
+  unsigned char vec[4096];
+  char *p = mem_start_brk;
+
+  while (pages > 0) {
+    n = (pages < sizeof(vec)) ? pages : sizeof(vec);
+    if (mincore(p, n * pagesize, vec) < 0)
+      return 0;
+    for (i = 0; i < n; i++)
+      resident += vec[i] & 1;
+    p += n * pagesize;
+    pages -= n;
+  }
+  return resident * pagesize;
+}
+
+/*
+ * mem_watch_rss() - start (or stop) keeping track of the most heap memory
+ *    resident at once.  Starting forgets the peak so far.
+ */
+void mem_watch_rss(int on)
+{
+  mem_rss_watch = on;
+  mem_rss_peak = 0;
+}
+
+/*
+ * mem_peak_rss() - returns the most heap memory resident at once since
+ *    mem_watch_rss(1).  Heap pages only leave the resident set when memlib
+ *    gives them back, so between releases the resident size only grows, and
+ *    the peak is the resident size just before some release or now.  That
+ *    takes a mincore per release rather than one per allocation.
+ */
+size_t mem_peak_rss(void)
+{
+  size_t rss = mem_heap_rss();
+
+  return (rss > mem_rss_peak) ? rss : mem_rss_peak;
+}
+
+/*
+ * mem_note_rss - record the resident heap size, if it is being watched,
+ *    before pages are given back
+ */
+static void mem_note_rss(void)
+{
+  size_t rss;
+
+  if (!mem_rss_watch)
+    return;
+  rss = mem_heap_rss();
+  if (rss > mem_rss_peak)
+    mem_rss_peak = rss;
+}
+
+/*
+ * mem_pagesize() - returns the size of the pages backing the heap
  */
 size_t mem_pagesize(void)
 {
+  if (mem_page_kind != MEM_PAGES_SMALL)
+    return HUGE_PAGE_SIZE;
   return (size_t)getpagesize();
 }
@@ -3,13 +3,26 @@
 
 #include <unistd.h>
 
+/* What backs the simulated heap */
+#define MEM_PAGES_SMALL   0  /* ordinary pages */
+#define MEM_PAGES_THP     1  /* transparent huge pages */
+#define MEM_PAGES_HUGETLB 2  /* hugetlbfs huge pages */
+
+void mem_set_pages(int kind);
+int mem_pages(void);
 void mem_init(void);
 void mem_deinit(void);
 void *mem_sbrk(int incr);
 void mem_reset_brk(void);
+void mem_trim(void);
+void mem_release(void *lo, void *hi);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
+size_t mem_heap_rss(void);
+void mem_watch_rss(int on);
+size_t mem_peak_rss(void);
 size_t mem_pagesize(void);
 
 #endif /* MM_MEMLIB_H */
@@ -1,21 +1,44 @@
 /*
- * In this naive approach, a block is allocated by simply incrementing
- * the brk pointer.  A block is pure payload (that is, the entire block
- * of memory which is internally allocated is returned for the caller to use).
- * There are no headers or footers.  Blocks are never coalesced or even reused.
- * mm_realloc is implemented directly using mm_malloc and mm_free.
+ * mm.c - Segregated explicit free-list allocator with boundary tags.
  *
- * Almost every line is commented in this reference implementation, and the
- * explanations are quite lengthy.  This is intended to help you figure out
- * what's going on without looking everything up.  You should assume that your
- * comments will be read by someone who is familiar with C and with the
- * standard library calls that this code makes.  To such a reader, many of the
- * comments below would simply be distracting.  Instead of explaining /how/
- * you're accomplishing a particular task, you should explain /what/ you're
- * accomplishing and /why/ that's useful.
+ * Every block starts with a 4-byte header holding the block size (a multiple
+ * of 8) and two flag bits: whether this block is allocated, and whether the
+ * block just before it is.  Free blocks also carry a copy of the header as a
+ * footer in their last word, which lets a block being freed find a free
+ * predecessor and coalesce with it immediately.  Allocated blocks have no
+ * footer; the "previous allocated" bit in the next block's header stands in
+ * for it.  Payloads are 8-byte aligned.
  *
- * Note: Change this comment block to give a brief description of your allocator.
+ * Free blocks are kept on NUM_CLASSES doubly linked lists segregated by size:
+ * one list per 8-byte size up to 64 bytes, then one per power of two.  The
+ * links are 32-bit offsets from the start of the heap, so the smallest block
+ * (header, two links, footer) is 16 bytes.  The list heads live at the very
+ * start of the simulated heap.
  *
+ * malloc searches the request's size class, and then each larger class.
+ * Within a class it takes the first block that fits, then looks at up to
+ * BESTFIT_SCAN more blocks for a tighter fit.  A block is split when the
+ * leftover would be at least MIN_BLOCK bytes.  When nothing fits, the heap is
+ * grown by only as much as the request needs beyond a free block already at
+ * the end of the heap.
+ *
+ * Free memory goes back to the system once it has gone unused for a while,
+ * counted in frees.  Every PURGE_INTERVAL frees, each free block of at least
+ * RELEASE_THRESHOLD bytes that was already free at the previous pass has its
+ * pages released, and if such a block of at least TRIM_THRESHOLD bytes ends
+ * the heap, it is cut off and the heap shrunk.  Memory that is freed and
+ * soon reused never makes the round trip through the system.  When the heap
+ * is backed by huge pages, both sizes grow to two huge pages, since memory
+ * goes back a whole huge page at a time.
+ *
+ * mm_check normally walks the whole heap.  With mm_check_incremental, the
+ * allocator instead remembers the blocks each operation leaves behind, and
+ * mm_check looks only at those, their neighbors and their free-list links,
+ * walking the whole heap again only every so many checks.
+ *
+ * Heap layout:
+ *
+ *   | list heads | pad | prologue hdr | prologue ftr | blocks ... | epilogue |
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,118 +56,1290 @@
 /* Rounds up to the nearest multiple of ALIGNMENT. */
 #define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
 
-/* The smallest aligned size that will hold a size_t value. */
-#define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
+/* Word (header, footer, link) and double word sizes in bytes. */
+#define WSIZE 4
+#define DSIZE 8
+
+/* Smallest block: header, next link, prev link, footer. */
+#define MIN_BLOCK 16
+
+/* Number of segregated free lists.  Keep it even so that the list heads fill
+ * whole double words. */
+#define NUM_CLASSES 20
+
+/* How many more blocks to examine after the first fit, looking for a tighter
+ * one. */
+#define BESTFIT_SCAN 8
+
+/* How often, in frees, to give idle free memory back to the system, and
+ * how big a free block must be to have its pages released, or to be cut
+ * off the end of the heap, with ordinary pages. */
+#define PURGE_INTERVAL 4096
+#define RELEASE_THRESHOLD (64 * 1024)
+#define TRIM_THRESHOLD (128 * 1024)
+
+/* Header bits. */
+#define ALLOC_BIT      0x1
+#define PREV_ALLOC_BIT 0x2
+
+/* Pack a size and flag bits into a header word. */
+#define PACK(size, bits) ((uint32_t)(size) | (bits))
+
+/* Read and write a word at address p. */
+#define GET(p)      (*(uint32_t *)(p))
+#define PUT(p, val) (*(uint32_t *)(p) = (val))
+
+/* Read the size and flags from a header or footer at address p. */
+#define GET_SIZE(p)       (GET(p) & ~0x7)
+#define GET_ALLOC(p)      (GET(p) & ALLOC_BIT)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC_BIT)
+
+/* Given a block pointer bp (the payload address), compute the address of its
+ * header and footer. */
+#define HDRP(bp) ((char *)(bp) - WSIZE)
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+
+/* Given a block pointer bp, compute the block pointer of the next block, and
+ * of the previous block.  PREV_BLKP reads the previous block's footer, so it
+ * is only valid when that block is free. */
+#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)))
+#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE((char *)(bp) - DSIZE))
+
+/* Free-list links, stored as heap offsets in the first two payload words. */
+#define NEXT_FREE(bp) GET(bp)
+#define PREV_FREE(bp) GET((char *)(bp) + WSIZE)
+#define SET_NEXT_FREE(bp, off) PUT(bp, off)
+#define SET_PREV_FREE(bp, off) PUT((char *)(bp) + WSIZE, off)
+
+/* For a free block of at least release_min bytes, the free clock's
+ * reading when most of it was last in use, kept in the word after the
+ * links.  Zero once the block's pages have been released. */
+#define FREED_AT(bp) GET((char *)(bp) + DSIZE)
+#define SET_FREED_AT(bp, t) PUT((char *)(bp) + DSIZE, t)
+
+/* Convert between block pointers and heap offsets.  Offset 0 is the first
+ * list head, which is never a block, so it doubles as NULL. */
+#define OFFSET(bp)    ((uint32_t)((char *)(bp) - heap_base))
+#define BLOCK_AT(off) ((off) ? heap_base + (off) : NULL)
+
+/* Requests of up to SLAB_MAX bytes are served from slabs: SLAB_SIZE-aligned
+ * pages holding objects of a single size class, with no per-object header.
+ * Each slab is the payload of an allocated block exactly SLAB_SIZE long, so
+ * the heap walk steps over it like any other block.  The block's header sits
+ * in the last word of the page before, so consecutive slabs tile the heap,
+ * and SLAB_BYTES is all of the page but its own last word. */
+#define SLAB_MAX 512
+#define SLAB_SIZE 4096
+#define SLAB_SHIFT 12
+#define SLAB_BYTES (SLAB_SIZE - WSIZE)
+#define NUM_SLAB_CLASSES 20
+
+/* Enough bitmap words for a slab of the smallest objects. */
+#define SLAB_MAP_WORDS (SLAB_SIZE / ALIGNMENT / 64)
+
+/* A slab's header, at the start of its page.  Slabs with free objects are
+ * kept on a doubly linked list per size class. */
+typedef struct {
+  uint32_t next;      /* heap offset of the next slab with free objects */
+  uint32_t prev;      /* heap offset of the previous one */
+  uint16_t obj_size;  /* bytes per object */
+  uint16_t nobjs;     /* objects in the slab */
+  uint16_t nfree;     /* objects not allocated */
+  uint16_t cls;       /* slab size class */
+  uint64_t free_map[SLAB_MAP_WORDS];  /* bit i is set if object i is free */
+} slab_t;
+
+/* The first object in a slab, and the slab holding object ptr. */
+#define SLAB_OBJS(slab) ((char *)(slab) + sizeof(slab_t))
+#define SLAB_OF(ptr) \
+  ((slab_t *)((uintptr_t)(ptr) & ~(uintptr_t)(SLAB_SIZE - 1)))
+
+/* Index of the page holding ptr, counting from the page where the heap
+ * starts. */
+#define PAGE_INDEX(ptr) \
+  (((uintptr_t)(ptr) >> SLAB_SHIFT) - ((uintptr_t)heap_base >> SLAB_SHIFT))
+
+/* Space taken by the list heads, rounded up to a double word. */
+#define HEADS_SIZE ALIGN((NUM_CLASSES + NUM_SLAB_CLASSES) * WSIZE)
+
+/* Start of the heap, and the list heads stored there: first the free lists,
+ * then the lists of slabs with free objects. */
+static char *heap_base;
+static uint32_t *class_heads;
+static uint32_t *slab_heads;
+
+/* Bitmap with a bit set for each page that is a slab.  It lives in a block
+ * from the general allocator and is replaced by one twice as big whenever a
+ * slab lands past its end. */
+static uint8_t *slab_map;
+static size_t slab_map_pages;
+
+/* Counts frees from the general allocator, starting at 1. */
+static uint32_t free_clock;
+
+/* RELEASE_THRESHOLD and TRIM_THRESHOLD, raised for huge pages. */
+static size_t release_min;
+static size_t trim_min;
+
+/* Incremental checking.  The blocks touched since the last check; more than
+ * TOUCH_MAX of them, or a heap reshaped by a purge, calls for a full walk,
+ * as does every check_left-th check.  Nothing is recorded while
+ * check_every is 0. */
+#define TOUCH_MAX 8
+static char *touched[TOUCH_MAX];
+static int num_touched;
+static int check_every;      /* checks between full walks, on average */
+static int check_left;       /* checks until the next full walk */
+static uint32_t check_seed = 1;
+
+/* Function prototypes for internal helpers */
+static int size_class(size_t size);
+static size_t adjust_size(size_t size);
+static void insert_free(char *bp);
+static void remove_free(char *bp);
+static void set_prev_alloc(char *bp, int prev_alloc);
+static char *coalesce(char *bp);
+static char *extend_heap(size_t size);
+static char *grow_heap(size_t asize);
+static char *find_fit(size_t asize);
+static void place(char *bp, size_t asize);
+static void shrink(char *bp, size_t asize);
+static void *block_malloc(size_t size);
+static void *block_malloc_aligned(size_t size, size_t align);
+static char *align_up(char *bp, size_t align);
+static void block_free(char *bp);
+static void purge(void);
+static int slab_class(size_t size);
+static size_t slab_obj_size(int cls);
+static int in_slab(void *ptr);
+static int slab_map_cover(size_t index);
+static void slab_push(slab_t *slab);
+static void slab_unlink(slab_t *slab);
+static slab_t *slab_new(int cls);
+static void *slab_malloc(int cls);
+static void slab_free(void *ptr);
+static int check_slabs(void);
+static void touch(char *bp);
+static void forget(char *bp);
+static int check_all(void);
+static int check_touched(void);
+static int check_block(char *bp);
+static int check_slab(slab_t *slab);
+
+/*
+ * size_class - Map a block size to the index of its free list.
+ */
+static int size_class(size_t size)
+{
+  int c;
+
+  if (size <= 64)
+    return size / DSIZE - 2;  /* 16 -> 0, 24 -> 1, ..., 64 -> 6 */
+
+  /* 65..128 -> 7, 129..256 -> 8, and so on. */
+  c = 7;
+  size = (size - 1) >> 7;
+  while (size > 0 && c < NUM_CLASSES - 1) {
+    size >>= 1;
+    c++;
+  }
+  return c;
+}
+
+/*
+ * adjust_size - Block size needed to hold a payload of size bytes.
+ */
+static size_t adjust_size(size_t size)
+{
+  size_t asize = ALIGN(size + WSIZE);
+  return (asize < MIN_BLOCK) ? MIN_BLOCK : asize;
+}
+
+/*
+ * insert_free - Push free block bp on the front of its size class's list.
+ */
+static void insert_free(char *bp)
+{
+  int c = size_class(GET_SIZE(HDRP(bp)));
+  uint32_t head = class_heads[c];
+
+  SET_NEXT_FREE(bp, head);
+  SET_PREV_FREE(bp, 0);
+  if (head)
+    SET_PREV_FREE(BLOCK_AT(head), OFFSET(bp));
+  class_heads[c] = OFFSET(bp);
+}
+
+/*
+ * remove_free - Unlink free block bp from its size class's list.
+ */
+static void remove_free(char *bp)
+{
+  uint32_t next = NEXT_FREE(bp);
+  uint32_t prev = PREV_FREE(bp);
+
+  if (prev)
+    SET_NEXT_FREE(BLOCK_AT(prev), next);
+  else
+    class_heads[size_class(GET_SIZE(HDRP(bp)))] = next;
+  if (next)
+    SET_PREV_FREE(BLOCK_AT(next), prev);
+}
+
+/*
+ * set_prev_alloc - Record in block bp's header whether the block before it is
+ *     allocated, updating its footer too if bp is free.
+ */
+static void set_prev_alloc(char *bp, int prev_alloc)
+{
+  uint32_t hdr = GET(HDRP(bp));
+
+  hdr = prev_alloc ? (hdr | PREV_ALLOC_BIT) : (hdr & ~PREV_ALLOC_BIT);
+  PUT(HDRP(bp), hdr);
+  if (!(hdr & ALLOC_BIT) && GET_SIZE(HDRP(bp)) > 0)
+    PUT(FTRP(bp), hdr);
+}
+
+/*
+ * coalesce - Merge free block bp, which was just freed and is not on any
+ *     list, with any free neighbors.  Returns the merged block, which is
+ *     also not on any list.  The merged block was last in use when the
+ *     biggest of its parts with resident pages was, so a big idle block
+ *     that small requests are carved from still ages.  Only parts of at
+ *     least release_min bytes have a free time; a smaller part's word there
+ *     is stale payload.
+ */
+static char *coalesce(char *bp)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+  int prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+  char *next = NEXT_BLKP(bp);
+  size_t biggest = size;
+  uint32_t freed_at = free_clock;
+
+  if (!GET_ALLOC(HDRP(next))) {
+    remove_free(next);
+    forget(next);
+    if (GET_SIZE(HDRP(next)) > biggest &&
+        GET_SIZE(HDRP(next)) >= release_min && FREED_AT(next) != 0) {
+      biggest = GET_SIZE(HDRP(next));
+      freed_at = FREED_AT(next);
+    }
+    size += GET_SIZE(HDRP(next));
+  }
+
+  if (!prev_alloc) {
+    forget(bp);
+    bp = PREV_BLKP(bp);
+    remove_free(bp);
+    if (GET_SIZE(HDRP(bp)) > biggest && GET_SIZE(HDRP(bp)) >= release_min &&
+        FREED_AT(bp) != 0)
+      freed_at = FREED_AT(bp);
+    size += GET_SIZE(HDRP(bp));
+    prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+  }
+
+  PUT(HDRP(bp), PACK(size, prev_alloc));
+  PUT(FTRP(bp), PACK(size, prev_alloc));
+  set_prev_alloc(NEXT_BLKP(bp), 0);
+  if (size >= release_min)
+    SET_FREED_AT(bp, freed_at);
+  return bp;
+}
+
+/*
+ * extend_heap - Grow the heap by size bytes (a multiple of DSIZE) and return
+ *     the new free block, coalesced with a free block that was at the end of
+ *     the heap.  The block is not on any list.  Returns NULL if out of memory.
+ */
+static char *extend_heap(size_t size)
+{
+  char *bp;
+  int prev_alloc;
+
+  if ((bp = mem_sbrk(size)) == (void *)-1)
+    return NULL;
+
+  /* The old epilogue header becomes the new block's header. */
+  prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+  PUT(HDRP(bp), PACK(size, prev_alloc));
+  PUT(FTRP(bp), PACK(size, prev_alloc));
+  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC_BIT));
+
+  return coalesce(bp);
+}
 
 /*
- * mm_check - This checks our invariant that the size_t header before every
- * block points to either the beginning of the next block, or the end of the
- * heap.
+ * grow_heap - Grow the heap so that it ends in a free block of at least
+ *     asize bytes, extending it by only what a free block already at the end
+ *     doesn't cover, if anything.  Returns that block, which is not on any list, or NULL
+ *     if out of memory.
+ */
+static char *grow_heap(size_t asize)
+{
+  char *epilogue = (char *)mem_heap_hi() + 1 - WSIZE;
+  size_t extend = asize;
+
+  if (!GET_PREV_ALLOC(epilogue)) {
+    size_t size = GET_SIZE(epilogue - WSIZE);
+    if (size >= asize) {
+      char *bp = epilogue + WSIZE - size;
+      remove_free(bp);
+      return bp;
+    }
+    extend -= size;
+  }
+  return extend_heap(extend);
+}
+
+/*
+ * find_fit - Find a free block of at least asize bytes, or return NULL.
+ *     First fit within a class, refined by a bounded best-fit scan.
+ */
+static char *find_fit(size_t asize)
+{
+  int c;
+
+  for (c = size_class(asize); c < NUM_CLASSES; c++) {
+    char *best = NULL;
+    size_t best_size = 0;
+    int extra = 0;
+    char *bp;
+
+    for (bp = BLOCK_AT(class_heads[c]); bp != NULL;
+         bp = BLOCK_AT(NEXT_FREE(bp))) {
+      size_t size = GET_SIZE(HDRP(bp));
+      if (size >= asize && (best == NULL || size < best_size)) {
+        best = bp;
+        best_size = size;
+        if (size == asize)
+          break;
+      }
+      if (best != NULL && extra++ >= BESTFIT_SCAN)
+        break;
+    }
+
+    if (best != NULL)
+      return best;
+  }
+
+  return NULL;
+}
+
+/*
+ * place - Allocate asize bytes at the start of free block bp, which is not
+ *     on any list, splitting off the rest as a new free block if it is big
+ *     enough to stand on its own.
+ */
+static void place(char *bp, size_t asize)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+  int prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+
+  if (size - asize >= MIN_BLOCK) {
+    char *rest;
+
+    PUT(HDRP(bp), PACK(asize, prev_alloc | ALLOC_BIT));
+    rest = NEXT_BLKP(bp);
+    PUT(HDRP(rest), PACK(size - asize, PREV_ALLOC_BIT));
+    PUT(FTRP(rest), PACK(size - asize, PREV_ALLOC_BIT));
+    if (size - asize >= release_min)
+      SET_FREED_AT(rest, FREED_AT(bp));
+    insert_free(rest);
+  } else {
+    PUT(HDRP(bp), PACK(size, prev_alloc | ALLOC_BIT));
+    set_prev_alloc(NEXT_BLKP(bp), 1);
+  }
+}
+
+/*
+ * shrink - Cut allocated block bp down to asize bytes, freeing the tail if it
+ *     is big enough to stand on its own.  The tail is coalesced with a free
+ *     block after it.
+ */
+static void shrink(char *bp, size_t asize)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+  char *rest;
+
+  if (size - asize < MIN_BLOCK)
+    return;
+
+  PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | ALLOC_BIT));
+  rest = NEXT_BLKP(bp);
+  PUT(HDRP(rest), PACK(size - asize, PREV_ALLOC_BIT));
+  PUT(FTRP(rest), PACK(size - asize, PREV_ALLOC_BIT));
+  insert_free(coalesce(rest));
+}
+
+/*
+ * slab_class - Map a request of 1 to SLAB_MAX bytes to its slab size class:
+ *     8-byte steps up to 64 bytes, then 16-, 32- and 64-byte steps up to
+ *     128, 256 and 512 bytes.
+ */
+static int slab_class(size_t size)
+{
+  if (size <= 64)
+    return (size + 7) / 8 - 1;
+  if (size <= 128)
+    return 8 + (size - 65) / 16;
+  if (size <= 256)
+    return 12 + (size - 129) / 32;
+  return 16 + (size - 257) / 64;
+}
+
+/*
+ * slab_obj_size - The object size of slab size class cls.
+ */
+static size_t slab_obj_size(int cls)
+{
+  if (cls < 8)
+    return (cls + 1) * 8;
+  if (cls < 12)
+    return 64 + (cls - 7) * 16;
+  if (cls < 16)
+    return 128 + (cls - 11) * 32;
+  return 256 + (cls - 15) * 64;
+}
+
+/*
+ * in_slab - Is ptr an object in a slab, rather than a general block?
+ */
+static int in_slab(void *ptr)
+{
+  size_t index = PAGE_INDEX(ptr);
+  return index < slab_map_pages && (slab_map[index >> 3] >> (index & 7)) & 1;
+}
+
+/*
+ * slab_map_cover - Make sure the slab map has a bit for page index.
+ *     Returns -1 if out of memory.
+ */
+static int slab_map_cover(size_t index)
+{
+  size_t pages = slab_map_pages ? slab_map_pages : 256;
+  uint8_t *map;
+
+  while (pages <= index)
+    pages *= 2;
+  if (pages == slab_map_pages)
+    return 0;
+
+  if ((map = block_malloc(pages / 8)) == NULL)
+    return -1;
+  memset(map, 0, pages / 8);
+  if (slab_map != NULL) {
+    memcpy(map, slab_map, slab_map_pages / 8);
+    block_free((char *)slab_map);
+  }
+  slab_map = map;
+  slab_map_pages = pages;
+  return 0;
+}
+
+/*
+ * slab_push - Put slab on the front of its class's list.
+ */
+static void slab_push(slab_t *slab)
+{
+  uint32_t head = slab_heads[slab->cls];
+
+  slab->next = head;
+  slab->prev = 0;
+  if (head)
+    ((slab_t *)BLOCK_AT(head))->prev = OFFSET(slab);
+  slab_heads[slab->cls] = OFFSET(slab);
+}
+
+/*
+ * slab_unlink - Take slab off its class's list.
+ */
+static void slab_unlink(slab_t *slab)
+{
+  if (slab->prev)
+    ((slab_t *)BLOCK_AT(slab->prev))->next = slab->next;
+  else
+    slab_heads[slab->cls] = slab->next;
+  if (slab->next)
+    ((slab_t *)BLOCK_AT(slab->next))->prev = slab->prev;
+}
+
+/*
+ * slab_new - Carve an empty slab for class cls out of the general allocator
+ *     and put it on the class's list.  Returns NULL if out of memory.
+ */
+static slab_t *slab_new(int cls)
+{
+  slab_t *slab;
+  size_t index, nobjs, i;
+
+  if ((slab = block_malloc_aligned(SLAB_BYTES, SLAB_SIZE)) == NULL)
+    return NULL;
+  index = PAGE_INDEX(slab);
+  if (slab_map_cover(index) < 0) {
+    block_free((char *)slab);
+    return NULL;
+  }
+  slab_map[index >> 3] |= 1 << (index & 7);
+
+  slab->obj_size = slab_obj_size(cls);
+  slab->nobjs = nobjs = (SLAB_BYTES - sizeof(slab_t)) / slab->obj_size;
+  slab->nfree = nobjs;
+  slab->cls = cls;
+  memset(slab->free_map, 0, sizeof(slab->free_map));
+  for (i = 0; i < nobjs / 64; i++)
+    slab->free_map[i] = ~(uint64_t)0;
+  if (nobjs % 64)
+    slab->free_map[i] = ((uint64_t)1 << (nobjs % 64)) - 1;
+
+  slab_push(slab);
+  return slab;
+}
+
+/*
+ * slab_malloc - Allocate an object of slab size class cls: the lowest free
+ *     object in the first slab on the class's list.
+ */
+static void *slab_malloc(int cls)
+{
+  slab_t *slab;
+  int w, bit;
+
+  if (slab_heads[cls])
+    slab = (slab_t *)BLOCK_AT(slab_heads[cls]);
+  else if ((slab = slab_new(cls)) == NULL)
+    return NULL;
+
+  for (w = 0; slab->free_map[w] == 0; w++)
+    ;
+  bit = __builtin_ctzll(slab->free_map[w]);
+  slab->free_map[w] &= slab->free_map[w] - 1;
+
+  if (--slab->nfree == 0)
+    slab_unlink(slab);
+  touch((char *)slab);
+  return SLAB_OBJS(slab) + (size_t)(w * 64 + bit) * slab->obj_size;
+}
+
+/*
+ * slab_free - Free a slab object.  A slab that becomes empty goes back to the
+ *     general allocator, unless it is the only one its class has left.
+ */
+static void slab_free(void *ptr)
+{
+  slab_t *slab = SLAB_OF(ptr);
+  size_t i = ((char *)ptr - SLAB_OBJS(slab)) / slab->obj_size;
+  size_t index;
+
+  slab->free_map[i / 64] |= (uint64_t)1 << (i % 64);
+  if (slab->nfree++ == 0)
+    slab_push(slab);
+  touch((char *)slab);
+
+  if (slab->nfree == slab->nobjs && (slab->prev || slab->next)) {
+    slab_unlink(slab);
+    index = PAGE_INDEX(slab);
+    slab_map[index >> 3] &= ~(1 << (index & 7));
+    block_free((char *)slab);
+  }
+}
+
+/*
+ * mm_check_incremental - Make mm_check look only at the blocks touched since
+ *     the last check, walking the whole heap about every full_every checks,
+ *     at random so the walks don't fall into step with a trace.  0 goes back
+ *     to walking the whole heap every time.  The first check after mm_init
+ *     is always a full walk.
+ */
+void mm_check_incremental(int full_every)
+{
+  check_every = (full_every > 0) ? full_every : 0;
+  check_left = 0;
+  num_touched = TOUCH_MAX + 1;
+}
+
+/*
+ * mm_check - Check the heap and free lists for consistency.  Returns 0 if
+ *     everything checks out, and -1 after printing what went wrong if not.
  */
 int mm_check(void)
 {
-  char *p;
-  char *lo = (char*)mem_heap_lo();
-  char *hi = (char*)mem_heap_hi() + 1;
-  size_t size = 0;
+  int result;
 
-  p = lo;
-  while (lo <= p && p < hi) {
-    size = ALIGN(*(size_t*)p + SIZE_T_SIZE);
-    p += size;
+  if (check_every > 0 && num_touched <= TOUCH_MAX && --check_left > 0) {
+    result = check_touched();
+  } else {
+    result = check_all();
+    if (check_every > 0) {
+      check_seed ^= check_seed << 13;
+      check_seed ^= check_seed >> 17;
+      check_seed ^= check_seed << 5;
+      check_left = 1 + check_seed % (2 * check_every);
+    }
+  }
+  num_touched = 0;
+  return result;
+}
+
+/*
+ * touch - Remember that the last operation left block bp behind, for the
+ *     next incremental check.
+ */
+static void touch(char *bp)
+{
+  if (check_every == 0 || num_touched > TOUCH_MAX)
+    return;
+  if (num_touched < TOUCH_MAX)
+    touched[num_touched] = bp;
+  num_touched++;
+}
+
+/*
+ * forget - Block bp was merged into another, so its header means nothing
+ *     any more; stop remembering it.
+ */
+static void forget(char *bp)
+{
+  int i;
+
+  if (check_every == 0 || num_touched > TOUCH_MAX)
+    return;
+  for (i = 0; i < num_touched; i++) {
+    if (touched[i] == bp)
+      touched[i--] = touched[--num_touched];
+  }
+}
+
+/*
+ * check_touched - Check each touched block, the blocks on either side of it,
+ *     and its slab if it is one.  Returns 0 or -1 like mm_check.
+ */
+static int check_touched(void)
+{
+  int i;
+
+  for (i = 0; i < num_touched; i++) {
+    char *bp = touched[i];
+    char *next;
+
+    if (check_block(bp) < 0)
+      return -1;
+    if (!GET_PREV_ALLOC(HDRP(bp)) && check_block(PREV_BLKP(bp)) < 0)
+      return -1;
+    next = NEXT_BLKP(bp);
+    if (GET_SIZE(HDRP(next)) > 0 && check_block(next) < 0)
+      return -1;
+    if (GET_ALLOC(HDRP(bp)) && in_slab(bp) && check_slab((slab_t *)bp) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+/*
+ * check_block - Check the heap invariants that involve block bp alone, or
+ *     bp and the blocks next to it, and if bp is free, that its neighbors
+ *     on its free list link back to it.  Returns 0 or -1 like mm_check.
+ */
+static int check_block(char *bp)
+{
+  char *first = heap_base + HEADS_SIZE + 2 * DSIZE;
+  char *hi = (char *)mem_heap_hi() + 1;
+  size_t size;
+  char *next;
+  int c;
+
+  if (bp < first || bp >= hi || (uintptr_t)bp % ALIGNMENT != 0) {
+    printf("mm_check: block %p is not aligned inside the heap\n", bp);
+    return -1;
+  }
+  size = GET_SIZE(HDRP(bp));
+  if (size < MIN_BLOCK || bp + size > hi) {
+    printf("mm_check: block %p has bad size %lu\n", bp, (unsigned long)size);
+    return -1;
   }
 
-  if (p != hi) {
-    printf("Bad headers did not end at heap_hi!\n");
-    printf("heap_lo: %p, heap_hi: %p, size: %lu, p: %p\n", lo, hi, size, p);
+  next = NEXT_BLKP(bp);
+  if (!GET_PREV_ALLOC(HDRP(next)) != !GET_ALLOC(HDRP(bp))) {
+    printf("mm_check: block %p has the wrong prev-allocated bit\n", next);
+    return -1;
+  }
+  if (GET_SIZE(HDRP(next)) == 0 && next != hi) {
+    printf("mm_check: bad epilogue at %p, heap ends at %p\n", next, hi);
     return -1;
   }
+  if (!GET_PREV_ALLOC(HDRP(bp))) {
+    char *prev = PREV_BLKP(bp);
+    if (prev < first || GET_ALLOC(HDRP(prev)) || NEXT_BLKP(prev) != bp) {
+      printf("mm_check: block %p has the wrong prev-allocated bit\n", bp);
+      return -1;
+    }
+  }
+  if (GET_ALLOC(HDRP(bp)))
+    return 0;
 
+  if (GET(HDRP(bp)) != GET(FTRP(bp))) {
+    printf("mm_check: free block %p header and footer differ\n", bp);
+    return -1;
+  }
+  if (!GET_PREV_ALLOC(HDRP(bp)) || !GET_ALLOC(HDRP(next))) {
+    printf("mm_check: free blocks around %p escaped coalescing\n", bp);
+    return -1;
+  }
+
+  c = size_class(size);
+  if (PREV_FREE(bp) == 0 ? class_heads[c] != OFFSET(bp) :
+      (BLOCK_AT(PREV_FREE(bp)) < first || BLOCK_AT(PREV_FREE(bp)) >= hi ||
+       NEXT_FREE(BLOCK_AT(PREV_FREE(bp))) != OFFSET(bp))) {
+    printf("mm_check: free block %p is not linked from list %d\n", bp, c);
+    return -1;
+  }
+  if (NEXT_FREE(bp) != 0 &&
+      (BLOCK_AT(NEXT_FREE(bp)) < first || BLOCK_AT(NEXT_FREE(bp)) >= hi ||
+       PREV_FREE(BLOCK_AT(NEXT_FREE(bp))) != OFFSET(bp) ||
+       size_class(GET_SIZE(HDRP(BLOCK_AT(NEXT_FREE(bp))))) != c)) {
+    printf("mm_check: list %d entry %p has a bad next link\n", c, bp);
+    return -1;
+  }
   return 0;
 }
 
 /*
- * mm_init - Initialize the malloc package.  Called once before any other
- * calls are made.  Since this is a very simple implementation, we just
- * return success.
+ * check_all - Check the whole heap and every list.
+ *
+ *     Heap invariants: the prologue and epilogue are intact; every block is
+ *     aligned, at least MIN_BLOCK bytes, and inside the heap; free blocks'
+ *     footers match their headers; every header's previous-allocated bit
+ *     matches the block before it; no two free blocks are adjacent; and the
+ *     walk ends exactly at the end of the heap.
+ *
+ *     List invariants: every list entry is a free block inside the heap, in
+ *     the list for its size, with a back link to the entry before it; and the
+ *     lists together hold exactly the free blocks found by the heap walk.
+ *
+ *     Slab invariants are checked by check_slabs.
  */
-int mm_init(void)
+static int check_all(void)
 {
+  char *lo = (char *)mem_heap_lo();
+  char *hi = (char *)mem_heap_hi() + 1;
+  char *bp;
+  int prev_alloc = 1;
+  long heap_free = 0, list_free = 0;
+  int c;
+
+  /* Prologue: an allocated 8-byte block right after the list heads. */
+  bp = heap_base + HEADS_SIZE + DSIZE;
+  if (GET_SIZE(HDRP(bp)) != DSIZE || !GET_ALLOC(HDRP(bp)) ||
+      GET(HDRP(bp)) != GET(FTRP(bp))) {
+    printf("mm_check: bad prologue header\n");
+    return -1;
+  }
+
+  for (bp = NEXT_BLKP(bp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if ((uintptr_t)bp % ALIGNMENT != 0) {
+      printf("mm_check: block %p is not aligned\n", bp);
+      return -1;
+    }
+    if (size < MIN_BLOCK || bp + size > hi) {
+      printf("mm_check: block %p has bad size %lu\n", bp, (unsigned long)size);
+      return -1;
+    }
+    if (!GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc) {
+      printf("mm_check: block %p has the wrong prev-allocated bit\n", bp);
+      return -1;
+    }
+    if (!GET_ALLOC(HDRP(bp))) {
+      if (GET(HDRP(bp)) != GET(FTRP(bp))) {
+        printf("mm_check: free block %p header and footer differ\n", bp);
+        return -1;
+      }
+      if (!prev_alloc) {
+        printf("mm_check: free blocks before %p escaped coalescing\n", bp);
+        return -1;
+      }
+      heap_free++;
+    }
+    prev_alloc = GET_ALLOC(HDRP(bp));
+  }
+
+  /* Epilogue: a zero-size allocated header in the last word of the heap. */
+  if (bp != hi || !GET_ALLOC(HDRP(bp)) ||
+      !GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc) {
+    printf("mm_check: bad epilogue at %p, heap ends at %p\n", bp, hi);
+    return -1;
+  }
+
+  for (c = 0; c < NUM_CLASSES; c++) {
+    uint32_t prev = 0;
+    for (bp = BLOCK_AT(class_heads[c]); bp != NULL;
+         bp = BLOCK_AT(NEXT_FREE(bp))) {
+      if (bp < lo || bp >= hi) {
+        printf("mm_check: list %d entry %p is outside the heap\n", c, bp);
+        return -1;
+      }
+      if (GET_ALLOC(HDRP(bp))) {
+        printf("mm_check: list %d entry %p is allocated\n", c, bp);
+        return -1;
+      }
+      if (size_class(GET_SIZE(HDRP(bp))) != c) {
+        printf("mm_check: list %d entry %p belongs in another list\n", c, bp);
+        return -1;
+      }
+      if (PREV_FREE(bp) != prev) {
+        printf("mm_check: list %d entry %p has a bad back link\n", c, bp);
+        return -1;
+      }
+      /* More entries than free blocks means the list has a cycle. */
+      if (++list_free > heap_free) {
+        printf("mm_check: free lists hold more blocks than the heap\n");
+        return -1;
+      }
+      prev = OFFSET(bp);
+    }
+  }
+
+  if (list_free != heap_free) {
+    printf("mm_check: %ld free blocks in the heap, but %ld on lists\n",
+           heap_free, list_free);
+    return -1;
+  }
+
+  return check_slabs();
+}
+
+/*
+ * check_slabs - Check that every page in the slab map is the payload of an
+ *     allocated block, and that every slab on a class list is in the map,
+ *     belongs to that class, has a back link to the slab before it, and has
+ *     as many bits set in its bitmap as it claims free objects, between one
+ *     and all of them.  Returns 0 or -1 like mm_check.
+ */
+static int check_slabs(void)
+{
+  size_t index, pages = 0, listed = 0;
+  int cls, w;
+
+  for (index = 0; index < slab_map_pages; index++) {
+    char *page;
+    if (!((slab_map[index >> 3] >> (index & 7)) & 1))
+      continue;
+    page = (char *)((((uintptr_t)heap_base >> SLAB_SHIFT) + index)
+                    << SLAB_SHIFT);
+    if (!GET_ALLOC(HDRP(page)) || GET_SIZE(HDRP(page)) != SLAB_SIZE) {
+      printf("mm_check: slab %p is not an allocated block\n", page);
+      return -1;
+    }
+    pages++;
+  }
+
+  for (cls = 0; cls < NUM_SLAB_CLASSES; cls++) {
+    uint32_t prev = 0;
+    slab_t *slab;
+    for (slab = (slab_t *)BLOCK_AT(slab_heads[cls]); slab != NULL;
+         slab = (slab_t *)BLOCK_AT(slab->next)) {
+      int nfree = 0;
+      if (!in_slab(slab) || SLAB_OF(slab) != slab) {
+        printf("mm_check: slab list %d entry %p is not a slab\n", cls, slab);
+        return -1;
+      }
+      if (slab->cls != cls || slab->obj_size != slab_obj_size(cls)) {
+        printf("mm_check: slab %p is on the wrong list\n", slab);
+        return -1;
+      }
+      if (slab->prev != prev) {
+        printf("mm_check: slab %p has a bad back link\n", slab);
+        return -1;
+      }
+      for (w = 0; w < SLAB_MAP_WORDS; w++)
+        nfree += __builtin_popcountll(slab->free_map[w]);
+      if (nfree != slab->nfree || nfree == 0 || nfree > slab->nobjs) {
+        printf("mm_check: slab %p has %d free objects, but claims %d\n",
+               slab, nfree, slab->nfree);
+        return -1;
+      }
+      /* More listed slabs than slab pages means a list has a cycle. */
+      if (++listed > pages) {
+        printf("mm_check: slab lists hold more slabs than the map\n");
+        return -1;
+      }
+      prev = OFFSET(slab);
+    }
+  }
+
   return 0;
 }
 
 /*
- * mm_malloc - Allocate a block by incrementing the brk pointer.
- *     Always allocate a block whose size is a multiple of the alignment.
+ * check_slab - Check one slab on its own: it is an allocated block in the
+ *     slab map, its size class and object size agree, its bitmap has as many
+ *     bits set as it claims free objects, and if it has any, its neighbors
+ *     on its class list link back to it.  Returns 0 or -1 like mm_check.
  */
-void *mm_malloc(size_t size)
+static int check_slab(slab_t *slab)
+{
+  int nfree = 0, w;
+
+  if (SLAB_OF(slab) != slab || GET_SIZE(HDRP(slab)) != SLAB_SIZE) {
+    printf("mm_check: slab %p is not an allocated block\n", slab);
+    return -1;
+  }
+  if (slab->cls >= NUM_SLAB_CLASSES ||
+      slab->obj_size != slab_obj_size(slab->cls)) {
+    printf("mm_check: slab %p has a bad size class\n", slab);
+    return -1;
+  }
+  for (w = 0; w < SLAB_MAP_WORDS; w++)
+    nfree += __builtin_popcountll(slab->free_map[w]);
+  if (nfree != slab->nfree || nfree > slab->nobjs) {
+    printf("mm_check: slab %p has %d free objects, but claims %d\n",
+           slab, nfree, slab->nfree);
+    return -1;
+  }
+  if (nfree == 0)
+    return 0;
+
+  if (slab->prev ? ((slab_t *)BLOCK_AT(slab->prev))->next != OFFSET(slab) :
+      slab_heads[slab->cls] != OFFSET(slab)) {
+    printf("mm_check: slab %p is not linked from list %d\n", slab, slab->cls);
+    return -1;
+  }
+  if (slab->next && ((slab_t *)BLOCK_AT(slab->next))->prev != OFFSET(slab)) {
+    printf("mm_check: slab %p has a bad next link\n", slab);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * mm_init - Initialize the malloc package: lay down the list heads, the
+ *     prologue and the epilogue in an empty heap, and forget any slabs.
+ */
+int mm_init(void)
 {
-  /* We allocate a little bit of extra memory so that we can store the
-     size of the block we've allocated.  Take a look at mm_realloc to see
-     one example of a place where this can come in handy. */
-  int aligned_size = ALIGN(size + SIZE_T_SIZE);
+  char *p;
+
+  if ((p = mem_sbrk(HEADS_SIZE + 2 * DSIZE)) == (void *)-1)
+    return -1;
+
+  heap_base = p;
+  class_heads = (uint32_t *)p;
+  slab_heads = class_heads + NUM_CLASSES;
+  memset(class_heads, 0, HEADS_SIZE);
+  slab_map = NULL;
+  slab_map_pages = 0;
+  free_clock = 1;
+  num_touched = TOUCH_MAX + 1;
+  release_min = RELEASE_THRESHOLD;
+  trim_min = TRIM_THRESHOLD;
+  if (release_min < 2 * mem_pagesize())
+    release_min = 2 * mem_pagesize();
+  if (trim_min < 2 * mem_pagesize())
+    trim_min = 2 * mem_pagesize();
+
+  p += HEADS_SIZE;
+  PUT(p, 0);                                                 /* padding */
+  PUT(p + WSIZE, PACK(DSIZE, PREV_ALLOC_BIT | ALLOC_BIT));   /* prologue */
+  PUT(p + 2 * WSIZE, PACK(DSIZE, PREV_ALLOC_BIT | ALLOC_BIT));
+  PUT(p + 3 * WSIZE, PACK(0, PREV_ALLOC_BIT | ALLOC_BIT));   /* epilogue */
 
-  /* Expands the heap by the given number of bytes and returns a pointer to
-     the newly-allocated area.  This is a slow call, so you will want to
-     make sure you don't wind up calling it on every malloc. */
-  void *p = mem_sbrk(aligned_size);
+  return 0;
+}
+
+/*
+ * block_malloc - Allocate a block from the general allocator with at least
+ *     size bytes of payload.
+ */
+static void *block_malloc(size_t size)
+{
+  size_t asize = adjust_size(size);
+  char *bp;
 
-  if (p == (void *)-1) {
-    /* Whoops, an error of some sort occurred.  We return NULL to let
-       the client code know that we weren't able to allocate memory. */
+  if ((bp = find_fit(asize)) != NULL) {
+    remove_free(bp);
+  } else if ((bp = grow_heap(asize)) == NULL) {
     return NULL;
+  }
+
+  place(bp, asize);
+  touch(bp);
+  return bp;
+}
+
+/*
+ * block_malloc_aligned - Allocate a block from the general allocator whose
+ *     payload holds size bytes and starts at a multiple of align, a power of
+ *     two.  The free space skipped to reach the alignment is split off as a
+ *     block of its own.
+ */
+static void *block_malloc_aligned(size_t size, size_t align)
+{
+  size_t asize = adjust_size(size);
+  char *bp, *p;
+  size_t front;
+
+  if ((bp = find_fit(asize + align + MIN_BLOCK)) != NULL) {
+    remove_free(bp);
   } else {
-    /* We store the size of the block we've allocated in the first
-       SIZE_T_SIZE bytes. */
-    *(size_t*)p = size;
+    /* Grow the heap by exactly enough to fit an aligned block after the
+     * free block at the end, or after the last block. */
+    char *epilogue = (char *)mem_heap_hi() + 1 - WSIZE;
+    bp = epilogue + WSIZE;
+    if (!GET_PREV_ALLOC(epilogue))
+      bp -= GET_SIZE(epilogue - WSIZE);
+    p = align_up(bp, align);
+    if ((bp = grow_heap(p - bp + asize)) == NULL)
+      return NULL;
+  }
+
+  p = align_up(bp, align);
+  front = p - bp;
+  if (front > 0) {
+    size_t size_rest = GET_SIZE(HDRP(bp)) - front;
+    uint32_t freed_at = FREED_AT(bp);
+    PUT(HDRP(bp), PACK(front, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), GET(HDRP(bp)));
+    insert_free(bp);
+    PUT(HDRP(p), PACK(size_rest, 0));
+    if (size_rest >= release_min)
+      SET_FREED_AT(p, freed_at);
+  }
 
-    /* Then, we return a pointer to the rest of the block of memory,
-       which is at least size bytes long.  We have to cast to uint8_t
-       before we try any pointer arithmetic because voids have no size
-       and so the compiler doesn't know how far to move the pointer.
-       Since a uint8_t is always one byte, adding SIZE_T_SIZE after
-       casting advances the pointer by SIZE_T_SIZE bytes. */
-    return (void *)((char *)p + SIZE_T_SIZE);
+  place(p, asize);
+  touch(p);
+  return p;
+}
+
+/*
+ * align_up - The first payload address at or after bp that is a multiple of
+ *     align and leaves either no space or room for a whole block before it.
+ */
+static char *align_up(char *bp, size_t align)
+{
+  char *p = (char *)(((uintptr_t)bp + align - 1) & ~(uintptr_t)(align - 1));
+
+  if (p != bp && p - bp < MIN_BLOCK)
+    p += align;
+  return p;
+}
+
+/*
+ * block_free - Return a block to the general allocator, coalescing it with
+ *     its free neighbors.
+ */
+static void block_free(char *bp)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+
+  PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+  PUT(FTRP(bp), GET(HDRP(bp)));
+  bp = coalesce(bp);
+  insert_free(bp);
+  touch(bp);
+
+  if (++free_clock % PURGE_INTERVAL == 0)
+    purge();
+}
+
+/*
+ * purge - Give free memory that has been idle since the last pass back to
+ *     the system.  A block ending the heap is cut off, its header becoming
+ *     the new epilogue; any other keeps its header, links, free clock
+ *     reading and footer, and the whole pages between are released.
+ */
+static void purge(void)
+{
+  char *epilogue = (char *)mem_heap_hi() + 1 - WSIZE;
+  char *bp;
+  int c;
+
+  num_touched = TOUCH_MAX + 1;
+  if (!GET_PREV_ALLOC(epilogue)) {
+    size_t size = GET_SIZE(epilogue - WSIZE);
+    bp = epilogue + WSIZE - size;
+    if (size >= trim_min &&
+        free_clock - FREED_AT(bp) >= PURGE_INTERVAL) {
+      remove_free(bp);
+      PUT(HDRP(bp), PACK(0, GET_PREV_ALLOC(HDRP(bp)) | ALLOC_BIT));
+      mem_sbrk(-(int)size);
+    }
+  }
+
+  for (c = size_class(release_min); c < NUM_CLASSES; c++) {
+    for (bp = BLOCK_AT(class_heads[c]); bp != NULL;
+         bp = BLOCK_AT(NEXT_FREE(bp))) {
+      if (GET_SIZE(HDRP(bp)) >= release_min && FREED_AT(bp) != 0 &&
+          free_clock - FREED_AT(bp) >= PURGE_INTERVAL) {
+        mem_release(bp + DSIZE + WSIZE, FTRP(bp));
+        SET_FREED_AT(bp, 0);
+      }
+    }
   }
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * mm_malloc - Allocate a block with at least size bytes of payload: small
+ *     requests from a slab, the rest from the general allocator.
+ */
+void *mm_malloc(size_t size)
+{
+  if (size == 0)
+    return NULL;
+  if (size <= SLAB_MAX)
+    return slab_malloc(slab_class(size));
+  return block_malloc(size);
+}
+
+/*
+ * mm_memalign - Allocate a block with at least size bytes of payload that
+ *     starts at a multiple of alignment, a power of two.  Aligned blocks
+ *     always come from the general allocator.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+  if (size == 0 || (alignment & (alignment - 1)) != 0)
+    return NULL;
+  if (alignment <= ALIGNMENT)
+    return mm_malloc(size);
+  return block_malloc_aligned(size, alignment);
+}
+
+/*
+ * mm_free - Free a block, returning it to its slab or to the free lists.
  */
 void mm_free(void *ptr)
 {
+  if (ptr == NULL)
+    return;
+  if (in_slab(ptr))
+    slab_free(ptr);
+  else
+    block_free(ptr);
+}
+
+/*
+ * mm_usable_size - How many bytes of payload the block at ptr holds, which
+ *     may be more than were asked for.
+ */
+size_t mm_usable_size(void *ptr)
+{
+  if (ptr == NULL)
+    return 0;
+  if (in_slab(ptr))
+    return SLAB_OF(ptr)->obj_size;
+  return GET_SIZE(HDRP(ptr)) - WSIZE;
+}
+
+/*
+ * mm_calloc - Allocate a zeroed array of nmemb elements of size bytes.
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+  void *ptr;
+
+  if (size != 0 && nmemb > (size_t)-1 / size)
+    return NULL;
+  if ((ptr = mm_malloc(nmemb * size)) != NULL)
+    memset(ptr, 0, nmemb * size);
+  return ptr;
 }
 
 /*
- * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
+ * mm_free_sized - Free a block the caller knows was last sized size bytes.
+ *     Slab objects never outgrow SLAB_MAX, since realloc moves them out
+ *     first, so larger blocks skip the slab map lookup.
+ */
+void mm_free_sized(void *ptr, size_t size)
+{
+  if (ptr == NULL)
+    return;
+  if (size > SLAB_MAX)
+    block_free(ptr);
+  else
+    mm_free(ptr);
+}
+
+/*
+ * mm_realloc - Resize a block in place whenever possible: shrink it by
+ *     splitting off the tail, grow it into a free block right after it, or
+ *     grow the heap under it when it is the last block.  Only when none of
+ *     those work is the payload copied to a new block.  Slab objects are
+ *     moved unless the new size falls in the same slab class.
  */
 void *mm_realloc(void *ptr, size_t size)
 {
+  char *bp = ptr;
+  char *next;
+  size_t asize, size_avail;
   void *newptr;
   size_t copy_size;
 
-  /* Allocate a new chunk of memory, and fail if that allocation fails. */
-  newptr = mm_malloc(size);
-  if (NULL == newptr)
+  if (ptr == NULL)
+    return mm_malloc(size);
+  if (size == 0) {
+    mm_free(ptr);
     return NULL;
+  }
+
+  /* A slab object stays put while the new size is in the same class. */
+  if (in_slab(ptr)) {
+    slab_t *slab = SLAB_OF(ptr);
+    if (size <= SLAB_MAX && slab_class(size) == slab->cls)
+      return ptr;
+    if ((newptr = mm_malloc(size)) == NULL)
+      return NULL;
+    memcpy(newptr, ptr, size < slab->obj_size ? size : slab->obj_size);
+    slab_free(ptr);
+    return newptr;
+  }
+
+  asize = adjust_size(size);
+  size_avail = GET_SIZE(HDRP(bp));
 
-  /* Get the size of the old block of memory.  Take a peek at mm_malloc(),
-     where we stashed this in the SIZE_T_SIZE bytes directly before the
-     address we returned.  Now we can back up by that many bytes and read
-     the size. */
-  copy_size = *(size_t*)((uint8_t*)ptr - SIZE_T_SIZE);
+  if (asize <= size_avail) {
+    shrink(bp, asize);
+    touch(bp);
+    return bp;
+  }
+
+  /* Absorb a free block that follows. */
+  next = NEXT_BLKP(bp);
+  if (!GET_ALLOC(HDRP(next))) {
+    size_avail += GET_SIZE(HDRP(next));
+    if (size_avail >= asize || GET_SIZE(HDRP(NEXT_BLKP(next))) == 0) {
+      remove_free(next);
+      forget(next);
+      PUT(HDRP(bp), PACK(size_avail, GET_PREV_ALLOC(HDRP(bp)) | ALLOC_BIT));
+      set_prev_alloc(NEXT_BLKP(bp), 1);
+      next = NEXT_BLKP(bp);
+    }
+  }
 
-  /* If the new block is smaller than the old one, we have to stop copying
-     early so that we don't write off the end of the new block of memory. */
-  if (size < copy_size)
-    copy_size = size;
+  /* The block now ends at the epilogue: grow the heap under it. */
+  if (GET_SIZE(HDRP(bp)) < asize && GET_SIZE(HDRP(next)) == 0) {
+    size_t extend = asize - GET_SIZE(HDRP(bp));
+    if (mem_sbrk(extend) == (void *)-1)
+      return NULL;
+    PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | ALLOC_BIT));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, PREV_ALLOC_BIT | ALLOC_BIT));
+  }
+
+  if (GET_SIZE(HDRP(bp)) >= asize) {
+    shrink(bp, asize);
+    touch(bp);
+    return bp;
+  }
 
-  /* This is a standard library call that performs a simple memory copy. */
+  /* Last resort: copy the payload, which is the block minus its header, to
+   * a new block. */
+  newptr = mm_malloc(size);
+  if (NULL == newptr)
+    return NULL;
+
+  copy_size = GET_SIZE(HDRP(ptr)) - WSIZE;
   memcpy(newptr, ptr, copy_size);
 
-  /* Release the old block. */
   mm_free(ptr);
-
-  /* Return a pointer to the new block. */
   return newptr;
 }
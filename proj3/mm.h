@@ -4,9 +4,14 @@
 #include <unistd.h>
 
 int mm_check(void);
+void mm_check_incremental(int full_every);
 int mm_init(void);
 void *mm_malloc(size_t size);
 void mm_free(void *ptr);
 void *mm_realloc(void *ptr, size_t size);
+void *mm_memalign(size_t alignment, size_t size);
+void *mm_calloc(size_t nmemb, size_t size);
+void mm_free_sized(void *ptr, size_t size);
+size_t mm_usable_size(void *ptr);
 
 #endif /* MM_MM_H */
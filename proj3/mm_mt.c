@@ -0,0 +1,567 @@
+/*
+ * mm_mt.c - Thread-safe front end to the mm allocator, in the style of
+ * tcmalloc.
+ *
+ * Requests of up to MT_SMALL_MAX bytes are rounded to one of MT_CLASSES size
+ * classes and served from a per-thread cache: one singly linked free list per
+ * class, so the common malloc and free touch no shared state and take no
+ * lock.  An empty cache list is refilled with a batch of objects from the
+ * class's central list, and a cache list that grows past two batches gives a
+ * batch back, so each trip to a central list (and its lock) is paid for by
+ * many operations.  Each central list has its own lock.
+ *
+ * Central lists are stocked by carving spans: SPAN_SIZE-aligned,
+ * SPAN_SIZE-long blocks from the mm heap that hold objects of a single class
+ * back to back.  A byte per span-sized page of the simulated heap records
+ * which class a span belongs to, so free can tell a small object from a large
+ * block without a lock.  Each span also counts its objects that have been
+ * carved and are not on the central list.  When a span's count drops to zero
+ * and the central list holds at least two spans' worth of objects, the
+ * list is swept of every such span's objects and the spans go back to the
+ * mm heap.
+ *
+ * Larger requests go straight to mm_malloc, mm_free and mm_realloc under one
+ * heap lock.  mm_init wipes every thread's cache at once by bumping an epoch
+ * that each cache compares against on its next use.
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "memlib.h"
+#include "mm.h"
+#include "mm_mt.h"
+
+/* Largest request served from the thread caches. */
+#define MT_SMALL_MAX 1024
+
+/* Size classes: 8-byte steps up to 64 bytes, then four steps per doubling. */
+#define MT_CLASSES 24
+
+/* Spans are 64 KB.  A span block leaves the last double word of its page to
+ * the header of whatever block follows it, so spans can sit back to back. */
+#define SPAN_SHIFT 16
+#define SPAN_SIZE (1 << SPAN_SHIFT)
+#define SPAN_BYTES (SPAN_SIZE - 8)
+
+/* One map entry for every span-sized page the simulated heap can cover,
+ * plus one for a heap that doesn't start on a span boundary. */
+#define SPAN_MAP_SIZE (MAX_HEAP / SPAN_SIZE + 1)
+
+/* A batch moves about BATCH_BYTES between a cache and a central list, but
+ * never more than MAX_BATCH objects. */
+#define BATCH_BYTES 8192
+#define MAX_BATCH 32
+
+/* Free objects are linked through their first word. */
+#define NEXT(obj) (*(void **)(obj))
+
+/* A thread's cache of free objects. */
+typedef struct {
+  void *head[MT_CLASSES];       /* free objects of each class */
+  unsigned count[MT_CLASSES];   /* length of each list */
+  unsigned epoch;               /* value of epoch when the lists were valid */
+  int registered;               /* has the exit-time flush been set up? */
+} thread_cache_t;
+
+/* A class's shared free list, and the uncarved tail of its newest span.
+ * Aligned so that threads working on different classes don't share lines. */
+typedef struct {
+  pthread_mutex_t lock;
+  void *head;
+  size_t count;
+  char *bump;
+  char *bump_end;
+  int emptied;      /* has a span's count dropped to zero since the last sweep? */
+} __attribute__((aligned(64))) central_list_t;
+
+static __thread thread_cache_t cache;
+static central_list_t central[MT_CLASSES];
+static uint8_t span_class[SPAN_MAP_SIZE];   /* class + 1, or 0 if no span */
+static uint16_t span_live[SPAN_MAP_SIZE];   /* objects carved, not central */
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned epoch;
+
+/* Flushes a thread's cache to the central lists when the thread exits. */
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+/* Function prototypes for internal helpers */
+static int size_class(size_t size);
+static size_t class_size(int cls);
+static int batch_size(int cls);
+static size_t span_index(void *ptr);
+static int span_class_of(void *ptr);
+static void make_cache_key(void);
+static void flush_cache(void *arg);
+static thread_cache_t *get_cache(void);
+static int new_span(central_list_t *c, int cls);
+static int refill(thread_cache_t *tc, int cls);
+static void release(thread_cache_t *tc, int cls, int n);
+static void reclaim(central_list_t *c, int cls);
+static int check_list(void *head, size_t count, int cls, const char *what);
+
+/*
+ * size_class - Map a request of 1 to MT_SMALL_MAX bytes to its size class.
+ */
+static int size_class(size_t size)
+{
+  int cls = 8;
+  size_t step = 16;
+  size_t base = 64;
+
+  if (size <= 64)
+    return (size + 7) / 8 - 1;
+  while (size > base * 2) {
+    cls += 4;
+    base *= 2;
+    step *= 2;
+  }
+  return cls + (size - base - 1) / step;
+}
+
+/*
+ * class_size - The object size of size class cls.
+ */
+static size_t class_size(int cls)
+{
+  if (cls < 8)
+    return (cls + 1) * 8;
+  return ((size_t)64 << ((cls - 8) / 4)) / 4 * (4 + (cls - 8) % 4 + 1);
+}
+
+/*
+ * batch_size - How many objects of class cls move between a thread cache and
+ *     the central list at once.
+ */
+static int batch_size(int cls)
+{
+  int n = BATCH_BYTES / class_size(cls);
+  return (n < MAX_BATCH) ? n : MAX_BATCH;
+}
+
+/*
+ * span_index - The index in the span maps of the span-sized page holding ptr.
+ */
+static size_t span_index(void *ptr)
+{
+  return ((uintptr_t)ptr >> SPAN_SHIFT) -
+      ((uintptr_t)mem_heap_lo() >> SPAN_SHIFT);
+}
+
+/*
+ * span_class_of - The size class of the span holding ptr, or -1 if ptr is
+ *     not in a span.
+ */
+static int span_class_of(void *ptr)
+{
+  size_t index = span_index(ptr);
+
+  if (index >= SPAN_MAP_SIZE)
+    return -1;
+  return (int)__atomic_load_n(&span_class[index], __ATOMIC_ACQUIRE) - 1;
+}
+
+static void make_cache_key(void)
+{
+  pthread_key_create(&cache_key, &flush_cache);
+}
+
+/*
+ * flush_cache - Give every object in an exiting thread's cache back to the
+ *     central lists, unless the heap has been reset since it was filled.
+ */
+static void flush_cache(void *arg)
+{
+  thread_cache_t *tc = arg;
+  int cls;
+
+  if (tc->epoch != __atomic_load_n(&epoch, __ATOMIC_ACQUIRE))
+    return;
+  for (cls = 0; cls < MT_CLASSES; cls++) {
+    if (tc->count[cls] > 0)
+      release(tc, cls, tc->count[cls]);
+  }
+}
+
+/*
+ * get_cache - The calling thread's cache, emptied first if the heap has been
+ *     reset since the thread last used it.
+ */
+static thread_cache_t *get_cache(void)
+{
+  thread_cache_t *tc = &cache;
+  unsigned current = __atomic_load_n(&epoch, __ATOMIC_ACQUIRE);
+
+  if (tc->epoch != current) {
+    memset(tc->head, 0, sizeof(tc->head));
+    memset(tc->count, 0, sizeof(tc->count));
+    tc->epoch = current;
+    if (!tc->registered) {
+      pthread_once(&cache_key_once, &make_cache_key);
+      pthread_setspecific(cache_key, tc);
+      tc->registered = 1;
+    }
+  }
+  return tc;
+}
+
+/*
+ * new_span - Allocate a span for class cls and make it the class's bump
+ *     region.  Called with the class's lock held.  Returns -1 if out of
+ *     memory.
+ */
+static int new_span(central_list_t *c, int cls)
+{
+  char *span;
+  size_t index;
+
+  pthread_mutex_lock(&heap_lock);
+  span = mm_memalign(SPAN_SIZE, SPAN_BYTES);
+  pthread_mutex_unlock(&heap_lock);
+  if (span == NULL)
+    return -1;
+
+  /* The span being retired may already have all its objects back. */
+  if (c->bump != NULL && span_live[span_index(c->bump)] == 0)
+    c->emptied = 1;
+
+  index = span_index(span);
+  span_live[index] = 0;
+  __atomic_store_n(&span_class[index], cls + 1, __ATOMIC_RELEASE);
+  c->bump = span;
+  c->bump_end = span + SPAN_BYTES;
+  return 0;
+}
+
+/*
+ * refill - Move a batch of class cls objects into an empty cache list, from
+ *     the central list if it has them and from fresh spans if not.  Returns
+ *     how many objects were moved, which is 0 only if out of memory.
+ */
+static int refill(thread_cache_t *tc, int cls)
+{
+  central_list_t *c = &central[cls];
+  size_t obj_size = class_size(cls);
+  int want = batch_size(cls);
+  int got = 0;
+  void *head = NULL;
+  void *obj;
+
+  pthread_mutex_lock(&c->lock);
+  while (got < want && c->head != NULL) {
+    obj = c->head;
+    c->head = NEXT(obj);
+    NEXT(obj) = head;
+    head = obj;
+    span_live[span_index(obj)]++;
+    got++;
+  }
+  c->count -= got;
+
+  while (got < want) {
+    if (c->bump + obj_size > c->bump_end && new_span(c, cls) < 0)
+      break;
+    obj = c->bump;
+    c->bump += obj_size;
+    NEXT(obj) = head;
+    head = obj;
+    span_live[span_index(obj)]++;
+    got++;
+  }
+  pthread_mutex_unlock(&c->lock);
+
+  tc->head[cls] = head;
+  tc->count[cls] = got;
+  return got;
+}
+
+/*
+ * release - Move the first n objects of a cache list to the central list,
+ *     and sweep empty spans back to the mm heap if there are any and the
+ *     list has objects to spare.
+ */
+static void release(thread_cache_t *tc, int cls, int n)
+{
+  central_list_t *c = &central[cls];
+  void *first = tc->head[cls];
+  void *last = first;
+  int i;
+
+  pthread_mutex_lock(&c->lock);
+  for (i = 1; ; i++) {
+    if (--span_live[span_index(last)] == 0)
+      c->emptied = 1;
+    if (i == n)
+      break;
+    last = NEXT(last);
+  }
+  tc->head[cls] = NEXT(last);
+  tc->count[cls] -= n;
+
+  NEXT(last) = c->head;
+  c->head = first;
+  c->count += n;
+  if (c->emptied && c->count >= 2 * (SPAN_BYTES / class_size(cls)))
+    reclaim(c, cls);
+  pthread_mutex_unlock(&c->lock);
+}
+
+/*
+ * reclaim - Take the objects of every span of class cls with none carved
+ *     out off the central list, and free those spans.  The span being
+ *     carved stays.  Called with the class's lock held.
+ */
+static void reclaim(central_list_t *c, int cls)
+{
+  size_t bump = (c->bump != NULL) ? span_index(c->bump) : SPAN_MAP_SIZE;
+  size_t index;
+  void **link = &c->head;
+  void *obj;
+
+  /* First unlink the objects, whose links may run through the spans. */
+  while ((obj = *link) != NULL) {
+    index = span_index(obj);
+    if (span_live[index] == 0 && index != bump) {
+      *link = NEXT(obj);
+      c->count--;
+    } else {
+      link = &NEXT(obj);
+    }
+  }
+
+  for (index = 0; index < SPAN_MAP_SIZE; index++) {
+    if (span_class[index] != cls + 1 || span_live[index] != 0 ||
+        index == bump)
+      continue;
+    __atomic_store_n(&span_class[index], 0, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&heap_lock);
+    mm_free((char *)((((uintptr_t)mem_heap_lo() >> SPAN_SHIFT) + index)
+                     << SPAN_SHIFT));
+    pthread_mutex_unlock(&heap_lock);
+  }
+  c->emptied = 0;
+}
+
+/*
+ * check_list - Check that a free list holds count objects, each at an object
+ *     boundary in a span of class cls.  Returns 0, or -1 after printing what
+ *     went wrong.
+ */
+static int check_list(void *head, size_t count, int cls, const char *what)
+{
+  size_t obj_size = class_size(cls);
+  size_t n = 0;
+  void *obj;
+
+  for (obj = head; obj != NULL; obj = NEXT(obj)) {
+    uintptr_t offset = (uintptr_t)obj & (SPAN_SIZE - 1);
+    if (span_class_of(obj) != cls || offset % obj_size != 0 ||
+        offset + obj_size > SPAN_BYTES) {
+      printf("mm_mt_check: %s list %d holds a stray pointer %p\n",
+             what, cls, obj);
+      return -1;
+    }
+    if (++n > count)
+      break;
+  }
+
+  if (n != count) {
+    printf("mm_mt_check: %s list %d holds %lu objects, but claims %lu\n",
+           what, cls, (unsigned long)n, (unsigned long)count);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * mm_mt_check - Check the mm heap, every central list, and the calling
+ *     thread's cache.
+ */
+int mm_mt_check(void)
+{
+  thread_cache_t *tc = get_cache();
+  int cls;
+
+  if (mm_check() < 0)
+    return -1;
+
+  for (cls = 0; cls < MT_CLASSES; cls++) {
+    if (check_list(central[cls].head, central[cls].count, cls, "central") < 0)
+      return -1;
+    if (check_list(tc->head[cls], tc->count[cls], cls, "cache") < 0)
+      return -1;
+  }
+  return 0;
+}
+
+/*
+ * mm_mt_init - Initialize the mm heap and forget every span and cached
+ *     object.
+ */
+int mm_mt_init(void)
+{
+  int cls;
+
+  for (cls = 0; cls < MT_CLASSES; cls++) {
+    pthread_mutex_init(&central[cls].lock, NULL);
+    central[cls].head = NULL;
+    central[cls].count = 0;
+    central[cls].bump = NULL;
+    central[cls].bump_end = NULL;
+    central[cls].emptied = 0;
+  }
+  memset(span_class, 0, sizeof(span_class));
+  memset(span_live, 0, sizeof(span_live));
+  __atomic_add_fetch(&epoch, 1, __ATOMIC_RELEASE);
+
+  return mm_init();
+}
+
+/*
+ * mm_mt_malloc - Allocate a block with at least size bytes of payload.
+ */
+void *mm_mt_malloc(size_t size)
+{
+  thread_cache_t *tc;
+  void *obj;
+  int cls;
+
+  if (size == 0)
+    return NULL;
+
+  if (size > MT_SMALL_MAX) {
+    pthread_mutex_lock(&heap_lock);
+    obj = mm_malloc(size);
+    pthread_mutex_unlock(&heap_lock);
+    return obj;
+  }
+
+  cls = size_class(size);
+  tc = get_cache();
+  if (tc->head[cls] == NULL && refill(tc, cls) == 0)
+    return NULL;
+
+  obj = tc->head[cls];
+  tc->head[cls] = NEXT(obj);
+  tc->count[cls]--;
+  return obj;
+}
+
+/*
+ * mm_mt_free - Free a block: small objects go on the calling thread's cache,
+ *     whichever thread allocated them.
+ */
+void mm_mt_free(void *ptr)
+{
+  thread_cache_t *tc;
+  int cls;
+
+  if (ptr == NULL)
+    return;
+
+  if ((cls = span_class_of(ptr)) < 0) {
+    pthread_mutex_lock(&heap_lock);
+    mm_free(ptr);
+    pthread_mutex_unlock(&heap_lock);
+    return;
+  }
+
+  tc = get_cache();
+  NEXT(ptr) = tc->head[cls];
+  tc->head[cls] = ptr;
+  if (++tc->count[cls] > 2 * batch_size(cls))
+    release(tc, cls, batch_size(cls));
+}
+
+/*
+ * mm_mt_realloc - Resize a block.  Small objects stay put while the new size
+ *     is in the same class; large blocks that stay large are resized by
+ *     mm_realloc.  Anything else is copied.
+ */
+void *mm_mt_realloc(void *ptr, size_t size)
+{
+  size_t old_size;
+  void *newptr;
+  int cls;
+
+  if (ptr == NULL)
+    return mm_mt_malloc(size);
+  if (size == 0) {
+    mm_mt_free(ptr);
+    return NULL;
+  }
+
+  if ((cls = span_class_of(ptr)) >= 0) {
+    if (size <= MT_SMALL_MAX && size_class(size) == cls)
+      return ptr;
+    old_size = class_size(cls);
+  } else if (size > MT_SMALL_MAX) {
+    pthread_mutex_lock(&heap_lock);
+    newptr = mm_realloc(ptr, size);
+    pthread_mutex_unlock(&heap_lock);
+    return newptr;
+  } else {
+    /* A block from the shared heap, perhaps a small aligned one: its size
+     * is in its mm header, which other threads may be changing around. */
+    pthread_mutex_lock(&heap_lock);
+    old_size = mm_usable_size(ptr);
+    pthread_mutex_unlock(&heap_lock);
+  }
+
+  if ((newptr = mm_mt_malloc(size)) == NULL)
+    return NULL;
+  memcpy(newptr, ptr, size < old_size ? size : old_size);
+  mm_mt_free(ptr);
+  return newptr;
+}
+
+/*
+ * mm_mt_calloc - Allocate a zeroed array of nmemb elements of size bytes.
+ */
+void *mm_mt_calloc(size_t nmemb, size_t size)
+{
+  void *ptr;
+
+  if (size != 0 && nmemb > (size_t)-1 / size)
+    return NULL;
+  if ((ptr = mm_mt_malloc(nmemb * size)) != NULL)
+    memset(ptr, 0, nmemb * size);
+  return ptr;
+}
+
+/*
+ * mm_mt_memalign - Objects in spans are only ALIGNMENT-aligned, so stricter
+ *     alignments come from the shared heap.
+ */
+void *mm_mt_memalign(size_t alignment, size_t size)
+{
+  void *ptr;
+
+  if (alignment <= ALIGNMENT)
+    return mm_mt_malloc(size);
+  pthread_mutex_lock(&heap_lock);
+  ptr = mm_memalign(alignment, size);
+  pthread_mutex_unlock(&heap_lock);
+  return ptr;
+}
+
+/*
+ * mm_mt_free_sized - Free a block the caller knows was last sized size
+ *     bytes.  Span objects never hold more than MT_SMALL_MAX, so larger
+ *     blocks go straight to the shared heap without a span map lookup.
+ */
+void mm_mt_free_sized(void *ptr, size_t size)
+{
+  if (ptr == NULL)
+    return;
+  if (size <= MT_SMALL_MAX) {
+    mm_mt_free(ptr);
+    return;
+  }
+  pthread_mutex_lock(&heap_lock);
+  mm_free_sized(ptr, size);
+  pthread_mutex_unlock(&heap_lock);
+}
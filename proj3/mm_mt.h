@@ -0,0 +1,20 @@
+#ifndef MM_MM_MT_H
+#define MM_MM_MT_H
+
+#include <unistd.h>
+
+/*
+ * Thread-safe front end to the mm allocator.  Any number of threads may call
+ * the allocation and free functions at once.  mm_mt_init and
+ * mm_mt_check must be called while no other thread is inside the allocator.
+ */
+int mm_mt_check(void);
+int mm_mt_init(void);
+void *mm_mt_malloc(size_t size);
+void mm_mt_free(void *ptr);
+void *mm_mt_realloc(void *ptr, size_t size);
+void *mm_mt_calloc(size_t nmemb, size_t size);
+void *mm_mt_memalign(size_t alignment, size_t size);
+void mm_mt_free_sized(void *ptr, size_t size);
+
+#endif /* MM_MM_MT_H */
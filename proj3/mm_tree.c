@@ -0,0 +1,825 @@
+/*
+ * mm_tree.c - Best-fit allocator with boundary tags, small bins, and a treap
+ *     of large free blocks.
+ *
+ * Blocks are laid out just as in mm.c: a 4-byte header holding the block
+ * size and two flag bits, whether this block is allocated and whether the
+ * block just before it is, and in free blocks a copy of the header as a
+ * footer, so that a block being freed coalesces with its free neighbors
+ * immediately.  Payloads are 8-byte aligned.
+ *
+ * Free blocks smaller than TREE_MIN bytes are kept in small bins, one doubly
+ * linked list per 8-byte size, with a bitmap of the bins that aren't empty.
+ * Larger free blocks are the nodes of a treap keyed by (size, address): a
+ * search tree in that order which is also a heap on a priority hashed from
+ * the block's address, so it stays balanced with high probability without
+ * storing any balance information.  The child links are 32-bit heap offsets
+ * in the first two payload words, so, as with dlmalloc's tree bins, the tree
+ * lives entirely in the free blocks themselves.
+ *
+ * malloc takes an exact best fit in O(log n): the smallest non-empty small
+ * bin that fits, found with the bitmap, or else the smallest tree node that
+ * fits.  Among blocks of that size the tree gives the lowest addressed, which
+ * packs the heap toward its start and keeps free space at the end together.
+ * A block is split when the leftover would be at least MIN_BLOCK bytes.  When
+ * nothing fits, the heap is grown by only as much as the request needs beyond
+ * a free block already at the end of the heap.
+ *
+ * Heap layout:
+ *
+ *   | bins | tree root | pad | prologue hdr | prologue ftr | blocks | epilogue |
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mm_tree.h"
+#include "memlib.h"
+
+/* All blocks must have a specified minimum alignment. */
+#define ALIGNMENT 8
+
+/* Rounds up to the nearest multiple of ALIGNMENT. */
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
+
+/* Word (header, footer, link) and double word sizes in bytes. */
+#define WSIZE 4
+#define DSIZE 8
+
+/* Smallest block: header, two links, footer. */
+#define MIN_BLOCK 16
+
+/* Free blocks of at least TREE_MIN bytes go in the tree, smaller ones in the
+ * small bin for their size.  There must be at most 32 bins, one bit each in
+ * bin_map. */
+#define TREE_MIN 256
+#define NUM_BINS ((TREE_MIN - MIN_BLOCK) / DSIZE)
+
+/* Header bits. */
+#define ALLOC_BIT      0x1
+#define PREV_ALLOC_BIT 0x2
+
+/* Pack a size and flag bits into a header word. */
+#define PACK(size, bits) ((uint32_t)(size) | (bits))
+
+/* Read and write a word at address p. */
+#define GET(p)      (*(uint32_t *)(p))
+#define PUT(p, val) (*(uint32_t *)(p) = (val))
+
+/* Read the size and flags from a header or footer at address p. */
+#define GET_SIZE(p)       (GET(p) & ~0x7)
+#define GET_ALLOC(p)      (GET(p) & ALLOC_BIT)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC_BIT)
+
+/* Given a block pointer bp (the payload address), compute the address of its
+ * header and footer. */
+#define HDRP(bp) ((char *)(bp) - WSIZE)
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+
+/* Given a block pointer bp, compute the block pointer of the next block, and
+ * of the previous block.  PREV_BLKP reads the previous block's footer, so it
+ * is only valid when that block is free. */
+#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)))
+#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE((char *)(bp) - DSIZE))
+
+/* Small bin links, stored as heap offsets in the first two payload words. */
+#define NEXT_FREE(bp) GET(bp)
+#define PREV_FREE(bp) GET((char *)(bp) + WSIZE)
+#define SET_NEXT_FREE(bp, off) PUT(bp, off)
+#define SET_PREV_FREE(bp, off) PUT((char *)(bp) + WSIZE, off)
+
+/* Tree child links, in the same two words.  These give the address of the
+ * link, so that it can be followed and rewritten alike. */
+#define LEFT(bp)  ((uint32_t *)(bp))
+#define RIGHT(bp) ((uint32_t *)(bp) + 1)
+
+/* Convert between block pointers and heap offsets.  Offset 0 is the first
+ * bin head, which is never a block, so it doubles as NULL. */
+#define OFFSET(bp)    ((uint32_t)((char *)(bp) - heap_base))
+#define BLOCK_AT(off) ((off) ? heap_base + (off) : NULL)
+
+/* Space taken by the bin heads and the tree root, rounded up to a double
+ * word. */
+#define HEADS_SIZE ALIGN((NUM_BINS + 1) * WSIZE)
+
+/* Start of the heap, and the bin heads and tree root stored there. */
+static char *heap_base;
+static uint32_t *bin_heads;
+static uint32_t *tree_root;
+
+/* Bit i is set if small bin i is not empty. */
+static uint32_t bin_map;
+
+/* Function prototypes for internal helpers */
+static size_t adjust_size(size_t size);
+static int bin_index(size_t size);
+static uint32_t priority(char *bp);
+static int key_less(char *a, char *b);
+static void rotate(uint32_t *link, int left);
+static void tree_insert(uint32_t *link, char *bp);
+static void tree_remove(char *bp);
+static char *tree_best_fit(size_t asize);
+static void insert_free(char *bp);
+static void remove_free(char *bp);
+static void set_prev_alloc(char *bp, int prev_alloc);
+static char *coalesce(char *bp);
+static char *extend_heap(size_t size);
+static char *grow_heap(size_t asize);
+static char *find_fit(size_t asize);
+static void place(char *bp, size_t asize);
+static void shrink(char *bp, size_t asize);
+static char *align_up(char *bp, size_t align);
+static int check_tree(uint32_t off, char *lo, char *hi, uint32_t max_prio,
+                      long *count, long limit);
+
+/*
+ * adjust_size - Block size needed to hold a payload of size bytes.
+ */
+static size_t adjust_size(size_t size)
+{
+  size_t asize = ALIGN(size + WSIZE);
+  return (asize < MIN_BLOCK) ? MIN_BLOCK : asize;
+}
+
+/*
+ * bin_index - The small bin for free blocks of size bytes, which must be less
+ *     than TREE_MIN.
+ */
+static int bin_index(size_t size)
+{
+  return size / DSIZE - 2;  /* 16 -> 0, 24 -> 1, ..., 248 -> 29 */
+}
+
+/*
+ * priority - Tree node bp's heap priority: its offset, thoroughly mixed.
+ */
+static uint32_t priority(char *bp)
+{
+  uint32_t h = OFFSET(bp);
+
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+/*
+ * key_less - Does block a come before block b in (size, address) order?
+ */
+static int key_less(char *a, char *b)
+{
+  size_t size_a = GET_SIZE(HDRP(a));
+  size_t size_b = GET_SIZE(HDRP(b));
+
+  return size_a < size_b || (size_a == size_b && a < b);
+}
+
+/*
+ * rotate - Lift the left child (or right child) of the node *link refers to
+ *     into its place, making the node that child's right (or left) child.
+ */
+static void rotate(uint32_t *link, int left)
+{
+  char *node = BLOCK_AT(*link);
+  char *child;
+
+  if (left) {
+    child = BLOCK_AT(*LEFT(node));
+    *LEFT(node) = *RIGHT(child);
+    *RIGHT(child) = OFFSET(node);
+  } else {
+    child = BLOCK_AT(*RIGHT(node));
+    *RIGHT(node) = *LEFT(child);
+    *LEFT(child) = OFFSET(node);
+  }
+  *link = OFFSET(child);
+}
+
+/*
+ * tree_insert - Insert free block bp into the subtree *link refers to, then
+ *     rotate it up past any ancestor of lower priority.
+ */
+static void tree_insert(uint32_t *link, char *bp)
+{
+  char *node;
+  uint32_t *child;
+
+  if (*link == 0) {
+    *LEFT(bp) = 0;
+    *RIGHT(bp) = 0;
+    *link = OFFSET(bp);
+    return;
+  }
+
+  node = BLOCK_AT(*link);
+  child = key_less(bp, node) ? LEFT(node) : RIGHT(node);
+  tree_insert(child, bp);
+  if (priority(BLOCK_AT(*child)) > priority(node))
+    rotate(link, child == LEFT(node));
+}
+
+/*
+ * tree_remove - Take free block bp out of the tree: rotate it down, past its
+ *     higher priority child each time, until it has at most one child, and
+ *     then put that child in its place.
+ */
+static void tree_remove(char *bp)
+{
+  uint32_t *link = tree_root;
+  char *node;
+
+  while ((node = BLOCK_AT(*link)) != bp)
+    link = key_less(bp, node) ? LEFT(node) : RIGHT(node);
+
+  while (*LEFT(bp) && *RIGHT(bp)) {
+    int left = priority(BLOCK_AT(*LEFT(bp))) > priority(BLOCK_AT(*RIGHT(bp)));
+    rotate(link, left);
+    node = BLOCK_AT(*link);
+    link = left ? RIGHT(node) : LEFT(node);
+  }
+  *link = *LEFT(bp) ? *LEFT(bp) : *RIGHT(bp);
+}
+
+/*
+ * tree_best_fit - The smallest tree node of at least asize bytes, the lowest
+ *     addressed of that size, or NULL if there is none.
+ */
+static char *tree_best_fit(size_t asize)
+{
+  uint32_t off = *tree_root;
+  char *best = NULL;
+
+  while (off) {
+    char *node = BLOCK_AT(off);
+    if (GET_SIZE(HDRP(node)) >= asize) {
+      best = node;
+      off = *LEFT(node);
+    } else {
+      off = *RIGHT(node);
+    }
+  }
+  return best;
+}
+
+/*
+ * insert_free - Put free block bp in its small bin, or in the tree.
+ */
+static void insert_free(char *bp)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+  int i;
+  uint32_t head;
+
+  if (size >= TREE_MIN) {
+    tree_insert(tree_root, bp);
+    return;
+  }
+
+  i = bin_index(size);
+  head = bin_heads[i];
+  SET_NEXT_FREE(bp, head);
+  SET_PREV_FREE(bp, 0);
+  if (head)
+    SET_PREV_FREE(BLOCK_AT(head), OFFSET(bp));
+  bin_heads[i] = OFFSET(bp);
+  bin_map |= (uint32_t)1 << i;
+}
+
+/*
+ * remove_free - Take free block bp out of its small bin, or out of the tree.
+ */
+static void remove_free(char *bp)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+  uint32_t next, prev;
+  int i;
+
+  if (size >= TREE_MIN) {
+    tree_remove(bp);
+    return;
+  }
+
+  i = bin_index(size);
+  next = NEXT_FREE(bp);
+  prev = PREV_FREE(bp);
+  if (prev)
+    SET_NEXT_FREE(BLOCK_AT(prev), next);
+  else if ((bin_heads[i] = next) == 0)
+    bin_map &= ~((uint32_t)1 << i);
+  if (next)
+    SET_PREV_FREE(BLOCK_AT(next), prev);
+}
+
+/*
+ * set_prev_alloc - Record in block bp's header whether the block before it is
+ *     allocated, updating its footer too if bp is free.
+ */
+static void set_prev_alloc(char *bp, int prev_alloc)
+{
+  uint32_t hdr = GET(HDRP(bp));
+
+  hdr = prev_alloc ? (hdr | PREV_ALLOC_BIT) : (hdr & ~PREV_ALLOC_BIT);
+  PUT(HDRP(bp), hdr);
+  if (!(hdr & ALLOC_BIT) && GET_SIZE(HDRP(bp)) > 0)
+    PUT(FTRP(bp), hdr);
+}
+
+/*
+ * coalesce - Merge free block bp, which is not in any bin or the tree, with
+ *     any free neighbors.  Returns the merged block, which is also in
+ *     neither.
+ */
+static char *coalesce(char *bp)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+  int prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+  char *next = NEXT_BLKP(bp);
+
+  if (!GET_ALLOC(HDRP(next))) {
+    remove_free(next);
+    size += GET_SIZE(HDRP(next));
+  }
+
+  if (!prev_alloc) {
+    bp = PREV_BLKP(bp);
+    remove_free(bp);
+    size += GET_SIZE(HDRP(bp));
+    prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+  }
+
+  PUT(HDRP(bp), PACK(size, prev_alloc));
+  PUT(FTRP(bp), PACK(size, prev_alloc));
+  set_prev_alloc(NEXT_BLKP(bp), 0);
+  return bp;
+}
+
+/*
+ * extend_heap - Grow the heap by size bytes (a multiple of DSIZE) and return
+ *     the new free block, coalesced with a free block that was at the end of
+ *     the heap.  The block is not in any bin or the tree.  Returns NULL if out
+ *     of memory.
+ */
+static char *extend_heap(size_t size)
+{
+  char *bp;
+  int prev_alloc;
+
+  if ((bp = mem_sbrk(size)) == (void *)-1)
+    return NULL;
+
+  /* The old epilogue header becomes the new block's header. */
+  prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+  PUT(HDRP(bp), PACK(size, prev_alloc));
+  PUT(FTRP(bp), PACK(size, prev_alloc));
+  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC_BIT));
+
+  return coalesce(bp);
+}
+
+/*
+ * grow_heap - Grow the heap so that it ends in a free block of at least
+ *     asize bytes, extending it by only what a free block already at the end
+ *     doesn't cover, if anything.  Returns that block, which is not in any
+ *     bin or the tree, or NULL if out of memory.
+ */
+static char *grow_heap(size_t asize)
+{
+  char *epilogue = (char *)mem_heap_hi() + 1 - WSIZE;
+  size_t extend = asize;
+
+  if (!GET_PREV_ALLOC(epilogue)) {
+    size_t size = GET_SIZE(epilogue - WSIZE);
+    if (size >= asize) {
+      char *bp = epilogue + WSIZE - size;
+      remove_free(bp);
+      return bp;
+    }
+    extend -= size;
+  }
+  return extend_heap(extend);
+}
+
+/*
+ * find_fit - The best fitting free block of at least asize bytes, or NULL.
+ */
+static char *find_fit(size_t asize)
+{
+  if (asize < TREE_MIN) {
+    int i = bin_index(asize);
+    uint32_t map = bin_map >> i;
+    if (map)
+      return BLOCK_AT(bin_heads[i + __builtin_ctz(map)]);
+  }
+  return tree_best_fit(asize);
+}
+
+/*
+ * place - Allocate asize bytes at the start of free block bp, which is not
+ *     in any bin or the tree, splitting off the rest as a new free block if
+ *     it is big enough to stand on its own.
+ */
+static void place(char *bp, size_t asize)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+  int prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+
+  if (size - asize >= MIN_BLOCK) {
+    char *rest;
+
+    PUT(HDRP(bp), PACK(asize, prev_alloc | ALLOC_BIT));
+    rest = NEXT_BLKP(bp);
+    PUT(HDRP(rest), PACK(size - asize, PREV_ALLOC_BIT));
+    PUT(FTRP(rest), PACK(size - asize, PREV_ALLOC_BIT));
+    insert_free(rest);
+  } else {
+    PUT(HDRP(bp), PACK(size, prev_alloc | ALLOC_BIT));
+    set_prev_alloc(NEXT_BLKP(bp), 1);
+  }
+}
+
+/*
+ * shrink - Cut allocated block bp down to asize bytes, freeing the tail if it
+ *     is big enough to stand on its own.  The tail is coalesced with a free
+ *     block after it.
+ */
+static void shrink(char *bp, size_t asize)
+{
+  size_t size = GET_SIZE(HDRP(bp));
+  char *rest;
+
+  if (size - asize < MIN_BLOCK)
+    return;
+
+  PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | ALLOC_BIT));
+  rest = NEXT_BLKP(bp);
+  PUT(HDRP(rest), PACK(size - asize, PREV_ALLOC_BIT));
+  PUT(FTRP(rest), PACK(size - asize, PREV_ALLOC_BIT));
+  insert_free(coalesce(rest));
+}
+
+/*
+ * align_up - The first payload address at or after bp that is a multiple of
+ *     align and leaves either no space or room for a whole block before it.
+ */
+static char *align_up(char *bp, size_t align)
+{
+  char *p = (char *)(((uintptr_t)bp + align - 1) & ~(uintptr_t)(align - 1));
+
+  if (p != bp && p - bp < MIN_BLOCK)
+    p += align;
+  return p;
+}
+
+/*
+ * mm_tree_check - Check the heap, the small bins and the tree for
+ *     consistency.  Returns 0 if everything checks out, and -1 after printing
+ *     what went wrong if not.
+ *
+ *     Heap invariants are those of mm_check.  Every bin entry is a free block
+ *     inside the heap, of its bin's size, with a back link to the entry
+ *     before it, and a bin is marked in the bitmap exactly when it isn't
+ *     empty.  The tree is checked by check_tree.  The bins and the tree
+ *     together hold exactly the free blocks found by the heap walk.
+ */
+int mm_tree_check(void)
+{
+  char *lo = (char *)mem_heap_lo();
+  char *hi = (char *)mem_heap_hi() + 1;
+  char *bp;
+  int prev_alloc = 1;
+  long heap_free = 0, listed = 0;
+  int i;
+
+  /* Prologue: an allocated 8-byte block right after the heads. */
+  bp = heap_base + HEADS_SIZE + DSIZE;
+  if (GET_SIZE(HDRP(bp)) != DSIZE || !GET_ALLOC(HDRP(bp)) ||
+      GET(HDRP(bp)) != GET(FTRP(bp))) {
+    printf("mm_tree_check: bad prologue header\n");
+    return -1;
+  }
+
+  for (bp = NEXT_BLKP(bp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if ((uintptr_t)bp % ALIGNMENT != 0) {
+      printf("mm_tree_check: block %p is not aligned\n", bp);
+      return -1;
+    }
+    if (size < MIN_BLOCK || bp + size > hi) {
+      printf("mm_tree_check: block %p has bad size %lu\n", bp,
+             (unsigned long)size);
+      return -1;
+    }
+    if (!GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc) {
+      printf("mm_tree_check: block %p has the wrong prev-allocated bit\n", bp);
+      return -1;
+    }
+    if (!GET_ALLOC(HDRP(bp))) {
+      if (GET(HDRP(bp)) != GET(FTRP(bp))) {
+        printf("mm_tree_check: free block %p header and footer differ\n", bp);
+        return -1;
+      }
+      if (!prev_alloc) {
+        printf("mm_tree_check: free blocks before %p escaped coalescing\n",
+               bp);
+        return -1;
+      }
+      heap_free++;
+    }
+    prev_alloc = GET_ALLOC(HDRP(bp));
+  }
+
+  /* Epilogue: a zero-size allocated header in the last word of the heap. */
+  if (bp != hi || !GET_ALLOC(HDRP(bp)) ||
+      !GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc) {
+    printf("mm_tree_check: bad epilogue at %p, heap ends at %p\n", bp, hi);
+    return -1;
+  }
+
+  for (i = 0; i < NUM_BINS; i++) {
+    uint32_t prev = 0;
+    if (!bin_heads[i] != !((bin_map >> i) & 1)) {
+      printf("mm_tree_check: bin %d disagrees with the bitmap\n", i);
+      return -1;
+    }
+    for (bp = BLOCK_AT(bin_heads[i]); bp != NULL;
+         bp = BLOCK_AT(NEXT_FREE(bp))) {
+      if (bp < lo || bp >= hi) {
+        printf("mm_tree_check: bin %d entry %p is outside the heap\n", i, bp);
+        return -1;
+      }
+      if (GET_ALLOC(HDRP(bp))) {
+        printf("mm_tree_check: bin %d entry %p is allocated\n", i, bp);
+        return -1;
+      }
+      if (GET_SIZE(HDRP(bp)) >= TREE_MIN ||
+          bin_index(GET_SIZE(HDRP(bp))) != i) {
+        printf("mm_tree_check: bin %d entry %p belongs elsewhere\n", i, bp);
+        return -1;
+      }
+      if (PREV_FREE(bp) != prev) {
+        printf("mm_tree_check: bin %d entry %p has a bad back link\n", i, bp);
+        return -1;
+      }
+      /* More entries than free blocks means the bin has a cycle. */
+      if (++listed > heap_free) {
+        printf("mm_tree_check: bins hold more blocks than the heap\n");
+        return -1;
+      }
+      prev = OFFSET(bp);
+    }
+  }
+
+  if (check_tree(*tree_root, NULL, NULL, UINT32_MAX, &listed, heap_free) < 0)
+    return -1;
+
+  if (listed != heap_free) {
+    printf("mm_tree_check: %ld free blocks in the heap, but %ld in bins and "
+           "the tree\n", heap_free, listed);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * check_tree - Check the subtree at offset off: every node is a free block
+ *     inside the heap of at least TREE_MIN bytes, keyed after lo and before
+ *     hi (either of which may be NULL), with a priority no higher than
+ *     max_prio, its parent's.  Adds the nodes to *count, failing if it
+ *     passes limit, which means the tree has a cycle.  Returns 0 or -1 like
+ *     mm_tree_check.
+ */
+static int check_tree(uint32_t off, char *lo, char *hi, uint32_t max_prio,
+                      long *count, long limit)
+{
+  char *node = BLOCK_AT(off);
+
+  if (node == NULL)
+    return 0;
+  if (node < (char *)mem_heap_lo() || node > (char *)mem_heap_hi()) {
+    printf("mm_tree_check: tree node %p is outside the heap\n", node);
+    return -1;
+  }
+  if (GET_ALLOC(HDRP(node)) || GET_SIZE(HDRP(node)) < TREE_MIN) {
+    printf("mm_tree_check: tree node %p is not a large free block\n", node);
+    return -1;
+  }
+  if ((lo != NULL && !key_less(lo, node)) ||
+      (hi != NULL && !key_less(node, hi))) {
+    printf("mm_tree_check: tree node %p is out of order\n", node);
+    return -1;
+  }
+  if (priority(node) > max_prio) {
+    printf("mm_tree_check: tree node %p outranks its parent\n", node);
+    return -1;
+  }
+  if (++*count > limit) {
+    printf("mm_tree_check: tree holds more blocks than the heap\n");
+    return -1;
+  }
+
+  if (check_tree(*LEFT(node), lo, node, priority(node), count, limit) < 0)
+    return -1;
+  return check_tree(*RIGHT(node), node, hi, priority(node), count, limit);
+}
+
+/*
+ * mm_tree_init - Initialize the malloc package: lay down the bin heads, the
+ *     tree root, the prologue and the epilogue in an empty heap.
+ */
+int mm_tree_init(void)
+{
+  char *p;
+
+  if ((p = mem_sbrk(HEADS_SIZE + 2 * DSIZE)) == (void *)-1)
+    return -1;
+
+  heap_base = p;
+  bin_heads = (uint32_t *)p;
+  tree_root = bin_heads + NUM_BINS;
+  memset(bin_heads, 0, HEADS_SIZE);
+  bin_map = 0;
+
+  p += HEADS_SIZE;
+  PUT(p, 0);                                                 /* padding */
+  PUT(p + WSIZE, PACK(DSIZE, PREV_ALLOC_BIT | ALLOC_BIT));   /* prologue */
+  PUT(p + 2 * WSIZE, PACK(DSIZE, PREV_ALLOC_BIT | ALLOC_BIT));
+  PUT(p + 3 * WSIZE, PACK(0, PREV_ALLOC_BIT | ALLOC_BIT));   /* epilogue */
+
+  return 0;
+}
+
+/*
+ * mm_tree_malloc - Allocate a block with at least size bytes of payload from
+ *     the best fitting free block.
+ */
+void *mm_tree_malloc(size_t size)
+{
+  size_t asize;
+  char *bp;
+
+  if (size == 0)
+    return NULL;
+
+  asize = adjust_size(size);
+  if ((bp = find_fit(asize)) != NULL) {
+    remove_free(bp);
+  } else if ((bp = grow_heap(asize)) == NULL) {
+    return NULL;
+  }
+
+  place(bp, asize);
+  return bp;
+}
+
+/*
+ * mm_tree_memalign - Allocate a block with at least size bytes of payload
+ *     that starts at a multiple of alignment, a power of two.  The free space
+ *     skipped to reach the alignment is split off as a block of its own.
+ */
+void *mm_tree_memalign(size_t alignment, size_t size)
+{
+  size_t asize;
+  char *bp, *p;
+  size_t front;
+
+  if (size == 0 || (alignment & (alignment - 1)) != 0)
+    return NULL;
+  if (alignment <= ALIGNMENT)
+    return mm_tree_malloc(size);
+
+  asize = adjust_size(size);
+  if ((bp = find_fit(asize + alignment + MIN_BLOCK)) != NULL) {
+    remove_free(bp);
+  } else {
+    /* Grow the heap by exactly enough to fit an aligned block after the
+     * free block at the end, or after the last block. */
+    char *epilogue = (char *)mem_heap_hi() + 1 - WSIZE;
+    bp = epilogue + WSIZE;
+    if (!GET_PREV_ALLOC(epilogue))
+      bp -= GET_SIZE(epilogue - WSIZE);
+    p = align_up(bp, alignment);
+    if ((bp = grow_heap(p - bp + asize)) == NULL)
+      return NULL;
+  }
+
+  p = align_up(bp, alignment);
+  front = p - bp;
+  if (front > 0) {
+    size_t size_rest = GET_SIZE(HDRP(bp)) - front;
+    PUT(HDRP(bp), PACK(front, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), GET(HDRP(bp)));
+    insert_free(bp);
+    PUT(HDRP(p), PACK(size_rest, 0));
+  }
+
+  place(p, asize);
+  return p;
+}
+
+/*
+ * mm_tree_free - Free a block, coalescing it with its free neighbors.
+ */
+void mm_tree_free(void *ptr)
+{
+  char *bp = ptr;
+  size_t size;
+
+  if (ptr == NULL)
+    return;
+
+  size = GET_SIZE(HDRP(bp));
+  PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+  PUT(FTRP(bp), GET(HDRP(bp)));
+  insert_free(coalesce(bp));
+}
+
+/*
+ * mm_tree_calloc - Allocate a zeroed array of nmemb elements of size bytes.
+ */
+void *mm_tree_calloc(size_t nmemb, size_t size)
+{
+  void *ptr;
+
+  if (size != 0 && nmemb > (size_t)-1 / size)
+    return NULL;
+  if ((ptr = mm_tree_malloc(nmemb * size)) != NULL)
+    memset(ptr, 0, nmemb * size);
+  return ptr;
+}
+
+/*
+ * mm_tree_free_sized - Free a block the caller knows the size of.  Every
+ *     block's header has its size, so this is just a free.
+ */
+void mm_tree_free_sized(void *ptr, size_t size)
+{
+  mm_tree_free(ptr);
+}
+
+/*
+ * mm_tree_realloc - Resize a block in place whenever possible, as mm_realloc
+ *     does: shrink it by splitting off the tail, grow it into a free block
+ *     right after it, or grow the heap under it when it is the last block.
+ *     Only when none of those work is the payload copied to a new block.
+ */
+void *mm_tree_realloc(void *ptr, size_t size)
+{
+  char *bp = ptr;
+  char *next;
+  size_t asize, size_avail;
+  void *newptr;
+
+  if (ptr == NULL)
+    return mm_tree_malloc(size);
+  if (size == 0) {
+    mm_tree_free(ptr);
+    return NULL;
+  }
+
+  asize = adjust_size(size);
+  size_avail = GET_SIZE(HDRP(bp));
+
+  if (asize <= size_avail) {
+    shrink(bp, asize);
+    return bp;
+  }
+
+  /* Absorb a free block that follows. */
+  next = NEXT_BLKP(bp);
+  if (!GET_ALLOC(HDRP(next))) {
+    size_avail += GET_SIZE(HDRP(next));
+    if (size_avail >= asize || GET_SIZE(HDRP(NEXT_BLKP(next))) == 0) {
+      remove_free(next);
+      PUT(HDRP(bp), PACK(size_avail, GET_PREV_ALLOC(HDRP(bp)) | ALLOC_BIT));
+      set_prev_alloc(NEXT_BLKP(bp), 1);
+      next = NEXT_BLKP(bp);
+    }
+  }
+
+  /* The block now ends at the epilogue: grow the heap under it. */
+  if (GET_SIZE(HDRP(bp)) < asize && GET_SIZE(HDRP(next)) == 0) {
+    size_t extend = asize - GET_SIZE(HDRP(bp));
+    if (mem_sbrk(extend) == (void *)-1)
+      return NULL;
+    PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | ALLOC_BIT));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, PREV_ALLOC_BIT | ALLOC_BIT));
+  }
+
+  if (GET_SIZE(HDRP(bp)) >= asize) {
+    shrink(bp, asize);
+    return bp;
+  }
+
+  /* Last resort: copy the payload, which is the block minus its header, to
+   * a new block. */
+  if ((newptr = mm_tree_malloc(size)) == NULL)
+    return NULL;
+  memcpy(newptr, ptr, GET_SIZE(HDRP(bp)) - WSIZE);
+  mm_tree_free(ptr);
+  return newptr;
+}
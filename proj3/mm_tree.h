@@ -0,0 +1,20 @@
+#ifndef MM_MM_TREE_H
+#define MM_MM_TREE_H
+
+#include <unistd.h>
+
+/*
+ * Best-fit allocator that keeps large free blocks in a balanced tree ordered
+ * by size and address.  Uses the same simulated heap as mm, so only one of
+ * the two may be in use at a time.
+ */
+int mm_tree_check(void);
+int mm_tree_init(void);
+void *mm_tree_malloc(size_t size);
+void mm_tree_free(void *ptr);
+void *mm_tree_realloc(void *ptr, size_t size);
+void *mm_tree_calloc(size_t nmemb, size_t size);
+void *mm_tree_memalign(size_t alignment, size_t size);
+void mm_tree_free_sized(void *ptr, size_t size);
+
+#endif /* MM_MM_TREE_H */
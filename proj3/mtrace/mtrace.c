@@ -0,0 +1,506 @@
+/*
+ * mtrace.c - An LD_PRELOAD malloc tracer.
+ *
+ * Run a program with
+ *
+ *   MTRACE_FILE=app.%d.raw LD_PRELOAD=path/to/libmtrace.so <app-cmd>
+ *
+ * and then convert the raw events with mtracecvt.  %d in MTRACE_FILE
+ * becomes the process id, so forked and exec'd children get files of their
+ * own; the default is mtrace.%d.raw.
+ *
+ * malloc, calloc, realloc, free, posix_memalign, aligned_alloc and memalign
+ * are wrapped.  Each wrapper calls the next definition (usually libc's),
+ * takes a number from one process-wide counter, and appends an event to
+ * its thread's ring.  Rings are single-producer, single-consumer arrays
+ * mapped outside the heap, so recording never takes a lock or allocates.
+ * A writer thread drains every ring about once a millisecond, encodes the
+ * events as varints (see mtrace.h) and streams them to the file.  A thread
+ * whose ring is full waits for the writer rather than dropping events.
+ *
+ * Frees take their number before calling free and allocations after it
+ * returns, so when one thread frees a block and another thread gets the
+ * same address back, the free is always numbered first.  realloc can free
+ * too, so it takes one number before the call, for releasing the old
+ * block, and one after, for the block it returns.
+ *
+ * Allocations made while recording (by dlsym, the writer thread, or the
+ * thread library setting up a ring's key) are passed through untraced.
+ * Events after a thread's TLS destructors have run, after the library's
+ * own destructor, and in a forked child that has not exec'd are not
+ * recorded.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mtrace.h"
+
+/* Events in each thread's ring; a power of two */
+#define RING_SLOTS 8192
+
+/* Static memory for allocations made while dlsym looks up libc */
+#define BOOT_SIZE 65536
+
+/* How long the writer sleeps when every ring is empty */
+#define WRITER_SLEEP_NS 1000000
+
+#define TLS __thread __attribute__((tls_model("initial-exec")))
+
+/* One thread's events.  The producer owns tail and the writer owns head;
+ * they are on separate cache lines so neither bounces the other's. */
+typedef struct ring {
+  struct ring *next;           /* every ring, newest first */
+  uint32_t id;
+  int in_use;                  /* claimed by a running thread */
+  uint64_t head __attribute__((aligned(64)));
+  uint64_t tail __attribute__((aligned(64)));
+  mtrace_event_t slots[RING_SLOTS] __attribute__((aligned(64)));
+} ring_t;
+
+/* Where tracing is; events are buffered in rings from the first call, but
+ * the writer only starts in the library's constructor. */
+enum {STARTING, RUNNING, STOPPING, STOPPED};
+
+/* The wrapped functions */
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+
+static int state = STARTING;
+static uint64_t next_seq __attribute__((aligned(64)));
+static ring_t *rings;
+static uint32_t num_rings;
+static pthread_key_t ring_key;
+static pthread_t writer;
+static int out_fd = -1;
+
+static char boot_buf[BOOT_SIZE] __attribute__((aligned(64)));
+static size_t boot_used;
+
+/* The ring of this thread, or EXITED once its destructors have run */
+#define EXITED ((ring_t *)-1)
+static TLS ring_t *my_ring;
+
+/* Nonzero while this thread is inside the tracer */
+static TLS int in_tracer;
+
+/* Function prototypes for internal helpers */
+static void resolve(void);
+static void *boot_alloc(size_t size, size_t alignment);
+static int in_boot(void *ptr);
+static int enter(void);
+static void leave(void);
+static ring_t *claim_ring(void);
+static void release_ring(void *ring);
+static void record(int type, uint64_t seq, uint64_t ret_seq, void *ptr,
+                   size_t size, void *ret);
+static uint64_t take_seq(void);
+static int write_all(const void *buf, size_t len);
+static size_t drain(ring_t *ring, unsigned char *buf);
+static void *writer_main(void *arg);
+static void fork_child(void);
+
+/*
+ * resolve - Find the wrapped functions.  dlsym may allocate, and those
+ *     calls are served from boot_buf.
+ */
+static void resolve(void)
+{
+  real_malloc = dlsym(RTLD_NEXT, "malloc");
+  real_calloc = dlsym(RTLD_NEXT, "calloc");
+  real_realloc = dlsym(RTLD_NEXT, "realloc");
+  real_free = dlsym(RTLD_NEXT, "free");
+  real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+  real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+  real_memalign = dlsym(RTLD_NEXT, "memalign");
+}
+
+static void *boot_alloc(size_t size, size_t alignment)
+{
+  size_t used = __atomic_load_n(&boot_used, __ATOMIC_RELAXED);
+  size_t start, end;
+
+  if (alignment < 16)
+    alignment = 16;
+  do {
+    start = (used + alignment - 1) & ~(alignment - 1);
+    end = start + size;
+    if (size > BOOT_SIZE || end > BOOT_SIZE)
+      return NULL;
+  } while (!__atomic_compare_exchange_n(&boot_used, &used, end, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return boot_buf + start;
+}
+
+static int in_boot(void *ptr)
+{
+  return (char *)ptr >= boot_buf && (char *)ptr < boot_buf + BOOT_SIZE;
+}
+
+/*
+ * enter - Start tracing a call.  Returns 0 if the call should just be
+ *     passed through.
+ */
+static int enter(void)
+{
+  if (in_tracer || my_ring == EXITED ||
+      __atomic_load_n(&state, __ATOMIC_RELAXED) == STOPPED)
+    return 0;
+  in_tracer = 1;
+  if (real_free == NULL)
+    resolve();
+
+  /* Claim a ring before taking any number, so each ring's events are
+   * numbered in the order they are appended */
+  if (my_ring == NULL && claim_ring() == NULL) {
+    in_tracer = 0;
+    return 0;
+  }
+  return 1;
+}
+
+static void leave(void)
+{
+  in_tracer = 0;
+}
+
+/*
+ * claim_ring - Give this thread a ring: one an exited thread left behind,
+ *     or a new one.  Returns NULL if there is no memory for one.
+ */
+static ring_t *claim_ring(void)
+{
+  ring_t *ring;
+
+  for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL;
+       ring = ring->next) {
+    int free_ring = 0;
+    if (__atomic_compare_exchange_n(&ring->in_use, &free_ring, 1, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break;
+  }
+
+  if (ring == NULL) {
+    ring = mmap(NULL, sizeof(ring_t), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+      return NULL;
+    ring->id = __atomic_fetch_add(&num_rings, 1, __ATOMIC_RELAXED);
+    ring->in_use = 1;
+    ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+  }
+
+  /* Hand the ring back when the thread exits.  Before the constructor
+   * runs there is no key yet, but then this is the main thread. */
+  if (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != STARTING)
+    pthread_setspecific(ring_key, ring);
+  my_ring = ring;
+  return ring;
+}
+
+/*
+ * release_ring - Thread-exit destructor.  The ring's remaining events stay
+ *     for the writer; the next thread to claim the ring appends after them.
+ */
+static void release_ring(void *ring)
+{
+  my_ring = EXITED;
+  __atomic_store_n(&((ring_t *)ring)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * record - Append an event to this thread's ring, waiting for the writer
+ *     if the ring is full.  ret_seq is only used by REALLOC.
+ */
+static void record(int type, uint64_t seq, uint64_t ret_seq, void *ptr,
+                   size_t size, void *ret)
+{
+  ring_t *ring = my_ring;
+  mtrace_event_t *ev;
+  uint64_t tail;
+
+  tail = ring->tail;
+  while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == RING_SLOTS) {
+    if (__atomic_load_n(&state, __ATOMIC_RELAXED) == STOPPED)
+      return;
+    sched_yield();
+  }
+
+  ev = &ring->slots[tail & (RING_SLOTS - 1)];
+  ev->seq = seq;
+  ev->ret_seq = ret_seq;
+  ev->type = type;
+  ev->ptr = (uintptr_t)ptr;
+  ev->size = size;
+  ev->ret = (uintptr_t)ret;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static uint64_t take_seq(void)
+{
+  return __atomic_fetch_add(&next_seq, 1, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size)
+{
+  void *ret;
+
+  if (!enter())
+    return real_malloc ? real_malloc(size) : boot_alloc(size, 0);
+  ret = real_malloc(size);
+  if (ret != NULL)
+    record(MTRACE_MALLOC, take_seq(), 0, NULL, size, ret);
+  leave();
+  return ret;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+  void *ret;
+
+  if (!enter()) {
+    if (real_calloc)
+      return real_calloc(nmemb, size);
+    if (size && nmemb > (size_t)-1 / size)
+      return NULL;
+    return boot_alloc(nmemb * size, 0);  /* boot_buf is already zero */
+  }
+  ret = real_calloc(nmemb, size);
+  if (ret != NULL)
+    record(MTRACE_CALLOC, take_seq(), 0, NULL, nmemb * size, ret);
+  leave();
+  return ret;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  uint64_t seq;
+  void *ret;
+
+  if (in_boot(ptr)) {
+    /* Move blocks from before libc was found into the real heap */
+    size_t avail = boot_buf + BOOT_SIZE - (char *)ptr;
+    if ((ret = malloc(size)) != NULL)
+      memcpy(ret, ptr, size < avail ? size : avail);
+    return ret;
+  }
+  if (!enter())
+    return real_realloc(ptr, size);
+  seq = take_seq();
+  ret = real_realloc(ptr, size);
+  if (ret != NULL || size == 0)
+    record(MTRACE_REALLOC, seq, take_seq(), ptr, size, ret);
+  leave();
+  return ret;
+}
+
+void free(void *ptr)
+{
+  uint64_t seq;
+
+  if (ptr == NULL || in_boot(ptr))
+    return;
+  if (!enter()) {
+    real_free(ptr);
+    return;
+  }
+  seq = take_seq();
+  real_free(ptr);
+  record(MTRACE_FREE, seq, 0, ptr, 0, NULL);
+  leave();
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+  int err;
+
+  if (!enter()) {
+    if (real_posix_memalign)
+      return real_posix_memalign(memptr, alignment, size);
+    *memptr = boot_alloc(size, alignment);
+    return *memptr ? 0 : ENOMEM;
+  }
+  err = real_posix_memalign(memptr, alignment, size);
+  if (err == 0)
+    record(MTRACE_MEMALIGN, take_seq(), 0, (void *)alignment, size,
+           *memptr);
+  leave();
+  return err;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+  void *ret;
+
+  if (!enter())
+    return real_aligned_alloc ? real_aligned_alloc(alignment, size)
+                              : boot_alloc(size, alignment);
+  ret = real_aligned_alloc(alignment, size);
+  if (ret != NULL)
+    record(MTRACE_MEMALIGN, take_seq(), 0, (void *)alignment, size, ret);
+  leave();
+  return ret;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+  void *ret;
+
+  if (!enter())
+    return real_memalign ? real_memalign(alignment, size)
+                         : boot_alloc(size, alignment);
+  ret = real_memalign(alignment, size);
+  if (ret != NULL)
+    record(MTRACE_MEMALIGN, take_seq(), 0, (void *)alignment, size, ret);
+  leave();
+  return ret;
+}
+
+static int write_all(const void *buf, size_t len)
+{
+  const char *p = buf;
+
+  while (len > 0) {
+    ssize_t n = write(out_fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/*
+ * drain - Write the events in ring as one chunk.  buf has room for a full
+ *     ring.  Returns the number of events written.
+ */
+static size_t drain(ring_t *ring, unsigned char *buf)
+{
+  mtrace_chunk_header_t header;
+  mtrace_codec_t codec = {0, 0};
+  uint64_t head = ring->head;
+  uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  unsigned char *p = buf;
+  uint64_t i;
+
+  if (head == tail)
+    return 0;
+  for (i = head; i < tail; i++)
+    p += mtrace_encode(&codec, &ring->slots[i & (RING_SLOTS - 1)], p);
+  __atomic_store_n(&ring->head, tail, __ATOMIC_RELEASE);
+
+  header.ring = ring->id;
+  header.num_events = tail - head;
+  header.num_bytes = p - buf;
+  if (write_all(&header, sizeof(header)) < 0 || write_all(buf, p - buf) < 0) {
+    /* Keep draining so threads don't wait forever on a full disk */
+    static int warned;
+    if (!warned++)
+      fprintf(stderr, "mtrace: write failed: %s\n", strerror(errno));
+  }
+  return tail - head;
+}
+
+static void *writer_main(void *arg)
+{
+  struct timespec nap = {0, WRITER_SLEEP_NS};
+  unsigned char *buf;
+  ring_t *ring;
+
+  in_tracer = 1;
+  buf = mmap(NULL, RING_SLOTS * MTRACE_EVENT_MAX, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED)
+    return NULL;
+
+  for (;;) {
+    int stopping = __atomic_load_n(&state, __ATOMIC_ACQUIRE) == STOPPING;
+    size_t drained = 0;
+
+    for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL;
+         ring = ring->next)
+      drained += drain(ring, buf);
+    if (drained == 0) {
+      if (stopping)
+        break;
+      nanosleep(&nap, NULL);
+    }
+  }
+
+  munmap(buf, RING_SLOTS * MTRACE_EVENT_MAX);
+  return NULL;
+}
+
+/*
+ * fork_child - The child has the parent's rings but no writer thread, so
+ *     it stops tracing.  If it execs, the new image traces itself.
+ */
+static void fork_child(void)
+{
+  __atomic_store_n(&state, STOPPED, __ATOMIC_RELEASE);
+}
+
+__attribute__((constructor))
+static void mtrace_start(void)
+{
+  mtrace_file_header_t header;
+  const char *pattern = getenv("MTRACE_FILE");
+  char path[4096];
+
+  in_tracer = 1;
+  if (real_free == NULL)
+    resolve();
+
+  snprintf(path, sizeof(path), pattern ? pattern : "mtrace.%d.raw",
+           (int)getpid());
+  if ((out_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    fprintf(stderr, "mtrace: %s: %s\n", path, strerror(errno));
+    __atomic_store_n(&state, STOPPED, __ATOMIC_RELEASE);
+    in_tracer = 0;
+    return;
+  }
+  memcpy(header.magic, MTRACE_MAGIC, sizeof(header.magic));
+  header.version = MTRACE_VERSION;
+  write_all(&header, sizeof(header));
+
+  pthread_key_create(&ring_key, release_ring);
+  pthread_atfork(NULL, NULL, fork_child);
+  __atomic_store_n(&state, RUNNING, __ATOMIC_RELEASE);
+  if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+    fprintf(stderr, "mtrace: could not start the writer thread\n");
+    __atomic_store_n(&state, STOPPED, __ATOMIC_RELEASE);
+  }
+  in_tracer = 0;
+}
+
+__attribute__((destructor))
+static void mtrace_stop(void)
+{
+  if (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != RUNNING)
+    return;
+  in_tracer = 1;
+  __atomic_store_n(&state, STOPPING, __ATOMIC_RELEASE);
+  pthread_join(writer, NULL);
+  __atomic_store_n(&state, STOPPED, __ATOMIC_RELEASE);
+  close(out_fd);
+  in_tracer = 0;
+}
@@ -0,0 +1,81 @@
+#ifndef MTRACE_H
+#define MTRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Raw event files written by libmtrace.so and read by mtracecvt.
+ *
+ * A raw file is an mtrace_file_header_t followed by chunks.  Each chunk is
+ * an mtrace_chunk_header_t and the events the writer thread drained from
+ * one thread's ring in one pass, so events within a ring appear in the
+ * file in the order they happened.  Every event carries a number from a
+ * single process-wide counter, which orders events across threads.
+ *
+ * An event is its type byte, then varints: the counter as a delta from the
+ * previous event in the chunk, then the event's fields.  Addresses are
+ * zigzag deltas from the previous address in the chunk, so blocks near one
+ * another cost a byte or two.  A realloc has two numbers, one taken before
+ * it releases ptr and one after it returns ret; the counter is the first,
+ * and ret_seq is the second as a delta from it.
+ *
+ *   MALLOC    size, ret
+ *   CALLOC    size (nmemb * size), ret
+ *   REALLOC   ret_seq, ptr, size, ret
+ *   FREE      ptr
+ *   MEMALIGN  alignment, size, ret
+ */
+
+#define MTRACE_MAGIC "MTRC"
+#define MTRACE_VERSION 2
+
+/* Longest encoded event: a type byte and five 64-bit varints */
+#define MTRACE_EVENT_MAX (1 + 5 * 10)
+
+enum {
+  MTRACE_MALLOC = 0,
+  MTRACE_CALLOC = 1,
+  MTRACE_REALLOC = 2,
+  MTRACE_FREE = 3,
+  MTRACE_MEMALIGN = 4,
+};
+
+typedef struct {
+  char magic[4];           /* MTRACE_MAGIC */
+  uint32_t version;        /* MTRACE_VERSION */
+} mtrace_file_header_t;
+
+typedef struct {
+  uint32_t ring;           /* which thread's ring the events came from */
+  uint32_t num_events;
+  uint32_t num_bytes;      /* of encoded events after this header */
+} mtrace_chunk_header_t;
+
+typedef struct {
+  uint64_t seq;            /* position in the process-wide order */
+  uint64_t ret_seq;        /* for REALLOC, the position once it returned */
+  uint64_t ptr;            /* block passed in, or alignment for MEMALIGN */
+  uint64_t size;
+  uint64_t ret;            /* block returned */
+  int type;
+} mtrace_event_t;
+
+/* Previous counter value and address, which the next event is relative
+ * to.  Zero it at the start of each chunk. */
+typedef struct {
+  uint64_t seq;
+  uint64_t addr;
+} mtrace_codec_t;
+
+/* Encode ev at buf, which must have MTRACE_EVENT_MAX bytes free.  Returns
+ * the number of bytes written. */
+size_t mtrace_encode(mtrace_codec_t *codec, const mtrace_event_t *ev,
+                     unsigned char *buf);
+
+/* Decode the event at *p into ev and advance *p.  Returns -1 if the bytes
+ * before end don't hold a whole event. */
+int mtrace_decode(mtrace_codec_t *codec, const unsigned char **p,
+                  const unsigned char *end, mtrace_event_t *ev);
+
+#endif /* MTRACE_H */
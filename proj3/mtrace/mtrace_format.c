@@ -0,0 +1,129 @@
+/*
+ * mtrace_format.c - Encoding and decoding of raw tracer events.  Shared by
+ * the preloaded tracer and the converter, so it must not allocate.
+ */
+#include "mtrace.h"
+
+/* Function prototypes for internal helpers */
+static unsigned char *put_varint(unsigned char *p, uint64_t value);
+static int get_varint(const unsigned char **p, const unsigned char *end,
+                      uint64_t *value);
+static unsigned char *put_addr(mtrace_codec_t *codec, unsigned char *p,
+                               uint64_t addr);
+static int get_addr(mtrace_codec_t *codec, const unsigned char **p,
+                    const unsigned char *end, uint64_t *addr);
+
+static unsigned char *put_varint(unsigned char *p, uint64_t value)
+{
+  while (value >= 0x80) {
+    *p++ = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *p++ = value;
+  return p;
+}
+
+static int get_varint(const unsigned char **p, const unsigned char *end,
+                      uint64_t *value)
+{
+  const unsigned char *q = *p;
+  uint64_t v = 0;
+  int shift;
+
+  for (shift = 0; shift < 64 && q < end; shift += 7) {
+    v |= (uint64_t)(*q & 0x7f) << shift;
+    if ((*q++ & 0x80) == 0) {
+      *p = q;
+      *value = v;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* Addresses go out as zigzag deltas from the previous one */
+static unsigned char *put_addr(mtrace_codec_t *codec, unsigned char *p,
+                               uint64_t addr)
+{
+  int64_t delta = addr - codec->addr;
+
+  codec->addr = addr;
+  return put_varint(p, ((uint64_t)delta << 1) ^ (delta >> 63));
+}
+
+static int get_addr(mtrace_codec_t *codec, const unsigned char **p,
+                    const unsigned char *end, uint64_t *addr)
+{
+  uint64_t zigzag;
+
+  if (get_varint(p, end, &zigzag) < 0)
+    return -1;
+  codec->addr += (zigzag >> 1) ^ -(zigzag & 1);
+  *addr = codec->addr;
+  return 0;
+}
+
+size_t mtrace_encode(mtrace_codec_t *codec, const mtrace_event_t *ev,
+                     unsigned char *buf)
+{
+  unsigned char *p = buf;
+
+  *p++ = ev->type;
+  p = put_varint(p, ev->seq - codec->seq);
+  codec->seq = ev->seq;
+
+  switch (ev->type) {
+    case MTRACE_FREE:
+      p = put_addr(codec, p, ev->ptr);
+      return p - buf;
+    case MTRACE_REALLOC:
+      p = put_varint(p, ev->ret_seq - ev->seq);
+      p = put_addr(codec, p, ev->ptr);
+      break;
+    case MTRACE_MEMALIGN:
+      p = put_varint(p, ev->ptr);
+      break;
+  }
+  p = put_varint(p, ev->size);
+  p = put_addr(codec, p, ev->ret);
+  return p - buf;
+}
+
+int mtrace_decode(mtrace_codec_t *codec, const unsigned char **p,
+                  const unsigned char *end, mtrace_event_t *ev)
+{
+  uint64_t delta;
+
+  if (*p >= end)
+    return -1;
+  ev->type = *(*p)++;
+  if (get_varint(p, end, &delta) < 0)
+    return -1;
+  codec->seq += delta;
+  ev->seq = codec->seq;
+  ev->ret_seq = ev->seq;
+  ev->ptr = ev->size = ev->ret = 0;
+
+  switch (ev->type) {
+    case MTRACE_FREE:
+      return get_addr(codec, p, end, &ev->ptr);
+    case MTRACE_REALLOC:
+      if (get_varint(p, end, &delta) < 0 ||
+          get_addr(codec, p, end, &ev->ptr) < 0)
+        return -1;
+      ev->ret_seq = ev->seq + delta;
+      break;
+    case MTRACE_MEMALIGN:
+      if (get_varint(p, end, &ev->ptr) < 0)
+        return -1;
+      break;
+    case MTRACE_MALLOC:
+    case MTRACE_CALLOC:
+      break;
+    default:
+      return -1;
+  }
+  if (get_varint(p, end, &ev->size) < 0)
+    return -1;
+  return get_addr(codec, p, end, &ev->ret);
+}
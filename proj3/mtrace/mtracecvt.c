@@ -0,0 +1,520 @@
+/*
+ * mtracecvt.c - Convert a raw libmtrace.so event file into a trace.
+ *
+ * Usage: mtracecvt [-t] <raw> <output>
+ *
+ * The output is binary unless -t is given.  Each thread's events are
+ * stored in order, so the converter merges the threads' streams by event
+ * number with a heap, and never holds more than one event per thread.
+ * Live addresses are mapped to trace ids with an open-addressing hash
+ * table; ids are reused once their block is freed.
+ *
+ * calloc becomes a calloc op and the aligned allocators memalign ops.
+ * realloc(NULL, n) becomes an alloc, and realloc(p, 0) a free.  A realloc
+ * is applied in two halves at its two numbers: releasing the old address
+ * at the first, so another thread may get it back in between, and the
+ * realloc op with the new address at the second.  Frees of
+ * addresses that were never seen allocated, which happen when a block was
+ * allocated before tracing started, are dropped and counted.  Blocks still
+ * live at the end are left unfreed.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mtrace.h"
+#include "../trace.h"
+
+int verbose = 0;
+
+/* Largest size a trace op can hold */
+#define SIZE_LIMIT 0x7fffffff
+
+/* One thread's stream of events */
+typedef struct {
+  const unsigned char **chunks;   /* each chunk's header, in file order */
+  int num_chunks, max_chunks;
+  int next_chunk;
+  const unsigned char *p, *end;   /* events left in the current chunk */
+  uint32_t left;
+  mtrace_codec_t codec;
+  mtrace_event_t ev;              /* the stream's next event */
+  int half;                       /* ev is a realloc with its old block
+                                     released, and held is its id or -1 */
+  int held;
+} stream_t;
+
+/* Maps live block addresses to ids; an addr of 0 marks an empty slot */
+typedef struct {
+  struct {
+    uint64_t addr;
+    int id;
+  } *slots;
+  size_t mask;
+  size_t count;
+} addr_map_t;
+
+typedef struct {
+  trace_writer_t *writer;
+  const char *path;
+  addr_map_t map;
+  int *free_ids;                  /* stack of ids to reuse */
+  int num_free_ids;
+  uint64_t *id_sizes;
+  int num_ids, max_ids;
+  uint64_t live, peak;
+
+  long events, ops, unknown_frees, reused_addrs, too_big;
+} convert_t;
+
+static void fail(const char *msg, const char *path)
+{
+  fprintf(stderr, "mtracecvt: %s %s\n", msg, path);
+  exit(1);
+}
+
+static void *xrealloc(void *ptr, size_t size)
+{
+  if ((ptr = realloc(ptr, size)) == NULL) {
+    fprintf(stderr, "mtracecvt: out of memory\n");
+    exit(1);
+  }
+  return ptr;
+}
+
+/*
+ * Address map
+ */
+
+static size_t map_hash(const addr_map_t *map, uint64_t addr)
+{
+  uint64_t h = (addr >> 4) * 0x9e3779b97f4a7c15ULL;
+  return (h ^ (h >> 32)) & map->mask;
+}
+
+static void map_init(addr_map_t *map, size_t slots)
+{
+  map->slots = calloc(slots, sizeof(*map->slots));
+  if (map->slots == NULL)
+    xrealloc(NULL, (size_t)-1);
+  map->mask = slots - 1;
+  map->count = 0;
+}
+
+static void map_insert(addr_map_t *map, uint64_t addr, int id);
+
+/* Double the table once it is half full */
+static void map_grow(addr_map_t *map)
+{
+  addr_map_t old = *map;
+  size_t i;
+
+  map_init(map, 2 * (old.mask + 1));
+  for (i = 0; i <= old.mask; i++)
+    if (old.slots[i].addr != 0)
+      map_insert(map, old.slots[i].addr, old.slots[i].id);
+  free(old.slots);
+}
+
+static void map_insert(addr_map_t *map, uint64_t addr, int id)
+{
+  size_t i;
+
+  if (2 * (map->count + 1) > map->mask + 1)
+    map_grow(map);
+  for (i = map_hash(map, addr); map->slots[i].addr != 0;
+       i = (i + 1) & map->mask)
+    ;
+  map->slots[i].addr = addr;
+  map->slots[i].id = id;
+  map->count++;
+}
+
+/*
+ * map_remove - Remove addr and return its id, or -1 if it isn't there.
+ *     Later entries in the probe run shift back into the hole, so lookups
+ *     never need tombstones.
+ */
+static int map_remove(addr_map_t *map, uint64_t addr)
+{
+  size_t i, j;
+  int id;
+
+  for (i = map_hash(map, addr); map->slots[i].addr != addr;
+       i = (i + 1) & map->mask)
+    if (map->slots[i].addr == 0)
+      return -1;
+  id = map->slots[i].id;
+
+  for (j = (i + 1) & map->mask; map->slots[j].addr != 0;
+       j = (j + 1) & map->mask) {
+    size_t home = map_hash(map, map->slots[j].addr);
+    /* Move j into the hole at i unless its home lies in (i, j] */
+    if (((j - home) & map->mask) >= ((j - i) & map->mask)) {
+      map->slots[i] = map->slots[j];
+      i = j;
+    }
+  }
+  map->slots[i].addr = 0;
+  map->count--;
+  return id;
+}
+
+/*
+ * Conversion
+ */
+
+static void emit(convert_t *cv, int type, int id, uint64_t size, int align)
+{
+  traceop_t op;
+
+  op.type = type;
+  op.index = id;
+  op.size = size;
+  op.align = align;
+  cv->ops++;
+  if (trace_writer_op(cv->writer, &op) < 0) {
+    perror(cv->path);
+    exit(1);
+  }
+}
+
+/* Free id, which has already left the address map */
+static void retire(convert_t *cv, int id)
+{
+  cv->live -= cv->id_sizes[id];
+  cv->free_ids[cv->num_free_ids++] = id;
+  emit(cv, FREE, id, 0, 0);
+}
+
+static void do_free(convert_t *cv, uint64_t addr)
+{
+  int id = map_remove(&cv->map, addr);
+
+  if (id < 0) {
+    cv->unknown_frees++;
+    return;
+  }
+  retire(cv, id);
+}
+
+/*
+ * do_alloc - Allocate a block of size bytes at addr, by an op of the given
+ *     type: ALLOC, CALLOC or MEMALIGN with alignment align.  A size of 0,
+ *     which mdriver rejects, is written as 1: the program got a unique
+ *     pointer it must free either way.
+ */
+static void do_alloc(convert_t *cv, int type, uint64_t addr, uint64_t size,
+                     uint64_t align)
+{
+  int id;
+
+  if (size > SIZE_LIMIT) {
+    cv->too_big++;
+    return;
+  }
+  if (size == 0)
+    size = 1;
+
+  /* The address is still live if its free raced past us in another
+   * thread's ring; retire the old block first. */
+  if ((id = map_remove(&cv->map, addr)) >= 0) {
+    cv->reused_addrs++;
+    retire(cv, id);
+  }
+
+  if (cv->num_free_ids > 0) {
+    id = cv->free_ids[--cv->num_free_ids];
+  } else {
+    if (cv->num_ids == cv->max_ids) {
+      cv->max_ids = cv->max_ids ? 2 * cv->max_ids : 1024;
+      cv->id_sizes = xrealloc(cv->id_sizes, cv->max_ids * sizeof(uint64_t));
+      cv->free_ids = xrealloc(cv->free_ids, cv->max_ids * sizeof(int));
+    }
+    id = cv->num_ids++;
+  }
+
+  map_insert(&cv->map, addr, id);
+  cv->id_sizes[id] = size;
+  cv->live += size;
+  if (cv->live > cv->peak)
+    cv->peak = cv->live;
+
+  /* Alignments the trace can't hold fall back to a plain alloc */
+  if (type == MEMALIGN && (align > SIZE_LIMIT || (align & (align - 1)) != 0))
+    type = ALLOC;
+  emit(cv, type, id, size, type == MEMALIGN ? align : 0);
+}
+
+/*
+ * realloc_release - The first half of realloc(ptr, size): take ptr out of
+ *     the address map.  Returns the id of the block to resize in the second
+ *     half, or -1 if it frees the block or there is none.
+ */
+static int realloc_release(convert_t *cv, uint64_t ptr, uint64_t size)
+{
+  int id;
+
+  if (ptr == 0)
+    return -1;
+  if (size == 0 || size > SIZE_LIMIT) {
+    do_free(cv, ptr);
+    return -1;
+  }
+  if ((id = map_remove(&cv->map, ptr)) < 0)
+    cv->unknown_frees++;
+  return id;
+}
+
+/*
+ * realloc_finish - The second half: resize block id, or allocate a new
+ *     block if there is none, at ret.
+ */
+static void realloc_finish(convert_t *cv, int id, uint64_t size, uint64_t ret)
+{
+  int stale;
+
+  if (id < 0) {
+    if (ret != 0)
+      do_alloc(cv, ALLOC, ret, size, 0);
+    return;
+  }
+  if ((stale = map_remove(&cv->map, ret)) >= 0) {
+    cv->reused_addrs++;
+    retire(cv, stale);
+  }
+  map_insert(&cv->map, ret, id);
+  cv->live += size - cv->id_sizes[id];
+  cv->id_sizes[id] = size;
+  if (cv->live > cv->peak)
+    cv->peak = cv->live;
+  emit(cv, REALLOC, id, size, 0);
+}
+
+/*
+ * convert - Apply the stream's event, or for a realloc the half due next.
+ *     Returns 1 once the whole event has been applied.
+ */
+static int convert(convert_t *cv, stream_t *s)
+{
+  const mtrace_event_t *ev = &s->ev;
+
+  if (ev->type == MTRACE_REALLOC && !s->half) {
+    s->held = realloc_release(cv, ev->ptr, ev->size);
+    s->half = 1;
+    return 0;
+  }
+
+  cv->events++;
+  switch (ev->type) {
+    case MTRACE_MALLOC:
+      do_alloc(cv, ALLOC, ev->ret, ev->size, 0);
+      break;
+    case MTRACE_CALLOC:
+      do_alloc(cv, CALLOC, ev->ret, ev->size, 0);
+      break;
+    case MTRACE_MEMALIGN:
+      do_alloc(cv, MEMALIGN, ev->ret, ev->size, ev->ptr);
+      break;
+    case MTRACE_REALLOC:
+      realloc_finish(cv, s->held, ev->size, ev->ret);
+      s->half = 0;
+      break;
+    case MTRACE_FREE:
+      do_free(cv, ev->ptr);
+      break;
+  }
+  return 1;
+}
+
+/*
+ * Merging the streams
+ */
+
+/*
+ * stream_next - Load the stream's next event.  Returns 0 at its end.
+ */
+static int stream_next(stream_t *s, const char *path)
+{
+  while (s->left == 0) {
+    mtrace_chunk_header_t header;
+
+    if (s->next_chunk == s->num_chunks)
+      return 0;
+    memcpy(&header, s->chunks[s->next_chunk++], sizeof(header));
+    s->p = s->chunks[s->next_chunk - 1] + sizeof(header);
+    s->end = s->p + header.num_bytes;
+    s->left = header.num_events;
+    s->codec.seq = s->codec.addr = 0;
+  }
+  if (mtrace_decode(&s->codec, &s->p, s->end, &s->ev) < 0)
+    fail("Bad event in", path);
+  s->left--;
+  return 1;
+}
+
+/* The number of the stream's next event, or of its realloc's second half */
+static uint64_t stream_seq(const stream_t *s)
+{
+  return s->half ? s->ev.ret_seq : s->ev.seq;
+}
+
+/* The heap holds stream indices ordered by stream_seq */
+static void heap_down(stream_t *streams, int *heap, int n, int i)
+{
+  for (;;) {
+    int least = i, l = 2 * i + 1, r = 2 * i + 2, tmp;
+
+    if (l < n && stream_seq(&streams[heap[l]]) <
+        stream_seq(&streams[heap[least]]))
+      least = l;
+    if (r < n && stream_seq(&streams[heap[r]]) <
+        stream_seq(&streams[heap[least]]))
+      least = r;
+    if (least == i)
+      return;
+    tmp = heap[i];
+    heap[i] = heap[least];
+    heap[least] = tmp;
+    i = least;
+  }
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "Usage: mtracecvt [-t] <raw> <output>\n");
+  fprintf(stderr, "Options\n");
+  fprintf(stderr, "\t-t  Write the .rep text format instead of binary.\n");
+}
+
+int main(int argc, char **argv)
+{
+  const char *in;
+  int binary = 1;
+  const unsigned char *map, *p, *end;
+  mtrace_file_header_t file_header;
+  stream_t *streams = NULL;
+  int num_streams = 0;
+  int *heap, n;
+  convert_t cv;
+  struct stat st;
+  int c, fd, i;
+
+  while ((c = getopt(argc, argv, "th")) != -1) {
+    switch (c) {
+      case 't':
+        binary = 0;
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      default:
+        usage();
+        exit(1);
+    }
+  }
+  if (argc - optind != 2) {
+    usage();
+    exit(1);
+  }
+  in = argv[optind];
+
+  if ((fd = open(in, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+    perror(in);
+    exit(1);
+  }
+  if (st.st_size < sizeof(file_header))
+    fail("Truncated header in", in);
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    perror(in);
+    exit(1);
+  }
+  close(fd);
+  memcpy(&file_header, map, sizeof(file_header));
+  if (memcmp(file_header.magic, MTRACE_MAGIC, sizeof(file_header.magic)) != 0 ||
+      file_header.version != MTRACE_VERSION)
+    fail("Not a raw mtrace file:", in);
+
+  /* Index each thread's chunks */
+  end = map + st.st_size;
+  for (p = map + sizeof(file_header); p < end; ) {
+    mtrace_chunk_header_t header;
+    stream_t *s;
+
+    if (end - p < sizeof(header))
+      fail("Truncated chunk in", in);
+    memcpy(&header, p, sizeof(header));
+    if (end - p - sizeof(header) < header.num_bytes)
+      fail("Truncated chunk in", in);
+
+    if (header.ring >= num_streams) {
+      streams = xrealloc(streams, (header.ring + 1) * sizeof(stream_t));
+      memset(streams + num_streams, 0,
+             (header.ring + 1 - num_streams) * sizeof(stream_t));
+      num_streams = header.ring + 1;
+    }
+    s = &streams[header.ring];
+    if (s->num_chunks == s->max_chunks) {
+      s->max_chunks = s->max_chunks ? 2 * s->max_chunks : 16;
+      s->chunks = xrealloc(s->chunks, s->max_chunks * sizeof(*s->chunks));
+    }
+    s->chunks[s->num_chunks++] = p;
+    p += sizeof(header) + header.num_bytes;
+  }
+
+  memset(&cv, 0, sizeof(cv));
+  cv.path = argv[optind + 1];
+  map_init(&cv.map, 1024);
+  if ((cv.writer = trace_writer_open(cv.path, binary)) == NULL) {
+    perror(cv.path);
+    exit(1);
+  }
+
+  heap = xrealloc(NULL, (num_streams + 1) * sizeof(int));
+  for (i = n = 0; i < num_streams; i++)
+    if (stream_next(&streams[i], in))
+      heap[n++] = i;
+  for (i = n / 2 - 1; i >= 0; i--)
+    heap_down(streams, heap, n, i);
+  while (n > 0) {
+    stream_t *s = &streams[heap[0]];
+
+    if (convert(&cv, s) && !stream_next(s, in))
+      heap[0] = heap[--n];
+    heap_down(streams, heap, n, 0);
+  }
+
+  if (trace_writer_close(cv.writer, cv.peak * 2 > SIZE_LIMIT ?
+                         SIZE_LIMIT : cv.peak * 2, 1) < 0) {
+    perror(cv.path);
+    exit(1);
+  }
+
+  fprintf(stderr, "%ld events from %d threads, %ld ops, %d ids, "
+          "peak %llu live bytes\n", cv.events, num_streams, cv.ops,
+          cv.num_ids, (unsigned long long)cv.peak);
+  if (cv.unknown_frees)
+    fprintf(stderr, "%ld frees of unknown blocks dropped\n",
+            cv.unknown_frees);
+  if (cv.reused_addrs)
+    fprintf(stderr, "%ld blocks reallocated before their free was seen\n",
+            cv.reused_addrs);
+  if (cv.too_big)
+    fprintf(stderr, "%ld blocks over %d bytes dropped\n", cv.too_big,
+            SIZE_LIMIT);
+
+  for (i = 0; i < num_streams; i++)
+    free(streams[i].chunks);
+  free(streams);
+  free(heap);
+  free(cv.map.slots);
+  free(cv.id_sizes);
+  free(cv.free_ids);
+  munmap((void *)map, st.st_size);
+  return 0;
+}
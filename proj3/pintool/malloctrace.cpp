@@ -14,13 +14,15 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
-#include <tr1/unordered_map>
+#include <vector>
 
 #include "pin.H"
 
@@ -45,7 +47,7 @@ static KNOB<string> KnobLogfile(
 
 static KNOB<bool> KnobDumpBuffer(
     KNOB_MODE_WRITEONCE, "pintool", "dump_buffer", "false",
-    "dump the buffer of events to the log, default false");
+    "log every event as it is recorded, default false");
 
 enum EventType {
     MALLOC,
@@ -53,7 +55,13 @@ enum EventType {
     REALLOC_PTR,
     REALLOC_SIZE,
     REALLOC_RET,
-    FREE
+    FREE,
+    CALLOC,
+    CALLOC_RET,
+    MEMALIGN_ALIGN,
+    MEMALIGN_SIZE,
+    MEMALIGN_RET,
+    NO_EVENT  // Past the end of the pending events
 };
 
 static const char *event_names[] = {
@@ -62,9 +70,23 @@ static const char *event_names[] = {
     "REALLOC_PTR",
     "REALLOC_SIZE",
     "REALLOC_RET",
-    "FREE"
+    "FREE",
+    "CALLOC",
+    "CALLOC_RET",
+    "MEMALIGN_ALIGN",
+    "MEMALIGN_SIZE",
+    "MEMALIGN_RET"
 };
 
+// Width the header's numbers are padded to, so they can be filled in at the
+// end.  mdriver reads the header with fscanf, which skips the padding.
+static const int kHeaderWidth = 10;
+
+// The most events one operation spans: realloc's pointer, size, and a tail
+// call to malloc and its return, or calloc's size, a call to malloc and its
+// return, and calloc's return.
+static const unsigned kMaxLookahead = 4;
+
 struct MallocEvent {
     MallocEvent(EventType type, uintptr_t val)
         : type(type), val(val) {}
@@ -73,233 +95,332 @@ struct MallocEvent {
     uintptr_t val;
 };
 
-static std::vector<MallocEvent> events;
-
-static void trace_malloc(size_t size) {
-    events.push_back(MallocEvent(MALLOC, size));
-}
-
-static void trace_malloc_ret(void *ptr) {
-    events.push_back(MallocEvent(MALLOC_RET, (uintptr_t)ptr));
-}
-
-static void trace_realloc(void *ptr, size_t size) {
-    events.push_back(MallocEvent(REALLOC_PTR, (uintptr_t)ptr));
-    events.push_back(MallocEvent(REALLOC_SIZE, size));
-}
-
-static void trace_realloc_ret(void *ptr) {
-    events.push_back(MallocEvent(REALLOC_RET, (uintptr_t)ptr));
-}
-
-static void trace_free(void *ptr) {
-    events.push_back(MallocEvent(FREE, (uintptr_t)ptr));
-}
-
-// Helper class for playing back malloc events to different listeners.  Malloc,
-// Realloc, and Free are called once with the appropriate arguments and return
-// values as occurred in the program.  The data argument is whatever was in the
-// addr_map.  If nothing was in the addr_map, the event is skipped.
-class MallocListener {
+// Maps each live address to its trace index and size.  Open addressing with
+// linear probing; deletion shifts later entries back instead of leaving
+// tombstones, so lookups stay short however many blocks come and go.  The
+// table doubles when half full, so memory follows the live set.
+class AddrMap {
  public:
-    MallocListener() : addr_map() {}
+    struct Block {
+        int index;
+        size_t size;
+    };
+
+    AddrMap() : slots_(1024), count_(0) {}
+
+    // Returns false if addr isn't live.
+    bool Find(uintptr_t addr, Block *block) const {
+        size_t i = Probe(addr);
+        if (!slots_[i].used)
+            return false;
+        *block = slots_[i].block;
+        return true;
+    }
+
+    void Insert(uintptr_t addr, const Block &block) {
+        if (2 * (count_ + 1) > slots_.size())
+            Grow();
+        size_t i = Probe(addr);
+        if (!slots_[i].used) {
+            slots_[i].used = true;
+            slots_[i].addr = addr;
+            count_++;
+        }
+        slots_[i].block = block;
+    }
 
-    void Playback(std::vector<MallocEvent> &events);
+    void Erase(uintptr_t addr) {
+        size_t mask = slots_.size() - 1;
+        size_t i = Probe(addr);
+        if (!slots_[i].used)
+            return;
+        for (size_t j = (i + 1) & mask; slots_[j].used; j = (j + 1) & mask) {
+            size_t home = Hash(slots_[j].addr);
+            // Move j into the hole at i unless its home lies in (i, j].
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                slots_[i] = slots_[j];
+                i = j;
+            }
+        }
+        slots_[i].used = false;
+        count_--;
+    }
 
- protected:
-    virtual void Malloc(size_t size, uintptr_t ret) = 0;
-    virtual void Realloc(size_t size, uintptr_t ptr, uintptr_t ret,
-                         int data) = 0;
-    virtual void Free(uintptr_t ptr, int data) = 0;
+ private:
+    struct Slot {
+        Slot() : used(false), addr(0) {}
+        bool used;
+        uintptr_t addr;
+        Block block;
+    };
+
+    size_t Hash(uintptr_t addr) const {
+        uint64_t h = (uint64_t)(addr >> 4) * 0x9e3779b97f4a7c15ULL;
+        return (size_t)(h ^ (h >> 32)) & (slots_.size() - 1);
+    }
 
-    // Called after every call to one of the above malloc operations.
-    virtual void Operation() {}
+    // The slot holding addr, or the empty slot where it would go.
+    size_t Probe(uintptr_t addr) const {
+        size_t mask = slots_.size() - 1;
+        size_t i = Hash(addr);
+        while (slots_[i].used && slots_[i].addr != addr)
+            i = (i + 1) & mask;
+        return i;
+    }
 
-    // Called after all events have been played back to the listener.
-    virtual void Done() {}
+    void Grow() {
+        std::vector<Slot> old(slots_.size() * 2);
+        old.swap(slots_);
+        count_ = 0;
+        for (size_t i = 0; i < old.size(); i++)
+            if (old[i].used)
+                Insert(old[i].addr, old[i].block);
+    }
 
-    // Most visitors want to keep some data attached to each address that is
-    // live at this point in the playback.
-    std::tr1::unordered_map<uintptr_t, int> addr_map;
+    std::vector<Slot> slots_;
+    size_t count_;
 };
 
-class HeaderListener : public MallocListener {
+// Turns the raw events into trace lines as they arrive.  Only the few events
+// an operation spans are buffered, and only live addresses are remembered,
+// so memory doesn't grow with the length of the run.  The header can't be
+// known until the end, so space is reserved for it and filled in by Finish.
+class TraceWriter {
  public:
-    HeaderListener()
-        : MallocListener(), cur_heap(0), max_heap(0), num_ids(0), num_ops(0) {}
+    TraceWriter()
+        : cur_heap(0), max_heap(0), num_ids(0), num_ops(0) {}
 
- protected:
-    virtual void Malloc(size_t size, uintptr_t ret);
-    virtual void Realloc(size_t size, uintptr_t ptr, uintptr_t ret,
-                         int data);
-    virtual void Free(uintptr_t ptr, int data);
-    virtual void Operation();
-    virtual void Done();
+    void Start();
+    void Record(EventType type, uintptr_t val);
+    void Finish();
 
  private:
+    EventType Type(unsigned i) const {
+        return i < pending.size() ? pending[i].type : NO_EVENT;
+    }
+
+    void Match();
+    void Alloc(char op, size_t align, size_t size, uintptr_t ret);
+    void Realloc(size_t size, uintptr_t ptr, uintptr_t ret);
+    void Free(uintptr_t ptr);
+    void Operation();
 
+    std::deque<MallocEvent> pending;
+    AddrMap addr_map;
     size_t cur_heap;
     size_t max_heap;
     int num_ids;
     int num_ops;
 };
 
-class TraceListener : public MallocListener {
- public:
-    TraceListener() : MallocListener(), next_index(0) {}
+static TraceWriter writer;
 
- protected:
-    virtual void Malloc(size_t size, uintptr_t ret);
-    virtual void Realloc(size_t size, uintptr_t ptr, uintptr_t ret,
-                         int data);
-    virtual void Free(uintptr_t ptr, int size);
+void TraceWriter::Start() {
+    for (int i = 0; i < 4; i++)
+        trace() << std::setw(kHeaderWidth) << "" << '\n';
+}
 
- private:
-    int next_index;
-};
+void TraceWriter::Record(EventType type, uintptr_t val) {
+    if (KnobDumpBuffer.Value()) {
+        int base = (type == MALLOC || type == REALLOC_SIZE) ? 10 : 16;
+        log() << std::showbase
+              << std::left
+              << std::setbase(base)
+              << std::setw(12)
+              << event_names[type] << ' '
+              << val << '\n';
+    }
+    pending.push_back(MallocEvent(type, val));
+    while (pending.size() >= kMaxLookahead)
+        Match();
+}
 
-void MallocListener::Playback(std::vector<MallocEvent> &events) {
-    // TODO(rnk): Make this less yucky in general.  Writing pattern matchers in
-    // C++ is hard.
-    for (unsigned i = 0; i < events.size(); i++) {
-        if (events[i    ].type == MALLOC &&
-            events[i + 1].type == MALLOC_RET) {
-            // Normal malloc/ret pair.
-            uintptr_t size = events[i].val;
-            uintptr_t ptr = events[i + 1].val;
-            i += 1;
-            this->Malloc(size, ptr);
-            this->Operation();
-        } else if (events[i    ].type == REALLOC_PTR &&
-                   events[i + 1].type == REALLOC_SIZE) {
-            uintptr_t old_ptr  = events[i    ].val;
-            uintptr_t new_size = events[i + 1].val;
-            uintptr_t new_ptr;
-            if (events[i + 2].type == REALLOC_RET) {
-                // Normal return straight from realloc.
-                new_ptr = events[i + 2].val;
-                i += 2;
-            } else if (events[i + 2].type == MALLOC &&
-                       events[i + 3].type == MALLOC_RET) {
-                // Tail call from realloc to malloc.
-                if (new_size != events[i + 2].val) {
-                    log() << "Size from realloc tail call doesn't match!\n";
-                    i += 1;
-                    continue;
-                }
-                new_ptr = events[i + 3].val;
-                i += 3;
-            } else if (events[i + 2].type == REALLOC_PTR &&
-                       events[i + 3].type == REALLOC_SIZE &&
-                       events[i + 2].val == old_ptr &&
-                       events[i + 3].val == new_size) {
-                // On the first call to realloc, we get called twice.  Ignore
-                // the first call.
-                i += 1;
-                continue;
+// Consume the operation at the front of pending, or one event that doesn't
+// start an operation.  pending must hold kMaxLookahead events, or all that
+// are left at the end.
+void TraceWriter::Match() {
+    unsigned consumed = 1;
+
+    if (Type(0) == MALLOC && Type(1) == MALLOC_RET) {
+        // Normal malloc/ret pair.
+        this->Alloc('a', 0, pending[0].val, pending[1].val);
+        consumed = 2;
+    } else if (Type(0) == CALLOC && Type(1) == CALLOC_RET) {
+        this->Alloc('c', 0, pending[0].val, pending[1].val);
+        consumed = 2;
+    } else if (Type(0) == CALLOC && Type(1) == MALLOC &&
+               Type(2) == MALLOC_RET && Type(3) == CALLOC_RET) {
+        // A calloc that calls malloc and clears the block itself.
+        this->Alloc('c', 0, pending[0].val, pending[3].val);
+        consumed = 4;
+    } else if (Type(0) == MEMALIGN_ALIGN && Type(1) == MEMALIGN_SIZE &&
+               Type(2) == MEMALIGN_RET) {
+        this->Alloc('m', pending[0].val, pending[1].val, pending[2].val);
+        consumed = 3;
+    } else if (Type(0) == REALLOC_PTR && Type(1) == REALLOC_SIZE) {
+        uintptr_t old_ptr  = pending[0].val;
+        uintptr_t new_size = pending[1].val;
+        bool matched = true;
+        uintptr_t new_ptr = 0;
+        consumed = 2;
+        if (Type(2) == REALLOC_RET) {
+            // Normal return straight from realloc.
+            new_ptr = pending[2].val;
+            consumed = 3;
+        } else if (Type(2) == MALLOC && Type(3) == MALLOC_RET) {
+            // Tail call from realloc to malloc.
+            if (new_size != pending[2].val) {
+                log() << "Size from realloc tail call doesn't match!\n";
+                matched = false;
             } else {
-                log() << "Unable to find realloc return value!\n";
-                i += 1;
-                continue;
+                new_ptr = pending[3].val;
+                consumed = 4;
             }
+        } else if (Type(2) == REALLOC_PTR && Type(3) == REALLOC_SIZE &&
+                   pending[2].val == old_ptr && pending[3].val == new_size) {
+            // On the first call to realloc, we get called twice.  Ignore
+            // the first call.
+            matched = false;
+        } else {
+            log() << "Unable to find realloc return value!\n";
+            matched = false;
+        }
+        if (matched) {
             if (old_ptr == 0) {
-                // To support realloc'ing NULL, we inject a malloc of size 1
-                // because the trace file format doesn't support realloc'ing
-                // pointers that aren't previously allocated blocks.
-                this->Malloc(1, 0);
-                this->Operation();
-            }
-            std::tr1::unordered_map<uintptr_t, int>::iterator it =
-                addr_map.find(old_ptr);
-            if (it == addr_map.end()) {
-                log() << "Called realloc with unallocated ptr!\n";
-                continue;
-            }
-            size_t data = it->second;
-            addr_map.erase(old_ptr);
-            this->Realloc(new_size, old_ptr, new_ptr, data);
-            this->Operation();
-        } else if (events[i].type == FREE) {
-            // Normal free.
-            uintptr_t ptr = events[i].val;
-            if (ptr == 0) {
-                // To simulate free'ing NULL, we inject a malloc of size 0.
-                this->Malloc(1, 0);
-                this->Operation();
-            }
-            std::tr1::unordered_map<uintptr_t, int>::iterator it =
-                    addr_map.find(ptr);
-            if (it == addr_map.end()) {
-                log() << "Freed previously unallocated pointer: "
-                      << ptr << '\n';
-                continue;
+                // realloc'ing NULL is a malloc.
+                this->Alloc('a', 0, new_size, new_ptr);
+            } else {
+                this->Realloc(new_size, old_ptr, new_ptr);
             }
-            size_t data = it->second;
-            addr_map.erase(ptr);
-            this->Free(ptr, data);
-            this->Operation();
         }
+    } else if (Type(0) == FREE) {
+        // Normal free.  free'ing NULL does nothing, so it isn't traced.
+        uintptr_t ptr = pending[0].val;
+        if (ptr != 0)
+            this->Free(ptr);
     }
 
-    this->Done();
+    pending.erase(pending.begin(), pending.begin() + consumed);
 }
 
-void HeaderListener::Malloc(size_t size, uintptr_t ret) {
+// op is 'a' for malloc, 'c' for calloc (with size the total bytes), or 'm'
+// for an aligned allocation.  Failed allocations aren't traced.
+void TraceWriter::Alloc(char op, size_t align, size_t size, uintptr_t ret) {
+    if (ret == 0)
+        return;
+    AddrMap::Block block;
+    block.index = num_ids++;
+    block.size = size;
+    addr_map.Insert(ret, block);
     cur_heap += size;
-    addr_map[ret] = size;
-    num_ids++;
+    trace() << op << ' ' << block.index << ' ';
+    if (op == 'm')
+        trace() << align << ' ';
+    trace() << size << '\n';
+    this->Operation();
 }
 
-void HeaderListener::Realloc(size_t new_size, uintptr_t old_ptr,
-                             uintptr_t new_ptr, int old_size) {
-    cur_heap += new_size - old_size;
-    addr_map[new_ptr] = new_size;
+void TraceWriter::Realloc(size_t new_size, uintptr_t old_ptr,
+                          uintptr_t new_ptr) {
+    AddrMap::Block block;
+    if (!addr_map.Find(old_ptr, &block)) {
+        log() << "Called realloc with unallocated ptr!\n";
+        return;
+    }
+    addr_map.Erase(old_ptr);
+    cur_heap += new_size - block.size;
+    block.size = new_size;
+    addr_map.Insert(new_ptr, block);
+    trace() << "r " << block.index << ' ' << new_size << '\n';
+    this->Operation();
 }
 
-void HeaderListener::Free(uintptr_t ptr, int old_size) {
-    cur_heap -= old_size;
+void TraceWriter::Free(uintptr_t ptr) {
+    AddrMap::Block block;
+    if (!addr_map.Find(ptr, &block)) {
+        log() << "Freed previously unallocated pointer: " << ptr << '\n';
+        return;
+    }
+    addr_map.Erase(ptr);
+    cur_heap -= block.size;
+    trace() << "f " << block.index << '\n';
+    this->Operation();
 }
 
-void HeaderListener::Operation() {
+void TraceWriter::Operation() {
     num_ops++;
     max_heap = std::max(max_heap, cur_heap);
 }
 
-void HeaderListener::Done() {
+void TraceWriter::Finish() {
+    while (!pending.empty())
+        Match();
+
     // The first four lines of the tracefiles are:
     // - sugg_heapsize # unused
     // - num_ids
     // - num_ops
     // - weight # unused
-    trace() << std::setbase(10)
-            << max_heap * 2 << '\n'
-            << num_ids << '\n'
-            << num_ops << '\n'
-            << 1 << '\n';
+    trace().seekp(0);
+    trace() << std::setbase(10) << std::left
+            << std::setw(kHeaderWidth) << max_heap * 2 << '\n'
+            << std::setw(kHeaderWidth) << num_ids << '\n'
+            << std::setw(kHeaderWidth) << num_ops << '\n'
+            << std::setw(kHeaderWidth) << 1 << '\n';
+}
+
+static void trace_malloc(size_t size) {
+    writer.Record(MALLOC, size);
 }
 
-void TraceListener::Malloc(size_t size, uintptr_t ret) {
-    int index = next_index++;
-    addr_map[ret] = index;
-    trace() << "a " << index << ' ' << size << '\n';
+static void trace_malloc_ret(void *ptr) {
+    writer.Record(MALLOC_RET, (uintptr_t)ptr);
 }
 
-void TraceListener::Realloc(size_t new_size, uintptr_t old_ptr,
-                            uintptr_t new_ptr, int index) {
-    addr_map[new_ptr] = index;
-    trace() << "r " << index << ' ' << new_size << '\n';
+static void trace_realloc(void *ptr, size_t size) {
+    writer.Record(REALLOC_PTR, (uintptr_t)ptr);
+    writer.Record(REALLOC_SIZE, size);
 }
 
-void TraceListener::Free(uintptr_t ptr, int index) {
-    trace() << "f " << index << '\n';
+static void trace_realloc_ret(void *ptr) {
+    writer.Record(REALLOC_RET, (uintptr_t)ptr);
 }
 
-static void WriteTraceFile() {
-    HeaderListener hdr;
-    hdr.Playback(events);
-    TraceListener trace;
-    trace.Playback(events);
-    events.clear();
+static void trace_free(void *ptr) {
+    writer.Record(FREE, (uintptr_t)ptr);
+}
+
+static void trace_calloc(size_t nmemb, size_t size) {
+    writer.Record(CALLOC, nmemb * size);
+}
+
+static void trace_calloc_ret(void *ptr) {
+    writer.Record(CALLOC_RET, (uintptr_t)ptr);
+}
+
+static void trace_memalign(size_t align, size_t size) {
+    writer.Record(MEMALIGN_ALIGN, align);
+    writer.Record(MEMALIGN_SIZE, size);
+}
+
+static void trace_memalign_ret(void *ptr) {
+    writer.Record(MEMALIGN_RET, (uintptr_t)ptr);
+}
+
+// posix_memalign returns its block through memptr, which is remembered on
+// entry and read on return.
+static void **posix_memalign_memptr = NULL;
+
+static void trace_posix_memalign(void **memptr, size_t align, size_t size) {
+    posix_memalign_memptr = memptr;
+    trace_memalign(align, size);
+}
+
+static void trace_posix_memalign_ret(int err) {
+    void *ptr = NULL;
+    if (err == 0)
+        PIN_SafeCopy(&ptr, posix_memalign_memptr, sizeof(ptr));
+    writer.Record(MEMALIGN_RET, (uintptr_t)ptr);
 }
 
 static void LogInstrument(IMG img, RTN rtn) {
@@ -347,30 +468,69 @@ static void Image(IMG img, VOID *v) {
                        IARG_END);
         RTN_Close(rtn);
     }
-}
 
-static void DumpBuffer() {
-    for (unsigned i = 0; i < events.size(); i++) {
-        MallocEvent &e = events[i];
-        int base = 16;
-        if (e.type == MALLOC || e.type == REALLOC_SIZE) {
-            base = 10;
-        }
-        log() << std::showbase
-              << std::left
-              << std::setbase(base)
-              << std::setw(12)
-              << event_names[e.type] << ' '
-              << e.val << '\n';
+    rtn = RTN_FindByName(img, "calloc");
+    if (RTN_Valid(rtn)) {
+        LogInstrument(img, rtn);
+        RTN_Open(rtn);
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)trace_calloc,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 1,
+                       IARG_END);
+        RTN_InsertCall(rtn, IPOINT_AFTER, (AFUNPTR)trace_calloc_ret,
+                       IARG_FUNCRET_EXITPOINT_VALUE,
+                       IARG_END);
+        RTN_Close(rtn);
+    }
+
+    RTN memalign = RTN_FindByName(img, "memalign");
+    if (RTN_Valid(memalign)) {
+        LogInstrument(img, memalign);
+        RTN_Open(memalign);
+        RTN_InsertCall(memalign, IPOINT_BEFORE, (AFUNPTR)trace_memalign,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 1,
+                       IARG_END);
+        RTN_InsertCall(memalign, IPOINT_AFTER, (AFUNPTR)trace_memalign_ret,
+                       IARG_FUNCRET_EXITPOINT_VALUE,
+                       IARG_END);
+        RTN_Close(memalign);
+    }
+
+    // glibc aliases aligned_alloc to memalign; don't trace it twice.
+    rtn = RTN_FindByName(img, "aligned_alloc");
+    if (RTN_Valid(rtn) && (!RTN_Valid(memalign) ||
+                           RTN_Address(rtn) != RTN_Address(memalign))) {
+        LogInstrument(img, rtn);
+        RTN_Open(rtn);
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)trace_memalign,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 1,
+                       IARG_END);
+        RTN_InsertCall(rtn, IPOINT_AFTER, (AFUNPTR)trace_memalign_ret,
+                       IARG_FUNCRET_EXITPOINT_VALUE,
+                       IARG_END);
+        RTN_Close(rtn);
+    }
+
+    rtn = RTN_FindByName(img, "posix_memalign");
+    if (RTN_Valid(rtn)) {
+        LogInstrument(img, rtn);
+        RTN_Open(rtn);
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR)trace_posix_memalign,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 1,
+                       IARG_FUNCARG_ENTRYPOINT_VALUE, 2,
+                       IARG_END);
+        RTN_InsertCall(rtn, IPOINT_AFTER, (AFUNPTR)trace_posix_memalign_ret,
+                       IARG_FUNCRET_EXITPOINT_VALUE,
+                       IARG_END);
+        RTN_Close(rtn);
     }
 }
 
 static VOID Fini(INT32 code, VOID *v) {
-    // Dump the buffer to the log, if requested.
-    if (KnobDumpBuffer.Value()) {
-        DumpBuffer();
-    }
-    WriteTraceFile();
+    writer.Finish();
     trace_stream->close();
 }
 
@@ -391,6 +551,7 @@ int main(int argc, char * argv[]) {
     } else {
         log_stream = &std::cerr;
     }
+    writer.Start();
 
     IMG_AddInstrumentFunction(Image, 0);
     PIN_AddFiniFunction(Fini, 0);
@@ -0,0 +1,490 @@
+/*
+ * trace.c - Reading and writing trace files, in either the text .rep format
+ * or the binary format described in trace.h.
+ *
+ * Both formats are read one op at a time through a trace_reader_t, so tools
+ * can stream traces too big to hold in memory.  A binary trace is mapped
+ * with mmap and decoded in one sequential pass, with no stdio and no parsing
+ * of decimal numbers.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+extern int verbose; /* -v option in mdriver.c */
+
+/* Longest varint a 32-bit value needs */
+#define VARINT_MAX 5
+
+/* Width the text header's numbers are padded to, so the writer can fill
+ * them in at the end */
+#define TEXT_HEADER_WIDTH 10
+
+struct trace_writer {
+  FILE *file;
+  int binary;
+  int num_ids;      /* one more than the largest id written */
+  int num_ops;
+  int last_index;   /* id of the last op, for delta encoding */
+};
+
+/* Function prototypes for internal helpers */
+static void trace_fail(const char *msg, const char *path);
+static trace_t *alloc_trace(int num_ids, int num_ops);
+static int read_varint(const unsigned char **p, const unsigned char *end,
+                       uint32_t *value);
+static int write_varint(FILE *file, uint32_t value);
+
+/*
+ * trace_fail - Report an error reading a trace and exit.
+ */
+static void trace_fail(const char *msg, const char *path)
+{
+  if (errno != 0)
+    printf("%s %s: %s\n", msg, path, strerror(errno));
+  else
+    printf("%s %s\n", msg, path);
+  exit(1);
+}
+
+/*
+ * alloc_trace - Allocate a trace record and its arrays.
+ */
+static trace_t *alloc_trace(int num_ids, int num_ops)
+{
+  trace_t *trace;
+
+  if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+    return NULL;
+  trace->num_ids = num_ids;
+  trace->num_ops = num_ops;
+
+  /* We'll store each request line in the trace in this array */
+  trace->ops = (traceop_t *)malloc(num_ops * sizeof(traceop_t));
+
+  /* We'll keep an array of pointers to the allocated blocks here... */
+  trace->blocks = (char **)malloc(num_ids * sizeof(char *));
+
+  /* ... along with the corresponding byte sizes of each block */
+  trace->block_sizes = (size_t *)malloc(num_ids * sizeof(size_t));
+
+  if (trace->ops == NULL || trace->blocks == NULL ||
+      trace->block_sizes == NULL) {
+    free_trace(trace);
+    return NULL;
+  }
+  return trace;
+}
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+  char path[MAXLINE];
+  trace_reader_t *reader;
+  trace_t *trace;
+  int max_index = -1;
+  int i;
+
+  if (verbose > 1)
+    printf("Reading tracefile: %s\n", filename);
+
+  strcpy(path, tracedir);
+  strcat(path, filename);
+  reader = trace_reader_open(path);
+
+  if ((trace = alloc_trace(reader->num_ids, reader->num_ops)) == NULL)
+    trace_fail("Out of memory reading", path);
+  trace->sugg_heapsize = reader->sugg_heapsize;  /* not used */
+  trace->weight = reader->weight;                /* not used */
+
+  for (i = 0; i < trace->num_ops; i++) {
+    if (!trace_reader_next(reader, &trace->ops[i]))
+      trace_fail("Fewer ops than the header says in", path);
+    if (trace->ops[i].index > max_index)
+      max_index = trace->ops[i].index;
+  }
+  assert(max_index == trace->num_ids - 1);
+
+  trace_reader_close(reader);
+  return trace;
+}
+
+/*
+ * trace_reader_open - Open a trace in either format and read its header.
+ */
+trace_reader_t *trace_reader_open(const char *path)
+{
+  trace_reader_t *reader;
+  char magic[4];
+  struct stat st;
+  FILE *file;
+
+  if ((reader = (trace_reader_t *)calloc(1, sizeof(trace_reader_t))) == NULL)
+    trace_fail("Out of memory reading", path);
+  strncpy(reader->path, path, MAXLINE - 1);
+
+  errno = 0;
+  if ((file = fopen(path, "r")) == NULL)
+    trace_fail("Could not open", path);
+
+  /* Binary traces start with a magic number; text traces with a digit. */
+  if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+      memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+    rewind(file);
+    if (fscanf(file, "%d %d %d %d", &reader->sugg_heapsize,
+               &reader->num_ids, &reader->num_ops, &reader->weight) != 4)
+      trace_fail("Bad header in tracefile", path);
+    reader->file = file;
+    return reader;
+  }
+
+  if (fstat(fileno(file), &st) < 0)
+    trace_fail("Could not stat", path);
+  if (st.st_size < sizeof(trace_file_header_t))
+    trace_fail("Truncated header in", path);
+  reader->length = st.st_size;
+  reader->map = mmap(NULL, reader->length, PROT_READ,
+                     MAP_PRIVATE | MAP_POPULATE, fileno(file), 0);
+  if (reader->map == MAP_FAILED)
+    trace_fail("Could not mmap", path);
+  madvise((void *)reader->map, reader->length, MADV_SEQUENTIAL);
+  fclose(file);
+
+  {
+    const trace_file_header_t *header =
+        (const trace_file_header_t *)reader->map;
+    if (header->version < 1 || header->version > TRACE_VERSION)
+      trace_fail("Unsupported trace version in", path);
+    reader->sugg_heapsize = header->sugg_heapsize;
+    reader->num_ids = header->num_ids;
+    reader->num_ops = header->num_ops;
+    reader->weight = header->weight;
+  }
+  reader->p = reader->map + sizeof(trace_file_header_t);
+  reader->end = reader->map + reader->length;
+  return reader;
+}
+
+/*
+ * trace_reader_next - Read the next op into *op.  Returns 1, or 0 once
+ *     every op the header promises has been read.
+ */
+int trace_reader_next(trace_reader_t *reader, traceop_t *op)
+{
+  if (reader->ops_read == reader->num_ops)
+    return 0;
+  reader->ops_read++;
+  op->size = 0;
+  op->align = 0;
+
+  if (reader->file != NULL) {
+    char type[MAXLINE];
+    unsigned index, size, align;
+
+    if (fscanf(reader->file, "%s", type) != 1)
+      return 0;
+    switch(type[0]) {
+      case 'a':
+        if (fscanf(reader->file, "%u %u", &index, &size) != 2)
+          trace_fail("Bad alloc line in", reader->path);
+        op->type = ALLOC;
+        op->size = size;
+        break;
+      case 'r':
+        if (fscanf(reader->file, "%u %u", &index, &size) != 2)
+          trace_fail("Bad realloc line in", reader->path);
+        op->type = REALLOC;
+        op->size = size;
+        break;
+      case 'f':
+        if (fscanf(reader->file, "%u", &index) != 1)
+          trace_fail("Bad free line in", reader->path);
+        op->type = FREE;
+        break;
+      case 'c':
+        if (fscanf(reader->file, "%u %u", &index, &size) != 2)
+          trace_fail("Bad calloc line in", reader->path);
+        op->type = CALLOC;
+        op->size = size;
+        break;
+      case 'm':
+        if (fscanf(reader->file, "%u %u %u", &index, &align, &size) != 3 ||
+            align == 0 || (align & (align - 1)) != 0)
+          trace_fail("Bad memalign line in", reader->path);
+        op->type = MEMALIGN;
+        op->align = align;
+        op->size = size;
+        break;
+      case 's':
+        if (fscanf(reader->file, "%u %u", &index, &size) != 2)
+          trace_fail("Bad sized free line in", reader->path);
+        op->type = SIZED_FREE;
+        op->size = size;
+        break;
+      default:
+        printf("Bogus type character (%c) in tracefile %s\n",
+               type[0], reader->path);
+        exit(1);
+    }
+    if (index >= reader->num_ids)
+      trace_fail("Id out of range in", reader->path);
+    op->index = index;
+    return 1;
+  }
+
+  {
+    uint32_t value;
+    int code;
+
+    if (reader->p == reader->end)
+      trace_fail("Truncated ops in", reader->path);
+    code = *reader->p++;
+
+    if (read_varint(&reader->p, reader->end, &value) < 0)
+      trace_fail("Bad varint in", reader->path);
+    reader->index += (int32_t)((value >> 1) ^ -(value & 1));  /* unzigzag */
+    if (reader->index < 0 || reader->index >= reader->num_ids)
+      trace_fail("Id out of range in", reader->path);
+    op->index = reader->index;
+
+    switch (code) {
+      case TRACE_OP_ALLOC:
+        op->type = ALLOC;
+        break;
+      case TRACE_OP_REALLOC:
+        op->type = REALLOC;
+        break;
+      case TRACE_OP_FREE:
+        op->type = FREE;
+        return 1;
+      case TRACE_OP_CALLOC:
+        op->type = CALLOC;
+        break;
+      case TRACE_OP_MEMALIGN:
+        op->type = MEMALIGN;
+        if (read_varint(&reader->p, reader->end, &value) < 0 ||
+            value == 0 || (value & (value - 1)) != 0)
+          trace_fail("Bad alignment in", reader->path);
+        op->align = value;
+        break;
+      case TRACE_OP_SIZED_FREE:
+        op->type = SIZED_FREE;
+        break;
+      default:
+        trace_fail("Bogus op code in", reader->path);
+    }
+
+    if (read_varint(&reader->p, reader->end, &value) < 0)
+      trace_fail("Bad varint in", reader->path);
+    op->size = value;
+    return 1;
+  }
+}
+
+/*
+ * trace_reader_close - Close the file or unmap the trace.
+ */
+void trace_reader_close(trace_reader_t *reader)
+{
+  if (reader->file != NULL)
+    fclose(reader->file);
+  else
+    munmap((void *)reader->map, reader->length);
+  free(reader);
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+  free(trace->ops);         /* free the three arrays... */
+  free(trace->blocks);
+  free(trace->block_sizes);
+  free(trace);              /* and the trace record itself... */
+}
+
+/*
+ * read_varint - Decode a LEB128 varint at *p, no further than end, and
+ *     advance *p past it.  Returns -1 if it runs off the end or overflows.
+ */
+static int read_varint(const unsigned char **p, const unsigned char *end,
+                       uint32_t *value)
+{
+  const unsigned char *q = *p;
+  uint32_t v = 0;
+  int shift = 0;
+
+  do {
+    if (q == end || shift > 28)
+      return -1;
+    v |= (uint32_t)(*q & 0x7f) << shift;
+    shift += 7;
+  } while (*q++ & 0x80);
+
+  *p = q;
+  *value = v;
+  return 0;
+}
+
+/*
+ * write_varint - Write value as a LEB128 varint.
+ */
+static int write_varint(FILE *file, uint32_t value)
+{
+  unsigned char buf[VARINT_MAX];
+  int n = 0;
+
+  while (value >= 0x80) {
+    buf[n++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  buf[n++] = value;
+  return (fwrite(buf, 1, n, file) == n) ? 0 : -1;
+}
+
+/*
+ * trace_writer_open - Create path and leave room for the header, which
+ *     trace_writer_close fills in once the counts are known.
+ */
+trace_writer_t *trace_writer_open(const char *path, int binary)
+{
+  trace_writer_t *writer;
+  trace_file_header_t header;
+  int ok;
+
+  if ((writer = (trace_writer_t *)calloc(1, sizeof(trace_writer_t))) == NULL)
+    return NULL;
+  if ((writer->file = fopen(path, "w")) == NULL) {
+    free(writer);
+    return NULL;
+  }
+  writer->binary = binary;
+
+  if (binary) {
+    memset(&header, 0, sizeof(header));
+    ok = fwrite(&header, sizeof(header), 1, writer->file) == 1;
+  } else {
+    ok = fprintf(writer->file, "%*s\n%*s\n%*s\n%*s\n",
+                 TEXT_HEADER_WIDTH, "", TEXT_HEADER_WIDTH, "",
+                 TEXT_HEADER_WIDTH, "", TEXT_HEADER_WIDTH, "") > 0;
+  }
+
+  if (!ok) {
+    fclose(writer->file);
+    free(writer);
+    return NULL;
+  }
+  return writer;
+}
+
+/*
+ * trace_writer_op - Append one op to the trace.
+ */
+int trace_writer_op(trace_writer_t *writer, const traceop_t *op)
+{
+  int32_t delta;
+  int code;
+
+  if (op->index >= writer->num_ids)
+    writer->num_ids = op->index + 1;
+  writer->num_ops++;
+
+  if (!writer->binary) {
+    int n;
+    switch (op->type) {
+      case ALLOC:
+        n = fprintf(writer->file, "a %d %d\n", op->index, op->size);
+        break;
+      case REALLOC:
+        n = fprintf(writer->file, "r %d %d\n", op->index, op->size);
+        break;
+      case CALLOC:
+        n = fprintf(writer->file, "c %d %d\n", op->index, op->size);
+        break;
+      case MEMALIGN:
+        n = fprintf(writer->file, "m %d %d %d\n", op->index, op->align,
+                    op->size);
+        break;
+      case SIZED_FREE:
+        n = fprintf(writer->file, "s %d %d\n", op->index, op->size);
+        break;
+      default:
+        n = fprintf(writer->file, "f %d\n", op->index);
+        break;
+    }
+    return n < 0 ? -1 : 0;
+  }
+
+  switch (op->type) {
+    case ALLOC:
+      code = TRACE_OP_ALLOC;
+      break;
+    case REALLOC:
+      code = TRACE_OP_REALLOC;
+      break;
+    case CALLOC:
+      code = TRACE_OP_CALLOC;
+      break;
+    case MEMALIGN:
+      code = TRACE_OP_MEMALIGN;
+      break;
+    case SIZED_FREE:
+      code = TRACE_OP_SIZED_FREE;
+      break;
+    default:
+      code = TRACE_OP_FREE;
+      break;
+  }
+  putc(code, writer->file);
+
+  delta = op->index - writer->last_index;
+  writer->last_index = op->index;
+  if (write_varint(writer->file, ((uint32_t)delta << 1) ^ (delta >> 31)) < 0)
+    return -1;
+  if (op->type == MEMALIGN && write_varint(writer->file, op->align) < 0)
+    return -1;
+  if (op->type != FREE)
+    return write_varint(writer->file, op->size);
+  return 0;
+}
+
+/*
+ * trace_writer_close - Seek back to fill in the header, then close.
+ */
+int trace_writer_close(trace_writer_t *writer, int sugg_heapsize, int weight)
+{
+  trace_file_header_t header;
+  int ok = fseek(writer->file, 0, SEEK_SET) == 0;
+
+  if (ok && writer->binary) {
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.sugg_heapsize = sugg_heapsize;
+    header.num_ids = writer->num_ids;
+    header.num_ops = writer->num_ops;
+    header.weight = weight;
+    ok = fwrite(&header, sizeof(header), 1, writer->file) == 1;
+  } else if (ok) {
+    ok = fprintf(writer->file, "%-*d\n%-*d\n%-*d\n%-*d\n",
+                 TEXT_HEADER_WIDTH, sugg_heapsize,
+                 TEXT_HEADER_WIDTH, writer->num_ids,
+                 TEXT_HEADER_WIDTH, writer->num_ops,
+                 TEXT_HEADER_WIDTH, weight) > 0;
+  }
+
+  ok = (fclose(writer->file) == 0) && ok;
+  free(writer);
+  return ok ? 0 : -1;
+}
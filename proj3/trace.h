@@ -0,0 +1,90 @@
+#ifndef MM_TRACE_H
+#define MM_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mdriver.h"
+
+/*
+ * Trace files come in two formats, and read_trace tells them apart by their
+ * first bytes.
+ *
+ * Text (.rep): four header lines (suggested heap size, number of ids, number
+ * of ops, weight), then one op per line: "a <id> <size>", "r <id> <size>",
+ * "f <id>", "c <id> <size>" (calloc), "m <id> <align> <size>" (memalign) or
+ * "s <id> <size>" (free of a block known to be size bytes).
+ *
+ * Binary: a trace_file_header_t, then for each op a one-byte op code, the
+ * difference between its id and the previous op's id as a zigzag varint,
+ * for memaligns the alignment as a varint, and for every op but free the
+ * size as a varint.  Varints are LEB128: seven bits per byte, low bits
+ * first, high bit set on every byte but the last.  Version 1 traces have
+ * only the first three op codes.
+ */
+
+#define TRACE_MAGIC "MMTB"
+#define TRACE_VERSION 2
+
+/* Header of a binary trace; all fields little-endian */
+typedef struct {
+  char magic[4];           /* TRACE_MAGIC */
+  uint32_t version;        /* TRACE_VERSION */
+  uint32_t sugg_heapsize;
+  uint32_t num_ids;
+  uint32_t num_ops;
+  uint32_t weight;
+} trace_file_header_t;
+
+/* Binary op codes */
+enum {
+  TRACE_OP_ALLOC = 0,
+  TRACE_OP_FREE = 1,
+  TRACE_OP_REALLOC = 2,
+  TRACE_OP_CALLOC = 3,
+  TRACE_OP_MEMALIGN = 4,
+  TRACE_OP_SIZED_FREE = 5,
+};
+
+/* Reads a trace in either format one op at a time.  The header fields may
+ * be read directly; the rest is private. */
+typedef struct {
+  int sugg_heapsize;
+  int num_ids;
+  int num_ops;
+  int weight;
+
+  char path[MAXLINE];
+  FILE *file;                  /* text traces */
+  const unsigned char *map;    /* binary traces */
+  const unsigned char *p, *end;
+  size_t length;
+  int index;                   /* id of the last binary op */
+  int ops_read;
+} trace_reader_t;
+
+/* Writes a trace one op at a time, without knowing its length up front */
+typedef struct trace_writer trace_writer_t;
+
+/* Read a trace in either format, exiting with a message on error. */
+trace_t *read_trace(char *tracedir, char *filename);
+void free_trace(trace_t *trace);
+
+/* Stream a trace in either format.  trace_reader_open and trace_reader_next
+ * exit with a message on error; trace_reader_next returns 0 at the end. */
+trace_reader_t *trace_reader_open(const char *path);
+int trace_reader_next(trace_reader_t *reader, traceop_t *op);
+void trace_reader_close(trace_reader_t *reader);
+
+/* Start a trace file in binary or text format.  Returns NULL on error. */
+trace_writer_t *trace_writer_open(const char *path, int binary);
+
+/* Append an op.  size is ignored for FREE and align for all but MEMALIGN.
+ * Returns -1 on error. */
+int trace_writer_op(trace_writer_t *writer, const traceop_t *op);
+
+/* Fill in the header and close the file.  The number of ids and ops comes
+ * from the ops written.  Returns -1 on error. */
+int trace_writer_close(trace_writer_t *writer, int sugg_heapsize, int weight);
+
+#endif /* MM_TRACE_H */
@@ -0,0 +1,69 @@
+/*
+ * tracecvt.c - Convert a trace file between the text .rep format and the
+ * binary format.
+ *
+ * Usage: tracecvt [-t] <input> <output>
+ *
+ * The input may be in either format.  The output is binary unless -t is
+ * given.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+int verbose = 0;
+
+static void usage(void)
+{
+  fprintf(stderr, "Usage: tracecvt [-t] <input> <output>\n");
+  fprintf(stderr, "Options\n");
+  fprintf(stderr, "\t-t  Write the .rep text format instead of binary.\n");
+}
+
+int main(int argc, char **argv)
+{
+  int binary = 1;
+  trace_writer_t *writer;
+  trace_t *trace;
+  int c, i;
+
+  while ((c = getopt(argc, argv, "th")) != -1) {
+    switch (c) {
+      case 't':
+        binary = 0;
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      default:
+        usage();
+        exit(1);
+    }
+  }
+  if (argc - optind != 2) {
+    usage();
+    exit(1);
+  }
+
+  trace = read_trace("", argv[optind]);
+
+  if ((writer = trace_writer_open(argv[optind + 1], binary)) == NULL) {
+    perror(argv[optind + 1]);
+    exit(1);
+  }
+  for (i = 0; i < trace->num_ops; i++) {
+    if (trace_writer_op(writer, &trace->ops[i]) < 0) {
+      perror(argv[optind + 1]);
+      exit(1);
+    }
+  }
+  if (trace_writer_close(writer, trace->sugg_heapsize, trace->weight) < 0) {
+    perror(argv[optind + 1]);
+    exit(1);
+  }
+
+  free_trace(trace);
+  return 0;
+}
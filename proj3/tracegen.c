@@ -0,0 +1,432 @@
+/*
+ * tracegen.c - Generate synthetic traces from simple workload models.
+ *
+ * Usage: tracegen [options] <output>
+ *
+ * Each op either allocates a block, frees one, or starts a realloc series
+ * that grows one live block several times in a row.  Allocs are more
+ * likely while few blocks are live, so the live count settles around the
+ * -l target.  Which block a free picks is the lifetime model:
+ *
+ *   lifo    the newest live block (stack-like, short lifetimes)
+ *   fifo    the oldest live block (queue-like, long lifetimes)
+ *   random  any live block
+ *   phase   allocate until the target is reached, then free every block
+ *           in random order, and repeat
+ *
+ * Sizes come from one of these models, given as name:args:
+ *
+ *   uniform:MIN:MAX          uniform in [MIN, MAX]
+ *   power:MIN:MAX:ALPHA      bounded Pareto; small sizes dominate
+ *   bimodal:SMALL:LARGE:P    within 50% of SMALL with probability P,
+ *                            otherwise within 50% of LARGE
+ *
+ * Allocs can be made calloc or memalign (with an alignment from 16 to
+ * 4096), and frees can pass the block's size, in the proportions given by
+ * -c, -a and -S.
+ *
+ * Ids of freed blocks are reused, so the number of ids is the peak number
+ * of live blocks, and traces with hundreds of millions of ops need little
+ * memory to generate or replay.  Blocks still live after -n ops are freed
+ * at the end.  The same seed always gives the same trace.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+int verbose = 0;
+
+typedef enum {LIFO, FIFO, RANDOM, PHASE} lifetime_t;
+typedef enum {UNIFORM, POWER, BIMODAL} size_model_t;
+
+typedef struct {
+  size_model_t model;
+  double a, b, c;
+} size_dist_t;
+
+/* The generator's state */
+typedef struct {
+  trace_writer_t *writer;
+  const char *path;
+  uint64_t rng;
+  size_dist_t sizes;
+  lifetime_t lifetime;
+  int target;              /* live blocks to settle around */
+  double calloc_frac;      /* share of allocs made with calloc */
+  double memalign_frac;    /* share of allocs made with memalign */
+  double sized_free_frac;  /* share of frees that pass the size */
+  int freeing;             /* in a phase's free half */
+
+  /* Live ids, oldest first, in a ring of ring_size slots */
+  int *ring;
+  int ring_size;
+  int head, live;
+
+  /* Ids not in use, and the size of each id in use */
+  int *free_ids;
+  int num_free_ids;
+  int num_ids;
+  uint32_t *id_sizes;
+
+  size_t live_bytes, peak_bytes;
+} gen_t;
+
+/*
+ * next_random - xorshift64*, so traces don't depend on the libc rand().
+ */
+static uint64_t next_random(gen_t *gen)
+{
+  gen->rng ^= gen->rng >> 12;
+  gen->rng ^= gen->rng << 25;
+  gen->rng ^= gen->rng >> 27;
+  return gen->rng * 2685821657736338717ULL;
+}
+
+/* A double uniform in [0, 1) */
+static double next_double(gen_t *gen)
+{
+  return (next_random(gen) >> 11) * (1.0 / (1ULL << 53));
+}
+
+/* An integer uniform in [lo, hi] */
+static uint32_t next_range(gen_t *gen, uint32_t lo, uint32_t hi)
+{
+  return lo + next_random(gen) % ((uint64_t)hi - lo + 1);
+}
+
+static uint32_t next_size(gen_t *gen)
+{
+  const size_dist_t *d = &gen->sizes;
+  double u = next_double(gen);
+
+  switch (d->model) {
+    case UNIFORM:
+      return next_range(gen, d->a, d->b);
+    case POWER:
+      /* Invert the CDF of a Pareto distribution cut off at b */
+      return d->a / pow(1 - u * (1 - pow(d->a / d->b, d->c)), 1 / d->c);
+    default:
+      if (u < d->c)
+        return next_range(gen, d->a / 2, d->a * 3 / 2);
+      return next_range(gen, d->b / 2, d->b * 3 / 2);
+  }
+}
+
+static void emit(gen_t *gen, int type, int id, uint32_t size, int align)
+{
+  traceop_t op;
+
+  op.type = type;
+  op.index = id;
+  op.size = size;
+  op.align = align;
+  if (trace_writer_op(gen->writer, &op) < 0) {
+    perror(gen->path);
+    exit(1);
+  }
+}
+
+static void gen_alloc(gen_t *gen)
+{
+  uint32_t size = next_size(gen);
+  double u;
+  int id;
+
+  if (gen->num_free_ids > 0) {
+    id = gen->free_ids[--gen->num_free_ids];
+  } else {
+    id = gen->num_ids++;
+  }
+  gen->id_sizes[id] = size;
+  gen->ring[(gen->head + gen->live++) % gen->ring_size] = id;
+  gen->live_bytes += size;
+  if (gen->live_bytes > gen->peak_bytes)
+    gen->peak_bytes = gen->live_bytes;
+
+  /* Only draw when needed, so older option sets give the same traces */
+  u = gen->calloc_frac + gen->memalign_frac > 0 ? next_double(gen) : 1;
+  if (u < gen->calloc_frac) {
+    emit(gen, CALLOC, id, size, 0);
+  } else if (u < gen->calloc_frac + gen->memalign_frac) {
+    /* A power of two from 16 to 4096 */
+    emit(gen, MEMALIGN, id, size, 16 << next_range(gen, 0, 8));
+  } else {
+    emit(gen, ALLOC, id, size, 0);
+  }
+}
+
+/*
+ * gen_free - Free the live block at position pos, counting from the
+ *     oldest.  The newest block takes its place.
+ */
+static void gen_free(gen_t *gen, int pos)
+{
+  int *slot = &gen->ring[(gen->head + pos) % gen->ring_size];
+  int id = *slot;
+
+  if (pos == 0) {
+    gen->head = (gen->head + 1) % gen->ring_size;
+  } else {
+    *slot = gen->ring[(gen->head + gen->live - 1) % gen->ring_size];
+  }
+  gen->live--;
+  gen->live_bytes -= gen->id_sizes[id];
+  gen->free_ids[gen->num_free_ids++] = id;
+  if (gen->sized_free_frac > 0 && next_double(gen) < gen->sized_free_frac)
+    emit(gen, SIZED_FREE, id, gen->id_sizes[id], 0);
+  else
+    emit(gen, FREE, id, 0, 0);
+}
+
+/*
+ * gen_realloc_series - Grow one random live block up to steps times,
+ *     by factor growth each time, stopping at max_size.  Returns the
+ *     number of ops written.
+ */
+static long gen_realloc_series(gen_t *gen, int steps, double growth,
+                               uint32_t max_size)
+{
+  int pos = next_range(gen, 0, gen->live - 1);
+  int id = gen->ring[(gen->head + pos) % gen->ring_size];
+  long n;
+
+  for (n = 0; n < steps; n++) {
+    double grown = ceil(gen->id_sizes[id] * growth);
+    uint32_t size = grown > max_size ? max_size : (uint32_t)grown;
+
+    if (size <= gen->id_sizes[id])
+      break;
+    gen->live_bytes += size - gen->id_sizes[id];
+    if (gen->live_bytes > gen->peak_bytes)
+      gen->peak_bytes = gen->live_bytes;
+    gen->id_sizes[id] = size;
+    emit(gen, REALLOC, id, size, 0);
+  }
+  return n;
+}
+
+/*
+ * pick_free - The position of the block to free under the lifetime model.
+ */
+static int pick_free(gen_t *gen)
+{
+  switch (gen->lifetime) {
+    case LIFO:
+      return gen->live - 1;
+    case FIFO:
+      return 0;
+    default:
+      return next_range(gen, 0, gen->live - 1);
+  }
+}
+
+/*
+ * should_alloc - Whether the next op allocates.  Outside phases the
+ *     chance falls linearly from 1 with no blocks live to 0 at twice the
+ *     target, so there are never more than 2 * target live blocks.
+ */
+static int should_alloc(gen_t *gen)
+{
+  if (gen->lifetime == PHASE) {
+    if (gen->live == gen->target)
+      gen->freeing = 1;
+    else if (gen->live == 0)
+      gen->freeing = 0;
+    return !gen->freeing;
+  }
+  if (gen->live == 0)
+    return 1;
+  return next_double(gen) * 2 * gen->target >= gen->live;
+}
+
+static int parse_sizes(const char *arg, size_dist_t *d)
+{
+  char name[16];
+  int n = sscanf(arg, "%15[a-z]:%lf:%lf:%lf", name, &d->a, &d->b, &d->c);
+
+  if (strcmp(name, "uniform") == 0 && n == 3) {
+    d->model = UNIFORM;
+    return d->a >= 1 && d->b >= d->a ? 0 : -1;
+  }
+  if (strcmp(name, "power") == 0 && n == 4) {
+    d->model = POWER;
+    return d->a >= 1 && d->b >= d->a && d->c > 0 ? 0 : -1;
+  }
+  if (strcmp(name, "bimodal") == 0 && n == 4) {
+    d->model = BIMODAL;
+    return d->a >= 2 && d->b >= 2 && d->c >= 0 && d->c <= 1 ? 0 : -1;
+  }
+  return -1;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "Usage: tracegen [options] <output>\n");
+  fprintf(stderr, "Options\n");
+  fprintf(stderr, "\t-n <ops>    Number of ops before the final frees "
+          "(default 100000).\n");
+  fprintf(stderr, "\t-s <seed>   Random seed (default 1).\n");
+  fprintf(stderr, "\t-z <sizes>  Size model: uniform:MIN:MAX, "
+          "power:MIN:MAX:ALPHA or\n\t            bimodal:SMALL:LARGE:P "
+          "(default uniform:1:512).\n");
+  fprintf(stderr, "\t-L <model>  Lifetime model: lifo, fifo, random or "
+          "phase (default random).\n");
+  fprintf(stderr, "\t-l <n>      Target number of live blocks "
+          "(default 1000).\n");
+  fprintf(stderr, "\t-r <frac>   Fraction of ops that start a realloc "
+          "series (default 0).\n");
+  fprintf(stderr, "\t-k <n>      Longest realloc series (default 8).\n");
+  fprintf(stderr, "\t-g <factor> Growth per realloc (default 1.5).\n");
+  fprintf(stderr, "\t-x <bytes>  Largest realloc size (default 1MB).\n");
+  fprintf(stderr, "\t-c <frac>   Fraction of allocs made with calloc "
+          "(default 0).\n");
+  fprintf(stderr, "\t-a <frac>   Fraction of allocs made with memalign "
+          "(default 0).\n");
+  fprintf(stderr, "\t-S <frac>   Fraction of frees that pass the size "
+          "(default 0).\n");
+  fprintf(stderr, "\t-t          Write the .rep text format instead of "
+          "binary.\n");
+}
+
+int main(int argc, char **argv)
+{
+  gen_t gen;
+  long num_ops = 100000;
+  unsigned long long seed = 1;
+  double realloc_frac = 0, growth = 1.5;
+  int max_series = 8;
+  long max_realloc = 1 << 20;
+  int binary = 1;
+  long n;
+  int c;
+
+  memset(&gen, 0, sizeof(gen));
+  gen.sizes.model = UNIFORM;
+  gen.sizes.a = 1;
+  gen.sizes.b = 512;
+  gen.lifetime = RANDOM;
+  gen.target = 1000;
+
+  while ((c = getopt(argc, argv, "n:s:z:L:l:r:k:g:x:c:a:S:th")) != -1) {
+    switch (c) {
+      case 'n':
+        num_ops = atol(optarg);
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 0);
+        break;
+      case 'z':
+        if (parse_sizes(optarg, &gen.sizes) < 0) {
+          fprintf(stderr, "Bad size model: %s\n", optarg);
+          exit(1);
+        }
+        break;
+      case 'L':
+        if (strcmp(optarg, "lifo") == 0) {
+          gen.lifetime = LIFO;
+        } else if (strcmp(optarg, "fifo") == 0) {
+          gen.lifetime = FIFO;
+        } else if (strcmp(optarg, "random") == 0) {
+          gen.lifetime = RANDOM;
+        } else if (strcmp(optarg, "phase") == 0) {
+          gen.lifetime = PHASE;
+        } else {
+          fprintf(stderr, "Bad lifetime model: %s\n", optarg);
+          exit(1);
+        }
+        break;
+      case 'l':
+        gen.target = atoi(optarg);
+        break;
+      case 'r':
+        realloc_frac = atof(optarg);
+        break;
+      case 'k':
+        max_series = atoi(optarg);
+        break;
+      case 'g':
+        growth = atof(optarg);
+        break;
+      case 'x':
+        max_realloc = atol(optarg);
+        break;
+      case 'c':
+        gen.calloc_frac = atof(optarg);
+        break;
+      case 'a':
+        gen.memalign_frac = atof(optarg);
+        break;
+      case 'S':
+        gen.sized_free_frac = atof(optarg);
+        break;
+      case 't':
+        binary = 0;
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      default:
+        usage();
+        exit(1);
+    }
+  }
+  if (argc - optind != 1 || num_ops < 0 || gen.target < 1 ||
+      max_series < 1 || growth <= 1 || max_realloc < 1 ||
+      max_realloc > 0x7fffffff) {
+    usage();
+    exit(1);
+  }
+
+  /* A zero state would make xorshift return zeros forever */
+  gen.rng = seed * 0x9e3779b97f4a7c15ULL + 1;
+  gen.path = argv[optind];
+  gen.ring_size = 2 * gen.target + 1;
+  gen.ring = (int *)malloc(gen.ring_size * sizeof(int));
+  gen.free_ids = (int *)malloc(gen.ring_size * sizeof(int));
+  gen.id_sizes = (uint32_t *)malloc(gen.ring_size * sizeof(uint32_t));
+  if (gen.ring == NULL || gen.free_ids == NULL || gen.id_sizes == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  if ((gen.writer = trace_writer_open(gen.path, binary)) == NULL) {
+    perror(gen.path);
+    exit(1);
+  }
+
+  for (n = 0; n < num_ops; n++) {
+    if (gen.live > 0 && realloc_frac > 0 && next_double(&gen) < realloc_frac) {
+      long steps = next_range(&gen, 1, max_series);
+      long done;
+
+      if (steps > num_ops - n)
+        steps = num_ops - n;
+      done = gen_realloc_series(&gen, steps, growth, max_realloc);
+
+      if (done > 0) {
+        n += done - 1;
+        continue;
+      }
+    }
+    if (should_alloc(&gen))
+      gen_alloc(&gen);
+    else
+      gen_free(&gen, pick_free(&gen));
+  }
+  while (gen.live > 0)
+    gen_free(&gen, gen.live - 1);
+
+  if (trace_writer_close(gen.writer, gen.peak_bytes, 1) < 0) {
+    perror(gen.path);
+    exit(1);
+  }
+
+  free(gen.ring);
+  free(gen.free_ids);
+  free(gen.id_sizes);
+  return 0;
+}
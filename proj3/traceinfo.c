@@ -0,0 +1,351 @@
+/*
+ * traceinfo.c - Summarize the allocation behavior of trace files.
+ *
+ * Usage: traceinfo <trace>...
+ *
+ * Each trace, in either format, is read in a single streaming pass with
+ * a few words of state per id, so traces far larger than memory can be
+ * summarized.  For each trace this prints:
+ *
+ *  - a log-linear histogram of request sizes (all allocs and reallocs),
+ *  - a log2 histogram of block lifetimes, measured in ops,
+ *  - how reallocs change block sizes and how often ids are reallocated,
+ *  - peak and average live bytes, and live bytes over time,
+ *  - the best utilization any allocator could reach, which is peak live
+ *    payload over peak live bytes once each block is rounded up to
+ *    ALIGNMENT.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "trace.h"
+
+int verbose = 0;
+
+/* Size buckets: sizes below 4 get a bucket each; above that each power of
+ * two is split into SIZE_SUB buckets. */
+#define SIZE_SUB 4
+#define SIZE_BUCKETS (SIZE_SUB * 32)
+
+/* Lifetime and reallocs-per-id buckets: one per power of two */
+#define LOG_BUCKETS 33
+
+/* Number of points in the live-bytes timeline */
+#define TIMELINE_POINTS 20
+
+/* Realloc ratio buckets, by new size over old size */
+#define RATIO_BUCKETS 7
+static const char *ratio_names[RATIO_BUCKETS] = {
+  "< 0.5", "0.5 - 1", "1", "1 - 1.5", "1.5 - 2", "2 - 4", ">= 4",
+};
+
+/* Number of traceop_t types */
+#define NUM_OP_TYPES (SIZED_FREE + 1)
+
+#define ALIGN(size) (((size_t)(size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
+
+/* What is known about one id while it is live */
+typedef struct {
+  int birth;           /* op that allocated it, or -1 if not live */
+  uint32_t size;       /* current payload size */
+  uint32_t reallocs;   /* reallocs since it was allocated */
+} id_state_t;
+
+typedef struct {
+  long ops[NUM_OP_TYPES];             /* by traceop_t type */
+  long size_count[SIZE_BUCKETS];
+  long size_bytes[SIZE_BUCKETS];
+  long lifetime[LOG_BUCKETS];
+  long never_freed;
+  long ratio[RATIO_BUCKETS];
+  long reallocs_per_id[LOG_BUCKETS];  /* bucket 0 is "never reallocated" */
+  uint32_t max_reallocs;
+  size_t live, live_aligned;
+  size_t peak_live, peak_aligned;
+  int peak_op;
+  double live_sum;
+  size_t timeline[TIMELINE_POINTS];
+} stats_t;
+
+/*
+ * log2_bucket - Bucket 0 holds 0; bucket i holds [2^(i-1), 2^i).
+ */
+static int log2_bucket(uint32_t n)
+{
+  return n == 0 ? 0 : 32 - __builtin_clz(n);
+}
+
+static void print_log2_label(int bucket)
+{
+  if (bucket == 0)
+    printf("  %-13s", "0");
+  else
+    printf("  >= %-10u", (uint32_t)1 << (bucket - 1));
+}
+
+/*
+ * size_bucket - Map a size to its log-linear bucket.
+ */
+static int size_bucket(uint32_t size)
+{
+  int e;
+
+  if (size < SIZE_SUB)
+    return size;
+  e = 31 - __builtin_clz(size);
+  return SIZE_SUB * (e - 1) + ((size >> (e - 2)) & (SIZE_SUB - 1));
+}
+
+static uint32_t size_low(int bucket)
+{
+  int e;
+
+  if (bucket < SIZE_SUB)
+    return bucket;
+  e = bucket / SIZE_SUB + 1;
+  return (uint32_t)(SIZE_SUB + bucket % SIZE_SUB) << (e - 2);
+}
+
+static int ratio_bucket(uint32_t from, uint32_t to)
+{
+  double r = from ? (double)to / from : 4.0;
+
+  if (to == from)
+    return 2;
+  if (r < 0.5)
+    return 0;
+  if (r < 1)
+    return 1;
+  if (r < 1.5)
+    return 3;
+  if (r < 2)
+    return 4;
+  if (r < 4)
+    return 5;
+  return 6;
+}
+
+static void count_size(stats_t *stats, uint32_t size)
+{
+  int b = size_bucket(size);
+
+  stats->size_count[b]++;
+  stats->size_bytes[b] += size;
+}
+
+/*
+ * retire - An id stops being live, by free or at the end of the trace.
+ */
+static void retire(stats_t *stats, id_state_t *id)
+{
+  stats->live -= id->size;
+  stats->live_aligned -= ALIGN(id->size);
+  stats->reallocs_per_id[log2_bucket(id->reallocs)]++;
+  if (id->reallocs > stats->max_reallocs)
+    stats->max_reallocs = id->reallocs;
+  id->birth = -1;
+}
+
+static void print_bar(long n, long total)
+{
+  int width = total ? (int)(40 * n / total) : 0;
+
+  printf(" %6.2f%% ", total ? 100.0 * n / total : 0.0);
+  while (width-- > 0)
+    putchar('#');
+  putchar('\n');
+}
+
+static void report(const char *path, const trace_reader_t *reader,
+                   const stats_t *stats)
+{
+  long requests = stats->ops[ALLOC] + stats->ops[REALLOC] +
+      stats->ops[CALLOC] + stats->ops[MEMALIGN];
+  long lifetimes = 0, ids = 0;
+  int i;
+
+  printf("%s\n", path);
+  printf("  %d ids, %d ops: %ld allocs, %ld frees, %ld reallocs\n",
+         reader->num_ids, reader->num_ops,
+         stats->ops[ALLOC], stats->ops[FREE], stats->ops[REALLOC]);
+  if (stats->ops[CALLOC] + stats->ops[MEMALIGN] + stats->ops[SIZED_FREE] > 0)
+    printf("  %ld callocs, %ld memaligns, %ld sized frees\n",
+           stats->ops[CALLOC], stats->ops[MEMALIGN], stats->ops[SIZED_FREE]);
+
+  printf("\n  Request sizes      count      bytes\n");
+  for (i = 0; i < SIZE_BUCKETS; i++) {
+    if (stats->size_count[i] == 0)
+      continue;
+    printf("  >= %-10u %10ld %10ld", size_low(i),
+           stats->size_count[i], stats->size_bytes[i]);
+    print_bar(stats->size_count[i], requests);
+  }
+
+  for (i = 0; i < LOG_BUCKETS; i++)
+    lifetimes += stats->lifetime[i];
+  printf("\n  Lifetime (ops)     count\n");
+  for (i = 0; i < LOG_BUCKETS; i++) {
+    if (stats->lifetime[i] == 0)
+      continue;
+    print_log2_label(i);
+    printf(" %10ld           ", stats->lifetime[i]);
+    print_bar(stats->lifetime[i], lifetimes);
+  }
+  printf("  never freed   %10ld\n", stats->never_freed);
+
+  if (stats->ops[REALLOC] > 0) {
+    printf("\n  Realloc new/old    count\n");
+    for (i = 0; i < RATIO_BUCKETS; i++) {
+      if (stats->ratio[i] == 0)
+        continue;
+      printf("  %-13s %10ld           ", ratio_names[i], stats->ratio[i]);
+      print_bar(stats->ratio[i], stats->ops[REALLOC]);
+    }
+
+    for (i = 0; i < LOG_BUCKETS; i++)
+      ids += stats->reallocs_per_id[i];
+    printf("\n  Reallocs per id    count\n");
+    for (i = 0; i < LOG_BUCKETS; i++) {
+      if (stats->reallocs_per_id[i] == 0)
+        continue;
+      print_log2_label(i);
+      printf(" %10ld           ", stats->reallocs_per_id[i]);
+      print_bar(stats->reallocs_per_id[i], ids);
+    }
+    printf("  max           %10u\n", stats->max_reallocs);
+  }
+
+  printf("\n  Live bytes over time\n");
+  for (i = 0; i < TIMELINE_POINTS; i++) {
+    printf("  op %-10ld %10zu           ",
+           (long)reader->num_ops * (i + 1) / TIMELINE_POINTS,
+           stats->timeline[i]);
+    print_bar(stats->timeline[i], stats->peak_live);
+  }
+
+  printf("\n  Peak live bytes     %zu at op %d\n",
+         stats->peak_live, stats->peak_op);
+  printf("  Average live bytes  %.0f\n",
+         reader->num_ops ? stats->live_sum / reader->num_ops : 0.0);
+  printf("  Peak aligned bytes  %zu\n", stats->peak_aligned);
+  printf("  Best utilization    %.1f%%\n\n",
+         stats->peak_aligned ?
+         100.0 * stats->peak_live / stats->peak_aligned : 100.0);
+}
+
+static void analyze(const char *path)
+{
+  trace_reader_t *reader = trace_reader_open(path);
+  stats_t *stats;
+  id_state_t *ids;
+  traceop_t op;
+  int next_point = 0;
+  int n = 0;
+  int i;
+
+  stats = (stats_t *)calloc(1, sizeof(stats_t));
+  ids = (id_state_t *)malloc(reader->num_ids * sizeof(id_state_t));
+  if (stats == NULL || (ids == NULL && reader->num_ids > 0)) {
+    fprintf(stderr, "Out of memory reading %s\n", path);
+    exit(1);
+  }
+  for (i = 0; i < reader->num_ids; i++)
+    ids[i].birth = -1;
+
+  for (n = 0; trace_reader_next(reader, &op); n++) {
+    id_state_t *id = &ids[op.index];
+
+    stats->ops[op.type]++;
+    switch (op.type) {
+      case ALLOC:
+      case CALLOC:
+      case MEMALIGN:
+        if (id->birth >= 0)
+          retire(stats, id);
+        id->birth = n;
+        id->size = op.size;
+        id->reallocs = 0;
+        count_size(stats, op.size);
+        stats->live += op.size;
+        stats->live_aligned += ALIGN(op.size);
+        break;
+      case REALLOC:
+        count_size(stats, op.size);
+        if (id->birth < 0) {
+          /* realloc of a dead id behaves like malloc */
+          id->birth = n;
+          id->size = 0;
+          id->reallocs = 0;
+        } else {
+          stats->ratio[ratio_bucket(id->size, op.size)]++;
+          id->reallocs++;
+        }
+        stats->live += (size_t)op.size - id->size;
+        stats->live_aligned += ALIGN(op.size) - ALIGN(id->size);
+        id->size = op.size;
+        break;
+      case FREE:
+      case SIZED_FREE:
+        if (id->birth < 0)
+          break;
+        stats->lifetime[log2_bucket(n - id->birth)]++;
+        retire(stats, id);
+        break;
+    }
+
+    if (stats->live > stats->peak_live) {
+      stats->peak_live = stats->live;
+      stats->peak_op = n;
+    }
+    if (stats->live_aligned > stats->peak_aligned)
+      stats->peak_aligned = stats->live_aligned;
+    stats->live_sum += stats->live;
+    while (next_point < TIMELINE_POINTS &&
+           (long)reader->num_ops * (next_point + 1) / TIMELINE_POINTS <= n + 1)
+      stats->timeline[next_point++] = stats->live;
+  }
+
+  for (i = 0; i < reader->num_ids; i++) {
+    if (ids[i].birth >= 0) {
+      stats->never_freed++;
+      retire(stats, &ids[i]);
+    }
+  }
+
+  report(path, reader, stats);
+
+  trace_reader_close(reader);
+  free(ids);
+  free(stats);
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "Usage: traceinfo <trace>...\n");
+}
+
+int main(int argc, char **argv)
+{
+  int c, i;
+
+  while ((c = getopt(argc, argv, "h")) != -1) {
+    switch (c) {
+      case 'h':
+        usage();
+        exit(0);
+      default:
+        usage();
+        exit(1);
+    }
+  }
+  if (optind == argc) {
+    usage();
+    exit(1);
+  }
+
+  for (i = optind; i < argc; i++)
+    analyze(argv[i]);
+  return 0;
+}
@@ -1,7 +1,8 @@
 /*
  * validator.c - 6.172 Malloc Validator
  *
- * Validates a malloc/free/realloc implementation defined in mm.c.
+ * Validates a malloc/free/realloc implementation defined in mm.c, along with
+ * its calloc, memalign and sized free.
  *
  * Copyright (c) 2010, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
@@ -28,33 +29,102 @@
 #endif
 
 /***************************
- * Range list data structure
+ * Range tree data structure
  **************************/
 
-/* Records the extent of each block's payload */
-typedef struct range_t {
+/* Records the extent of a block's payload.  There is one per id in the
+ * trace, so that a block's record is found by its id. */
+typedef struct {
   char *lo;              /* low payload address */
   char *hi;              /* high payload address */
-  struct range_t *next;  /* next list element */
+  int left, right;       /* ids of the children in the tree, or -1 */
 } range_t;
 
+/* The extents of the allocated payloads, as a treap ordered by address:
+ * a search tree that is also a heap on a priority hashed from each id.
+ * Payloads never overlap, so ordering them by their low address orders
+ * their high addresses too. */
+typedef struct {
+  range_t *nodes;        /* indexed by id */
+  int root;              /* id at the root, or -1 */
+} ranges_t;
+
 /*****************************************************************
- * The following routines manipulate the range list, which keeps
+ * The following routines manipulate the range tree, which keeps
  * track of the extent of every allocated block payload. We use the
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks.
  ****************************************************************/
 
+/*
+ * range_priority - The heap priority of the range for id.
+ */
+static uint32_t range_priority(int id)
+{
+  uint32_t h = id;
+
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+/*
+ * range_rotate - Lift the left (or right) child of the node *link refers to
+ *     into its place.
+ */
+static void range_rotate(ranges_t *ranges, int *link, int left)
+{
+  range_t *node = &ranges->nodes[*link];
+  int child;
+
+  if (left) {
+    child = node->left;
+    node->left = ranges->nodes[child].right;
+    ranges->nodes[child].right = *link;
+  } else {
+    child = node->right;
+    node->right = ranges->nodes[child].left;
+    ranges->nodes[child].left = *link;
+  }
+  *link = child;
+}
+
+/*
+ * range_insert - Insert id's range into the subtree *link refers to, then
+ *     rotate it up past any ancestor of lower priority.
+ */
+static void range_insert(ranges_t *ranges, int *link, int id)
+{
+  range_t *node;
+  int *child;
+
+  if (*link < 0) {
+    ranges->nodes[id].left = -1;
+    ranges->nodes[id].right = -1;
+    *link = id;
+    return;
+  }
+
+  node = &ranges->nodes[*link];
+  child = (ranges->nodes[id].lo < node->lo) ? &node->left : &node->right;
+  range_insert(ranges, child, id);
+  if (range_priority(*child) > range_priority(*link))
+    range_rotate(ranges, link, child == &node->left);
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's malloc to allocate a block of
- *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list.
+ *     size bytes at addr lo for id. After checking the block for
+ *     correctness, we add id's range to the range tree.
  */
-static int add_range(malloc_impl_t *impl, range_t **ranges, char *lo, int size,
-                     int tracenum, int opnum)
+static int add_range(malloc_impl_t *impl, ranges_t *ranges, int id, char *lo,
+                     int size, int tracenum, int opnum)
 {
   char *hi = lo + size - 1;
-  range_t *p;
+  int n;
 
   /* You can use this as a buffer for writing messages with sprintf. */
   char msg[MAXLINE];
@@ -78,61 +148,49 @@ static int add_range(malloc_impl_t *impl, range_t **ranges, char *lo, int size,
     return 0;
   }
 
-  /* The payload must not overlap any other payloads */
-  for (p = *ranges; p != NULL; p = p->next) {
+  /* The payload must not overlap any other payloads.  A payload it
+   * overlaps would be on the path to where it goes in the tree, since every
+   * payload it passes is wholly before or after it. */
+  for (n = ranges->root; n >= 0; ) {
+    range_t *p = &ranges->nodes[n];
     if (lo <= p->hi && hi >= p->lo) {
       sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
               lo, hi, p->lo, p->hi);
       malloc_error(tracenum, opnum, msg);
       return 0;
     }
+    n = (hi < p->lo) ? p->left : p->right;
   }
 
-  /* Everything looks OK, so remember the extent of this block by creating a
-   * range struct and adding it the range list.
+  /* Everything looks OK, so remember the extent of this block by adding
+   * its range to the range tree.
    */
-  if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-    unix_error("malloc error in add_range");
-  p->next = *ranges;
-  p->lo = lo;
-  p->hi = hi;
-  *ranges = p;
+  ranges->nodes[id].lo = lo;
+  ranges->nodes[id].hi = hi;
+  range_insert(ranges, &ranges->root, id);
   return 1;
 }
 
 /*
- * remove_range - Free the range record of block whose payload starts at lo
+ * remove_range - Take id's range out of the range tree: rotate it down,
+ *     past its higher priority child each time, until it has at most one
+ *     child, and then put that child in its place.
  */
-static void remove_range(range_t **ranges, char *lo)
+static void remove_range(ranges_t *ranges, int id)
 {
-  range_t *p;
-  range_t **prevpp = ranges;
-  int size;
+  range_t *r = &ranges->nodes[id];
+  int *link = &ranges->root;
 
-  for (p = *ranges;  p != NULL; p = p->next) {
-    if (p->lo == lo) {
-      *prevpp = p->next;
-      size = p->hi - p->lo + 1;
-      free(p);
-      break;
-    }
-    prevpp = &(p->next);
-  }
-}
-
-/*
- * clear_ranges - free all of the range records for a trace
- */
-static void clear_ranges(range_t **ranges)
-{
-  range_t *p;
-  range_t *pnext;
+  while (*link != id)
+    link = (r->lo < ranges->nodes[*link].lo) ? &ranges->nodes[*link].left
+                                            : &ranges->nodes[*link].right;
 
-  for (p = *ranges; p != NULL; p = pnext) {
-    pnext = p->next;
-    free(p);
+  while (r->left >= 0 && r->right >= 0) {
+    int left = range_priority(r->left) > range_priority(r->right);
+    range_rotate(ranges, link, left);
+    link = left ? &ranges->nodes[*link].right : &ranges->nodes[*link].left;
   }
-  *ranges = NULL;
+  *link = (r->left >= 0) ? r->left : r->right;
 }
 
 /*
@@ -147,7 +205,12 @@ int eval_mm_valid(malloc_impl_t *impl, trace_t *trace, int tracenum)
   char *newp;
   char *oldp;
   char *p;
-  range_t *ranges = NULL;
+  ranges_t ranges;
+
+  /* Start with an empty range tree. */
+  if ((ranges.nodes = malloc(trace->num_ids * sizeof(range_t))) == NULL)
+    unix_error("malloc error in eval_mm_valid");
+  ranges.root = -1;
 
   /* Reset the heap. */
   impl->reset_brk();
@@ -155,6 +218,7 @@ int eval_mm_valid(malloc_impl_t *impl, trace_t *trace, int tracenum)
   /* Call the mm package's init function */
   if (impl->init() < 0) {
     malloc_error(tracenum, 0, "impl init failed.");
+    free(ranges.nodes);
     return 0;
   }
 
@@ -170,16 +234,16 @@ int eval_mm_valid(malloc_impl_t *impl, trace_t *trace, int tracenum)
         /* Call the student's malloc */
         if ((p = impl->malloc(size)) == NULL) {
           malloc_error(tracenum, i, "impl malloc failed.");
-          return 0;
+          goto fail;
         }
 
         /*
          * Test the range of the new block for correctness and add it
-         * to the range list if OK. The block must be  be aligned properly,
+         * to the range tree if OK. The block must be  be aligned properly,
          * and must not overlap any currently allocated block.
          */
-        if (add_range(impl, &ranges, p, size, tracenum, i) == 0)
-          return 0;
+        if (add_range(impl, &ranges, index, p, size, tracenum, i) == 0)
+          goto fail;
 
         /* Fill the allocated region with some unique data that you can check
          * for if the region is copied via realloc.
@@ -191,21 +255,65 @@ int eval_mm_valid(malloc_impl_t *impl, trace_t *trace, int tracenum)
         trace->block_sizes[index] = size;
         break;
 
+      case CALLOC: /* calloc */
+
+        if ((p = impl->calloc(1, size)) == NULL) {
+          malloc_error(tracenum, i, "impl calloc failed.");
+          goto fail;
+        }
+        if (add_range(impl, &ranges, index, p, size, tracenum, i) == 0)
+          goto fail;
+
+        /* The block must come back zeroed, even if it reuses freed memory
+         * that still holds another block's fill pattern. */
+        for (j = 0; j < size; j++) {
+          if (p[j] != 0) {
+            malloc_error(tracenum, i, "impl calloc did not zero the block");
+            goto fail;
+          }
+        }
+        memset(p, index & 0xFF, size);
+
+        trace->blocks[index] = p;
+        trace->block_sizes[index] = size;
+        break;
+
+      case MEMALIGN: /* memalign */
+
+        if ((p = impl->memalign(trace->ops[i].align, size)) == NULL) {
+          malloc_error(tracenum, i, "impl memalign failed.");
+          goto fail;
+        }
+        if ((uintptr_t)p % trace->ops[i].align != 0) {
+          char msg[MAXLINE];
+          sprintf(msg, "Payload address (%p) not aligned to %d bytes",
+                  p, trace->ops[i].align);
+          malloc_error(tracenum, i, msg);
+          goto fail;
+        }
+        if (add_range(impl, &ranges, index, p, size, tracenum, i) == 0)
+          goto fail;
+        memset(p, index & 0xFF, size);
+
+        trace->blocks[index] = p;
+        trace->block_sizes[index] = size;
+        break;
+
       case REALLOC: /* realloc */
 
         /* Call the student's realloc */
         oldp = trace->blocks[index];
         if ((newp = impl->realloc(oldp, size)) == NULL) {
           malloc_error(tracenum, i, "impl realloc failed.");
-          return 0;
+          goto fail;
         }
 
-        /* Remove the old region from the range list */
-        remove_range(&ranges, oldp);
+        /* Remove the old region from the range tree */
+        remove_range(&ranges, index);
 
-        /* Check new block for correctness and add it to range list */
-        if (add_range(impl, &ranges, newp, size, tracenum, i) == 0)
-          return 0;
+        /* Check new block for correctness and add it to the range tree */
+        if (add_range(impl, &ranges, index, newp, size, tracenum, i) == 0)
+          goto fail;
 
         /* Make sure that the new block contains the data from the old block,
          * and then fill in the new block with new data that you can use to
@@ -214,10 +322,10 @@ int eval_mm_valid(malloc_impl_t *impl, trace_t *trace, int tracenum)
         oldsize = trace->block_sizes[index];
         if (size < oldsize) oldsize = size;
         for (j = 0; j < oldsize; j++) {
-          if (newp[j] != (index & 0xFF)) {
+          if ((unsigned char)newp[j] != (index & 0xFF)) {
             malloc_error(tracenum, i, "impl realloc did not preserve the "
                          "data from old block");
-            return 0;
+            goto fail;
           }
         }
         memset(newp, index & 0xFF, size);
@@ -229,12 +337,23 @@ int eval_mm_valid(malloc_impl_t *impl, trace_t *trace, int tracenum)
 
       case FREE: /* free */
 
-        /* Remove region from list and call student's free function */
+        /* Remove region from the tree and call student's free function */
         p = trace->blocks[index];
-        remove_range(&ranges, p);
+        remove_range(&ranges, index);
         impl->free(p);
         break;
 
+      case SIZED_FREE: /* free with the block's size */
+
+        if (size != trace->block_sizes[index]) {
+          malloc_error(tracenum, i, "trace gives a sized free the wrong size");
+          goto fail;
+        }
+        p = trace->blocks[index];
+        remove_range(&ranges, index);
+        impl->free_sized(p, size);
+        break;
+
       default:
         app_error("Nonexistent request type in eval_mm_valid");
     }
@@ -243,8 +362,12 @@ int eval_mm_valid(malloc_impl_t *impl, trace_t *trace, int tracenum)
 
   /* Free ranges allocated and reset the heap. */
   impl->reset_brk();
-  clear_ranges(&ranges);
+  free(ranges.nodes);
 
   /* As far as we know, this is a valid malloc package */
   return 1;
+
+fail:
+  free(ranges.nodes);
+  return 0;
 }